@@ -0,0 +1,431 @@
+#ifndef PROJECT_BASE_ASSET_HOT_RELOAD_H
+#define PROJECT_BASE_ASSET_HOT_RELOAD_H
+
+#include <glad/glad.h>
+
+#include <learnopengl/model.h>
+
+#include <common.h>
+#include <compressed_texture.h>
+#include <dds.h>
+#include <mapped_file.h>
+#include <mip_cache.h>
+#include <model_cache.h>
+#include <texture_registry.h>
+#include <texture_streamer.h>
+
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a burst of file events is handled once no new event arrived for this long, in milliseconds; editors and
+// exporters often write a file in several steps
+#define HOT_RELOAD_SETTLE_MS 150
+// GL-thread time update() may spend per frame on swapping in reloaded assets, in milliseconds
+#define HOT_RELOAD_FRAME_BUDGET_MS 2.0
+
+// Watches asset directories with inotify and reloads what changed while the scene keeps running.
+//
+// A background thread collects file events, re-imports every tracked Model whose source file or one of the
+// material libraries it names changed, and decodes changed textures that the TextureRegistry holds. The GL thread calls
+// update() once per frame. A reloaded model is uploaded mesh by mesh into a new Model and, once every mesh is
+// resident, swapped into the existing Model object, so every Object::setModel pointer draws it from the next
+// frame on. A reloaded texture is written into its existing GL texture id, so every mesh sharing it updates at
+// once. Pixels go through the MipCache and the TextureStreamer, whose per-frame byte budget keeps large textures
+// from stalling a frame; the texture keeps its previous contents until the new ones land. update() itself stops uploading once HOT_RELOAD_FRAME_BUDGET_MS is used up and resumes on the next
+// frame.
+class AssetHotReload {
+public:
+    explicit AssetHotReload(TextureStreamer &streamer) : streamer(streamer) {
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) {
+            std::cout << "ERROR::HOT_RELOAD:: inotify unavailable, assets will not be reloaded" << std::endl;
+            return;
+        }
+        watcher = std::thread([this] { watchLoop(); });
+    }
+
+    ~AssetHotReload() {
+        stopping = true;
+        if (watcher.joinable())
+            watcher.join();
+        if (fd >= 0)
+            close(fd);
+    }
+
+    AssetHotReload(const AssetHotReload &) = delete;
+    AssetHotReload &operator=(const AssetHotReload &) = delete;
+
+    // watches a directory and all of its subdirectories, including ones created later
+    void watch(const std::string &directory) {
+        if (fd < 0)
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        addWatch(TextureRegistry::canonicalPath(directory));
+    }
+
+    // reloads the model in place whenever its source file or one of its material libraries changes. Only a
+    // weak reference is kept, and a model shared by several objects needs to be tracked once.
+    void track(const ModelHandle &model) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const TrackedModel &tracked : models)
+            if (tracked.model.lock() == model)
+                return;
+        models.push_back(TrackedModel{model, TextureRegistry::canonicalPath(model->path), canonicalPaths(model->dependencies)});
+    }
+
+    // uploads and swaps in reloaded assets until the frame budget is spent; call once per frame on the GL thread
+    void update(double budgetMs = HOT_RELOAD_FRAME_BUDGET_MS) {
+        auto start = std::chrono::steady_clock::now();
+        finishTextures();
+        do {
+            if (swapping) {
+                continueSwap(start, budgetMs);
+                continue;
+            }
+            std::unique_ptr<Reloaded> reloaded;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (ready.empty())
+                    return;
+                reloaded = std::move(ready.front());
+                ready.pop_front();
+            }
+            if (reloaded->texturePath.empty())
+                beginSwap(*reloaded);
+            else
+                swapTexture(*reloaded);
+        } while (elapsedMs(start) < budgetMs);
+    }
+
+private:
+    struct TrackedModel {
+        std::weak_ptr<Model> model;
+        std::string canonicalPath;
+        std::vector<std::string> dependencies; // canonical, as of the last import
+
+        bool dependsOn(const std::string &path) const {
+            return canonicalPath == path || std::find(dependencies.begin(), dependencies.end(), path) != dependencies.end();
+        }
+    };
+
+    // a re-imported model or a re-read texture (texturePath set), waiting for the GL thread
+    struct Reloaded {
+        std::weak_ptr<Model> model; // weak, so the model is never destroyed off the GL thread
+        ModelData data;
+        std::string texturePath; // canonical source path, the TextureRegistry key
+        TextureHandle texture;   // only ever released on the GL thread, which is where textures are deleted
+        uint64_t contentHash = 0;
+        MipChain mips;
+        CompressedImage compressed;
+    };
+
+    // a replaced whole texture whose new pixels are still on their way through the streamer
+    struct StreamingTexture {
+        TextureHandle texture;
+        uint64_t contentHash;
+        size_t bytes;
+    };
+
+    // a reloaded model whose meshes are uploaded over as many update() calls as the budget needs
+    struct ModelSwap {
+        std::weak_ptr<Model> model;
+        std::unique_ptr<Model> fresh;
+        double uploadMs = 0.0;
+        unsigned int frames = 0;
+    };
+
+    TextureStreamer &streamer;
+    std::unique_ptr<ModelSwap> swapping; // GL thread only
+    std::vector<StreamingTexture> streaming; // GL thread only
+    int fd = -1;
+    std::thread watcher;
+    std::atomic<bool> stopping{false};
+
+    std::mutex mutex; // guards everything below
+    std::map<int, std::string> directories; // watch descriptor -> canonical directory
+    std::vector<TrackedModel> models;
+    std::deque<std::unique_ptr<Reloaded>> ready;
+
+    static std::string extension(const std::string &path) {
+        size_t dot = path.find_last_of('.');
+        size_t slash = path.find_last_of('/');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            return "";
+        std::string ext = path.substr(dot);
+        for (char &c : ext)
+            c = (char) tolower((unsigned char) c);
+        return ext;
+    }
+
+    static double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static std::vector<std::string> canonicalPaths(const std::vector<std::string> &paths) {
+        std::vector<std::string> canonical;
+        for (const std::string &path : paths)
+            canonical.push_back(TextureRegistry::canonicalPath(path));
+        return canonical;
+    }
+
+    static bool isImage(const std::string &ext) {
+        return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".tga" || ext == ".bmp";
+    }
+
+    // expects the mutex to be held
+    void addWatch(const std::string &directory) {
+        int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+        if (wd < 0) {
+            std::cout << "ERROR::HOT_RELOAD:: could not watch " << directory << std::endl;
+            return;
+        }
+        directories[wd] = directory;
+        DIR *dir = opendir(directory.c_str());
+        if (!dir)
+            return;
+        while (dirent *entry = readdir(dir)) {
+            if (entry->d_name[0] == '.')
+                continue;
+            std::string child = directory + '/' + entry->d_name;
+            struct stat st;
+            if (stat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+                addWatch(child);
+        }
+        closedir(dir);
+    }
+
+    void watchLoop() {
+        std::set<std::string> changed;
+        alignas(inotify_event) char buffer[16 * 1024];
+        while (!stopping) {
+            pollfd descriptor = {fd, POLLIN, 0};
+            int events = poll(&descriptor, 1, HOT_RELOAD_SETTLE_MS);
+            if (events == 0) {
+                // quiet for a while: everything collected so far has been written completely
+                if (!changed.empty())
+                    reload(changed);
+                changed.clear();
+                continue;
+            }
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+            for (ssize_t offset = 0; offset < length;) {
+                const inotify_event *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                offset += sizeof(inotify_event) + event->len;
+                if (event->len == 0)
+                    continue;
+                std::lock_guard<std::mutex> lock(mutex);
+                auto directory = directories.find(event->wd);
+                if (directory == directories.end())
+                    continue;
+                std::string path = directory->second + '/' + event->name;
+                if (event->mask & IN_ISDIR) {
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                        addWatch(path);
+                } else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                    changed.insert(path);
+                }
+            }
+        }
+    }
+
+    // runs on the watcher thread: imports and decodes, then queues the results for update()
+    void reload(const std::set<std::string> &changed) {
+        // the edited files are newer than what the resource archive holds
+        for (const std::string &path : changed)
+            PakArchive::instance().overrideWithLooseFile(path);
+
+        std::vector<TrackedModel> dirtyModels;
+        std::set<std::string> dirtyTextures;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const TrackedModel &tracked : models) {
+                for (const std::string &path : changed) {
+                    if (!tracked.model.expired() && tracked.dependsOn(path)) {
+                        dirtyModels.push_back(tracked);
+                        break;
+                    }
+                }
+            }
+            for (const std::string &path : changed) {
+                std::string ext = extension(path);
+                if (isImage(ext))
+                    dirtyTextures.insert(path);
+                else if (ext == ".dds") {
+                    // a re-cooked texture: reload whichever source it was cooked from
+                    std::string stem = path.substr(0, path.size() - ext.size());
+                    for (const char *source : {".png", ".jpg", ".jpeg", ".tga", ".bmp"})
+                        dirtyTextures.insert(stem + source);
+                }
+            }
+        }
+
+        TextureRegistry &registry = TextureRegistry::instance();
+        for (const std::string &path : dirtyTextures) {
+            std::unique_ptr<Reloaded> reloaded(new Reloaded());
+            reloaded->texturePath = path;
+            reloaded->texture = registry.find(path);
+            if (!reloaded->texture)
+                continue;
+            // queued even when it cannot be read, as the handle may be the last one left
+            readTexture(*reloaded);
+            push(std::move(reloaded));
+        }
+
+        for (const TrackedModel &dirty : dirtyModels) {
+            std::unique_ptr<Reloaded> reloaded(new Reloaded());
+            reloaded->model = dirty.model;
+            reloaded->data = ModelImporter::import(dirty.canonicalPath);
+            if (reloaded->data.meshes.empty()) {
+                std::cout << "ERROR::HOT_RELOAD:: keeping the previous version of " << reloaded->data.path << std::endl;
+                continue;
+            }
+            // the edit may have added or removed an mtllib line
+            std::vector<std::string> dependencies = canonicalPaths(reloaded->data.dependencies);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (TrackedModel &tracked : models) {
+                    if (tracked.canonicalPath == dirty.canonicalPath)
+                        tracked.dependencies = dependencies;
+                }
+            }
+            push(std::move(reloaded));
+        }
+    }
+
+    // prefers a fresh cooked DDS like the importer does, and takes the source's full mip chain from the
+    // MipCache otherwise, decoding and rebuilding it when the cache is stale
+    static bool readTexture(Reloaded &reloaded) {
+        MappedFile file(reloaded.texturePath);
+        if (!file.isOpen())
+            return false;
+        reloaded.contentHash = hashBytes(file.data(), file.size());
+        std::string cooked = DDS::cookedPath(reloaded.texturePath);
+        if (DDS::isFresh(cooked, reloaded.texturePath) && DDS::read(cooked, reloaded.compressed))
+            return true;
+        reloaded.mips = MipCache::load(reloaded.texturePath, file.data(), file.size(), reloaded.contentHash, reloaded.texture->srgb);
+        if (!reloaded.mips.valid())
+            std::cout << "ERROR::HOT_RELOAD:: could not decode " << reloaded.texturePath << std::endl;
+        return reloaded.mips.valid();
+    }
+
+    void push(std::unique_ptr<Reloaded> reloaded) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.push_back(std::move(reloaded));
+    }
+
+    // creates the new model without uploading anything; continueSwap() uploads it
+    void beginSwap(Reloaded &reloaded) {
+        ModelHandle model = reloaded.model.lock();
+        if (!model)
+            return; // released while it was being re-imported
+        swapping.reset(new ModelSwap());
+        swapping->model = model;
+        swapping->fresh.reset(new Model(std::move(reloaded.data), model->gammaCorrection, &streamer, false, true));
+    }
+
+    // uploads meshes of the new model until the budget is spent, and swaps it in once all of them are resident
+    void continueSwap(std::chrono::steady_clock::time_point frameStart, double budgetMs) {
+        ModelHandle model = swapping->model.lock();
+        if (!model) {
+            swapping.reset(); // released while it was being uploaded
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        bool complete;
+        while (!(complete = swapping->fresh->uploadNextMesh()) && elapsedMs(frameStart) < budgetMs) {}
+        swapping->uploadMs += elapsedMs(start);
+        swapping->frames++;
+        if (!complete)
+            return;
+        model->swapContents(*swapping->fresh);
+        std::cout << "HOT_RELOAD:: swapped " << model->path << " in " << swapping->uploadMs << " ms over "
+                  << swapping->frames << " frame(s)" << std::endl;
+        // fresh now holds the previous meshes and texture references and releases them here
+        swapping.reset();
+    }
+
+    void swapTexture(Reloaded &reloaded) {
+        TextureRegistry &registry = TextureRegistry::instance();
+        TextureHandle texture = std::move(reloaded.texture);
+        bool compressed = reloaded.compressed.valid() && CompressedTexture::supported(reloaded.compressed.format);
+        if (texture.use_count() == 1 || (!compressed && !reloaded.mips.valid()))
+            return; // released meanwhile, or nothing usable was read
+
+        if (compressed) {
+            // the previous contents may have been streamed, with only some levels resident, or mipmapped
+            // from a source without a swizzle
+            streamer.forget(texture->id);
+            glBindTexture(GL_TEXTURE_2D, texture->id);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_GREEN);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_BLUE);
+            CompressedTexture::uploadLevels(GL_TEXTURE_2D, reloaded.compressed);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) reloaded.compressed.levels.size() - 1);
+            CompressedTexture::applySwizzle(GL_TEXTURE_2D, reloaded.compressed.format);
+            registry.updateContent(texture, reloaded.contentHash, reloaded.compressed.totalSize());
+            ResidencyManager::instance().update(texture->residency, texture->bytes, true);
+            std::cout << "HOT_RELOAD:: replaced " << reloaded.texturePath << std::endl;
+            return;
+        }
+
+        // the uploads wait in the streamer, which has to drop them should the texture be released first
+        if (!texture->onRelease) {
+            TextureStreamer *owner = &streamer;
+            texture->onRelease = [owner](unsigned int id) { owner->forget(id); };
+        }
+        size_t bytes = reloaded.mips.totalSize();
+        // textures without a residency entry were streamed by coverage and stay that way; the streamer
+        // accounts for their resident levels
+        bool streamLevels = !texture->residency.valid();
+        streamer.replace(texture->id, std::move(reloaded.mips), streamLevels, "AssetHotReload", reloaded.texturePath);
+        if (streamLevels) {
+            registry.updateContent(texture, reloaded.contentHash, bytes);
+            texture->memory.resize(0);
+            std::cout << "HOT_RELOAD:: replaced " << reloaded.texturePath << std::endl;
+            return;
+        }
+        // whole textures keep their previous size and residency until the new chain is on the GPU
+        streaming.erase(std::remove_if(streaming.begin(), streaming.end(), [&texture](const StreamingTexture &pending) {
+            return pending.texture == texture;
+        }), streaming.end());
+        streaming.push_back(StreamingTexture{texture, reloaded.contentHash, bytes});
+    }
+
+    // accounts the whole textures whose replacement the streamer has finished uploading
+    void finishTextures() {
+        TextureRegistry &registry = TextureRegistry::instance();
+        for (size_t i = 0; i < streaming.size();) {
+            StreamingTexture &pending = streaming[i];
+            if (pending.texture.use_count() == 1) {
+                streaming.erase(streaming.begin() + i); // nothing uses it any more, so it is released here
+                continue;
+            }
+            if (!streamer.isResident(pending.texture->id)) {
+                i++;
+                continue;
+            }
+            registry.updateContent(pending.texture, pending.contentHash, pending.bytes);
+            ResidencyManager::instance().update(pending.texture->residency, pending.bytes, true);
+            std::cout << "HOT_RELOAD:: replaced " << pending.texture->canonicalPath << std::endl;
+            streaming.erase(streaming.begin() + i);
+        }
+    }
+};
+
+#endif //PROJECT_BASE_ASSET_HOT_RELOAD_H
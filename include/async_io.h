@@ -0,0 +1,477 @@
+#ifndef PROJECT_BASE_ASYNC_IO_H
+#define PROJECT_BASE_ASYNC_IO_H
+
+#include <mapped_file.h>
+#include <pak_archive.h>
+#include <thread_pool.h>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// reads kept in flight by the io_uring backend at once
+#define ASYNC_IO_QUEUE_DEPTH 64
+// files at least this large are read with O_DIRECT, past the page cache, so their data is not held twice
+#define ASYNC_IO_DIRECT_MIN_BYTES (256 * 1024)
+// buffer, offset and length alignment O_DIRECT needs
+#define ASYNC_IO_ALIGNMENT 4096
+
+// The part of io_uring that reading files needs, over the raw syscalls: one submission and one completion
+// ring, read requests only. Used from a single thread.
+class IoUring {
+public:
+    IoUring() = default;
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    ~IoUring() {
+        if (sqes)
+            munmap(sqes, sqesSize);
+        if (cqRing && cqRing != sqRing)
+            munmap(cqRing, cqRingSize);
+        if (sqRing)
+            munmap(sqRing, sqRingSize);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    // false when the kernel does not offer io_uring or it is disabled
+    bool init(unsigned int entries) {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0)
+            return false;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap)
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        sqRing = map(sqRingSize, IORING_OFF_SQ_RING);
+        cqRing = singleMap ? sqRing : map(cqRingSize, IORING_OFF_CQ_RING);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(map(sqesSize, IORING_OFF_SQES));
+        if (!sqRing || !cqRing || !sqes)
+            return false;
+
+        char *sq = static_cast<char *>(sqRing), *cq = static_cast<char *>(cqRing);
+        sqHead = reinterpret_cast<unsigned int *>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned int *>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned int *>(sq + params.sq_off.ring_mask);
+        sqEntries = *reinterpret_cast<unsigned int *>(sq + params.sq_off.ring_entries);
+        sqArray = reinterpret_cast<unsigned int *>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned int *>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned int *>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned int *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // queues a read for the next submit; false while the submission ring is full
+    bool prepareRead(int file, void *buffer, unsigned int length, uint64_t offset, uint64_t userData) {
+        unsigned int tail = *sqTail;
+        if (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+            return false;
+        unsigned int index = tail & sqMask;
+        io_uring_sqe &sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = file;
+        sqe.addr = (uint64_t) (uintptr_t) buffer;
+        sqe.len = length;
+        sqe.off = offset;
+        sqe.user_data = userData;
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        prepared++;
+        return true;
+    }
+
+    // submits everything prepared and waits until at least minComplete reads have completed. On false
+    // nothing prepared was submitted, and cancelPrepared() takes it back.
+    bool submitAndWait(unsigned int minComplete) {
+        for (;;) {
+            int submitted = (int) syscall(__NR_io_uring_enter, fd, prepared, minComplete,
+                                          minComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (submitted >= 0) {
+                prepared -= (unsigned int) submitted;
+                return true;
+            }
+            if (errno == EAGAIN || errno == EBUSY) {
+                // the kernel is short of resources until some reads complete
+                if (syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                    return false;
+            } else if (errno != EINTR) {
+                return false;
+            }
+        }
+    }
+
+    // the kernel only looks at the submission ring when entered, so unsubmitted reads can be dropped
+    void cancelPrepared() {
+        __atomic_store_n(sqTail, *sqTail - prepared, __ATOMIC_RELEASE);
+        prepared = 0;
+    }
+
+    // calls handler(userData, result) for every completed read; result is the byte count or -errno
+    template<typename Handler>
+    void reap(Handler handler) {
+        unsigned int head = *cqHead;
+        while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe &cqe = cqes[head & cqMask];
+            handler(cqe.user_data, cqe.res);
+            head++;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    int fd = -1;
+    void *sqRing = nullptr, *cqRing = nullptr;
+    size_t sqRingSize = 0, cqRingSize = 0, sqesSize = 0;
+    io_uring_sqe *sqes = nullptr;
+    unsigned int *sqHead = nullptr, *sqTail = nullptr, *sqArray = nullptr;
+    unsigned int *cqHead = nullptr, *cqTail = nullptr;
+    unsigned int sqMask = 0, sqEntries = 0, cqMask = 0;
+    io_uring_cqe *cqes = nullptr;
+    unsigned int prepared = 0;
+
+    void *map(size_t size, off_t offset) {
+        void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return ptr == MAP_FAILED ? nullptr : ptr;
+    }
+};
+
+// Asynchronous whole-file reads. read() returns a future of the file's contents in memory; prefetch()
+// starts reading files some loader will open soon, and MappedFile::open then takes the finished buffer
+// over instead of touching the disk itself. With many files requested at once the reads overlap, and the
+// disk can serve them in the order that suits it. io_uring is used when the kernel offers it, a small pool
+// of blocking readers otherwise. Large files are read with O_DIRECT, and the page cache is dropped after
+// buffered reads, so the data is not held by the OS and by the loader at the same time. Files in the
+// mounted PakArchive are already mapped; they are only paged in ahead of time. Thread safe.
+class AsyncIO {
+public:
+    static AsyncIO &instance() {
+        static AsyncIO io;
+        return io;
+    }
+
+    AsyncIO(const AsyncIO &) = delete;
+    AsyncIO &operator=(const AsyncIO &) = delete;
+
+    ~AsyncIO() {
+        MappedFile::openHook() = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (service.joinable())
+            service.join();
+        pool.reset(); // finishes the queued jobs while the rest of the service is still alive
+    }
+
+    // the contents of path once read; an unopened MappedFile if it cannot be read
+    std::future<MappedFile> read(const std::string &path) {
+        std::shared_ptr<Request> request = std::make_shared<Request>();
+        request->path = path;
+        std::future<MappedFile> future = request->promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests++;
+        }
+        if (const PakEntry *entry = PakArchive::instance().find(path)) {
+            // already mapped: stored entries are handed out in place, compressed ones decompressed on the pool
+            PakArchive::instance().willNeed(*entry);
+            if (entry->compression == PAK_STORED)
+                request->promise.set_value(MappedFile(path));
+            else
+                pool->submit([request] { request->promise.set_value(MappedFile(request->path)); });
+        } else if (ring) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(request);
+            }
+            wake.notify_one();
+        } else {
+            pool->submit([this, request] { readBlocking(*request); });
+        }
+        return future;
+    }
+
+    // starts reading path for a later MappedFile::open of the same file
+    void prefetch(const std::string &path) {
+        const PakArchive &archive = PakArchive::instance();
+        if (const PakEntry *entry = archive.find(path)) {
+            archive.willNeed(*entry);
+            return;
+        }
+        std::string key = PakArchive::normalize(path, cwd);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (prefetched.count(key))
+                return;
+        }
+        std::future<MappedFile> future = read(path);
+        std::lock_guard<std::mutex> lock(mutex);
+        prefetched.emplace(key, std::move(future));
+    }
+
+    // forgets prefetched files nobody opened, e.g. a cache that turned out to be stale, and frees their memory
+    void dropUnclaimed() {
+        std::unordered_map<std::string, std::future<MappedFile>> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            dropped.swap(prefetched);
+            unclaimed += dropped.size();
+        }
+        // the futures wait for their reads to finish as they go
+    }
+
+    const char *backend() const {
+        return ring ? "io_uring" : "thread pool";
+    }
+
+    void report(std::ostream &out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "IO:: " << backend() << ", " << requests << " reads (" << directReads << " direct) of "
+            << bytesRead / (1024.0 * 1024.0) << " MB, up to " << maxInFlight << " in flight, " << claimed
+            << " prefetches used, " << unclaimed << " unused" << std::endl;
+    }
+
+private:
+    struct Request {
+        std::string path;
+        std::promise<MappedFile> promise;
+        int fd = -1;
+        unsigned char *buffer = nullptr;
+        size_t size = 0, done = 0;
+        bool direct = false;
+    };
+
+    std::unique_ptr<IoUring> ring;
+    std::unique_ptr<ThreadPool> pool;
+    std::thread service;
+    std::string cwd;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::shared_ptr<Request>> queue; // waiting for the io_uring service thread
+    std::unordered_map<std::string, std::future<MappedFile>> prefetched; // by normalized path
+    bool stopping = false;
+    size_t requests = 0, blockingReads = 0, directReads = 0, bytesRead = 0, maxInFlight = 0, claimed = 0, unclaimed = 0;
+
+    AsyncIO() : cwd(PakArchive::currentDirectory()) {
+        std::unique_ptr<IoUring> uring(new IoUring());
+        if (uring->init(ASYNC_IO_QUEUE_DEPTH)) {
+            ring = std::move(uring);
+            service = std::thread([this] { serviceLoop(); });
+        }
+        // with io_uring the pool only decompresses archive entries; without it, it does the blocking reads
+        pool.reset(new ThreadPool(ring ? 1 : 4));
+        MappedFile::openHook() = &AsyncIO::claim;
+    }
+
+    // MappedFile::OpenHook: hands over a prefetched file, waiting for its read if it is still running
+    static bool claim(const std::string &path, MappedFile &file) {
+        AsyncIO &io = instance();
+        std::future<MappedFile> future;
+        {
+            std::lock_guard<std::mutex> lock(io.mutex);
+            if (io.prefetched.empty())
+                return false;
+            auto entry = io.prefetched.find(PakArchive::normalize(path, io.cwd));
+            if (entry == io.prefetched.end())
+                return false;
+            future = std::move(entry->second);
+            io.prefetched.erase(entry);
+            io.claimed++;
+        }
+        file = future.get();
+        return file.isOpen();
+    }
+
+    static size_t alignUp(size_t size) {
+        return (size + ASYNC_IO_ALIGNMENT - 1) / ASYNC_IO_ALIGNMENT * ASYNC_IO_ALIGNMENT;
+    }
+
+    // opens the file and allocates its buffer; false if there is nothing to read
+    bool start(Request &request) {
+        request.fd = ::open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (request.fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(request.fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+            return false;
+        request.size = (size_t) st.st_size;
+        if (request.size >= ASYNC_IO_DIRECT_MIN_BYTES) {
+            // not every file system supports it (tmpfs does not); those are read through the page cache
+            int flags = fcntl(request.fd, F_GETFL);
+            request.direct = flags >= 0 && fcntl(request.fd, F_SETFL, flags | O_DIRECT) == 0;
+        }
+        void *buffer = nullptr;
+        if (posix_memalign(&buffer, ASYNC_IO_ALIGNMENT, alignUp(request.size)) != 0)
+            return false;
+        request.buffer = static_cast<unsigned char *>(buffer);
+        return true;
+    }
+
+    // a direct read failed, e.g. on an unaligned remainder: continue through the page cache
+    static void stopDirect(Request &request) {
+        int flags = fcntl(request.fd, F_GETFL);
+        if (flags >= 0)
+            fcntl(request.fd, F_SETFL, flags & ~O_DIRECT);
+        request.direct = false;
+    }
+
+    // length of the next read: whole pages for direct reads, which may run past the end of the file
+    static size_t nextLength(const Request &request) {
+        size_t remaining = request.size - request.done;
+        return std::min<size_t>(request.direct ? alignUp(remaining) : remaining, 1u << 30);
+    }
+
+    void finish(Request &request, bool ok) {
+        if (request.fd >= 0) {
+            if (ok && !request.direct)
+                posix_fadvise(request.fd, 0, 0, POSIX_FADV_DONTNEED);
+            ::close(request.fd);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ok) {
+                bytesRead += request.size;
+                directReads += request.direct;
+            }
+        }
+        if (!ok) {
+            free(request.buffer);
+            request.buffer = nullptr;
+        }
+        request.promise.set_value(MappedFile::adopt(request.buffer, ok ? request.size : 0));
+    }
+
+    // reads the file, or the rest of it when the io_uring backend gave up on it
+    void readBlocking(Request &request) {
+        if (!request.buffer && !start(request)) {
+            finish(request, false);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            maxInFlight = std::max(maxInFlight, ++blockingReads);
+        }
+        while (request.done < request.size) {
+            ssize_t result = pread(request.fd, request.buffer + request.done, nextLength(request), (off_t) request.done);
+            if (result < 0 && errno == EINTR)
+                continue;
+            if (result < 0 && request.direct) {
+                stopDirect(request);
+                continue;
+            }
+            if (result <= 0)
+                break;
+            request.done += std::min<size_t>((size_t) result, request.size - request.done);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            blockingReads--;
+        }
+        finish(request, request.done == request.size);
+    }
+
+    // owns the ring: opens queued files, keeps up to ASYNC_IO_QUEUE_DEPTH reads in flight and completes
+    // requests as their last bytes arrive
+    void serviceLoop() {
+        std::deque<std::shared_ptr<Request>> ready; // opened, waiting for a free submission slot
+        std::unordered_map<Request *, std::shared_ptr<Request>> inFlight;
+        for (;;) {
+            std::deque<std::shared_ptr<Request>> incoming;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (inFlight.empty() && ready.empty())
+                    wake.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping && queue.empty() && inFlight.empty() && ready.empty())
+                    return;
+                incoming.swap(queue);
+            }
+            for (std::shared_ptr<Request> &request : incoming) {
+                if (start(*request))
+                    ready.push_back(std::move(request));
+                else
+                    finish(*request, false);
+            }
+
+            // more than the queue depth in flight could overflow the completion ring
+            std::vector<Request *> submitting;
+            while (!ready.empty() && inFlight.size() < ASYNC_IO_QUEUE_DEPTH) {
+                Request &request = *ready.front();
+                if (!ring->prepareRead(request.fd, request.buffer + request.done, (unsigned int) nextLength(request),
+                                       request.done, (uint64_t) (uintptr_t) &request))
+                    break;
+                submitting.push_back(&request);
+                inFlight[&request] = std::move(ready.front());
+                ready.pop_front();
+            }
+            // only block for completions when nothing else can be done until one arrives
+            bool wait = !inFlight.empty() && (ready.empty() || inFlight.size() >= ASYNC_IO_QUEUE_DEPTH);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                maxInFlight = std::max(maxInFlight, inFlight.size());
+                wait = wait && queue.empty();
+            }
+            if (!ring->submitAndWait(wait ? 1 : 0)) {
+                // the reads submitted before still complete through the ring; these go to the pool instead
+                std::cout << "ERROR::ASYNC_IO:: io_uring_enter failed: " << strerror(errno) << std::endl;
+                ring->cancelPrepared();
+                for (Request *request : submitting) {
+                    std::shared_ptr<Request> owned = std::move(inFlight[request]);
+                    inFlight.erase(request);
+                    pool->submit([this, owned] { readBlocking(*owned); });
+                }
+                continue;
+            }
+            ring->reap([&](uint64_t userData, int result) {
+                auto entry = inFlight.find(reinterpret_cast<Request *>((uintptr_t) userData));
+                std::shared_ptr<Request> request = std::move(entry->second);
+                inFlight.erase(entry);
+                if (result < 0 && request->direct) {
+                    stopDirect(*request);
+                    ready.push_front(std::move(request));
+                    return;
+                }
+                if (result < 0 && result != -EINTR && result != -EAGAIN) {
+                    finish(*request, false);
+                    return;
+                }
+                if (result > 0)
+                    request->done += std::min<size_t>((size_t) result, request->size - request->done);
+                if (request->done == request->size)
+                    finish(*request, true);
+                else if (result == 0)
+                    finish(*request, false); // the file shrank
+                else
+                    ready.push_front(std::move(request)); // a short read, or interrupted: read the rest
+            });
+        }
+    }
+};
+
+#endif //PROJECT_BASE_ASYNC_IO_H
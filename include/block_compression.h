@@ -0,0 +1,192 @@
+#ifndef PROJECT_BASE_BLOCK_COMPRESSION_H
+#define PROJECT_BASE_BLOCK_COMPRESSION_H
+
+#include <thread_pool.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// CPU encoders for the block compressed formats used by cooked textures. Every format works on 4x4
+// texel blocks; images are padded by clamping to the edge. The encoders use the bounding-box-with-inset
+// endpoint selection from van Waveren's "Real-Time DXT Compression", which is fast and good enough for
+// offline cooking of the bundled assets.
+//
+//   BC1 (8 bytes/block)  RGB albedo
+//   BC3 (16 bytes/block) RGBA albedo with a meaningful alpha channel
+//   BC4 (8 bytes/block)  single channel, used for the grayscale bump/height maps
+//   BC5 (16 bytes/block) two channels, used for tangent-space normal maps (z is rebuilt in the shader)
+enum BlockFormat {
+    BLOCK_BC1,
+    BLOCK_BC3,
+    BLOCK_BC4,
+    BLOCK_BC5
+};
+
+class BlockCompressor {
+public:
+    static size_t blockBytes(BlockFormat format) {
+        return format == BLOCK_BC1 || format == BLOCK_BC4 ? 8 : 16;
+    }
+
+    static size_t compressedSize(BlockFormat format, int width, int height) {
+        return (size_t) ((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+    }
+
+    // compresses an RGBA8 image. Rows of blocks are split across the pool's workers.
+    static std::vector<unsigned char> compress(const unsigned char *rgba, int width, int height, BlockFormat format, ThreadPool &pool) {
+        std::vector<unsigned char> out(compressedSize(format, width, height));
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        int rowsPerJob = std::max(1, blocksY / (int) (pool.size() * 4));
+        for (int firstRow = 0; firstRow < blocksY; firstRow += rowsPerJob) {
+            int lastRow = std::min(blocksY, firstRow + rowsPerJob);
+            pool.submit([=, &out] {
+                unsigned char block[64];
+                for (int by = firstRow; by < lastRow; by++) {
+                    for (int bx = 0; bx < blocksX; bx++) {
+                        fetchBlock(rgba, width, height, bx * 4, by * 4, block);
+                        encodeBlock(block, format, &out[((size_t) by * blocksX + bx) * blockBytes(format)]);
+                    }
+                }
+            });
+        }
+        pool.wait();
+        return out;
+    }
+
+    static void encodeBlock(const unsigned char block[64], BlockFormat format, unsigned char *out) {
+        switch (format) {
+            case BLOCK_BC1:
+                encodeColor(block, out);
+                break;
+            case BLOCK_BC3:
+                encodeChannel(block, 3, out);
+                encodeColor(block, out + 8);
+                break;
+            case BLOCK_BC4:
+                encodeChannel(block, 0, out);
+                break;
+            case BLOCK_BC5:
+                encodeChannel(block, 0, out);
+                encodeChannel(block, 1, out + 8);
+                break;
+        }
+    }
+
+private:
+    static void fetchBlock(const unsigned char *rgba, int width, int height, int x0, int y0, unsigned char block[64]) {
+        for (int y = 0; y < 4; y++) {
+            int sy = std::min(y0 + y, height - 1);
+            for (int x = 0; x < 4; x++) {
+                int sx = std::min(x0 + x, width - 1);
+                memcpy(block + (y * 4 + x) * 4, rgba + ((size_t) sy * width + sx) * 4, 4);
+            }
+        }
+    }
+
+    static uint16_t pack565(const int c[3]) {
+        return (uint16_t) (((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3));
+    }
+
+    static void unpack565(uint16_t v, int c[3]) {
+        c[0] = ((v >> 11) & 31) * 255 / 31;
+        c[1] = ((v >> 5) & 63) * 255 / 63;
+        c[2] = (v & 31) * 255 / 31;
+    }
+
+    // BC1 colour block, always in four-colour mode
+    static void encodeColor(const unsigned char block[64], unsigned char *out) {
+        int lo[3] = {255, 255, 255}, hi[3] = {0, 0, 0};
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < 3; c++) {
+                lo[c] = std::min(lo[c], (int) block[i * 4 + c]);
+                hi[c] = std::max(hi[c], (int) block[i * 4 + c]);
+            }
+        }
+        // pull the endpoints in by 1/16 of the range to reduce the error at the extremes
+        for (int c = 0; c < 3; c++) {
+            int inset = (hi[c] - lo[c]) >> 4;
+            lo[c] = std::min(255, lo[c] + inset);
+            hi[c] = std::max(0, hi[c] - inset);
+        }
+        uint16_t c0 = pack565(hi), c1 = pack565(lo);
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        int palette[4][3];
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        for (int c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        uint32_t indices = 0;
+        if (c0 != c1) {
+            for (int i = 0; i < 16; i++) {
+                int best = 0, bestError = 1 << 30;
+                for (int p = 0; p < 4; p++) {
+                    int error = 0;
+                    for (int c = 0; c < 3; c++) {
+                        int d = block[i * 4 + c] - palette[p][c];
+                        error += d * d;
+                    }
+                    if (error < bestError) {
+                        bestError = error;
+                        best = p;
+                    }
+                }
+                indices |= (uint32_t) best << (2 * i);
+            }
+        }
+
+        out[0] = (unsigned char) (c0 & 0xff);
+        out[1] = (unsigned char) (c0 >> 8);
+        out[2] = (unsigned char) (c1 & 0xff);
+        out[3] = (unsigned char) (c1 >> 8);
+        for (int b = 0; b < 4; b++)
+            out[4 + b] = (unsigned char) (indices >> (8 * b));
+    }
+
+    // BC4 block of one channel of the RGBA block, in eight-value mode
+    static void encodeChannel(const unsigned char block[64], int channel, unsigned char *out) {
+        int lo = 255, hi = 0;
+        for (int i = 0; i < 16; i++) {
+            lo = std::min(lo, (int) block[i * 4 + channel]);
+            hi = std::max(hi, (int) block[i * 4 + channel]);
+        }
+        int inset = (hi - lo) >> 5;
+        lo += inset;
+        hi -= inset;
+
+        int palette[8];
+        palette[0] = hi;
+        palette[1] = lo;
+        for (int p = 1; p < 7; p++)
+            palette[p + 1] = ((7 - p) * hi + p * lo) / 7;
+
+        uint64_t indices = 0;
+        if (hi != lo) {
+            for (int i = 0; i < 16; i++) {
+                int value = block[i * 4 + channel];
+                int best = 0, bestError = 256;
+                for (int p = 0; p < 8; p++) {
+                    int error = std::abs(value - palette[p]);
+                    if (error < bestError) {
+                        bestError = error;
+                        best = p;
+                    }
+                }
+                indices |= (uint64_t) best << (3 * i);
+            }
+        }
+
+        out[0] = (unsigned char) hi;
+        out[1] = (unsigned char) lo;
+        for (int b = 0; b < 6; b++)
+            out[2 + b] = (unsigned char) (indices >> (8 * b));
+    }
+};
+
+#endif //PROJECT_BASE_BLOCK_COMPRESSION_H
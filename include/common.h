@@ -4,16 +4,78 @@
 
 #ifndef PROJECT_BASE_COMMON_H
 #define PROJECT_BASE_COMMON_H
+#include <mapped_file.h>
+#include <thread_pool.h>
+
+#include <algorithm>
+#include <atomic>
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
 
+// the whole file, read through the mounted archive when it holds it; empty if it cannot be read
 std::string readFileContents(std::string path) {
-    std::ifstream in(path);
-    std::stringstream buffer;
-    buffer << in.rdbuf();
-    return buffer.str();
+    MappedFile file(path);
+    if (!file.isOpen())
+        return std::string();
+    return std::string(reinterpret_cast<const char *>(file.data()), file.size());
+}
+
+// 64-bit FNV-1a, used to fingerprint asset contents for the on-disk caches
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 14695981039346656037ull) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
 }
 
+// extra threads parallelFor may start, shared by every call in the process: one per hardware thread
+// beyond the first
+std::atomic<int> &parallelForSpareThreads() {
+    static std::atomic<int> spare{(int) std::max(1u, std::thread::hardware_concurrency()) - 1};
+    return spare;
+}
+
+// runs function(i) for every i in [0, count) on the calling thread plus whatever extra threads the process-wide
+// budget has left, so concurrent calls never add up to more threads than hardware threads. Called from a
+// ThreadPool worker it runs serially, as the pool already keeps the cores busy. Each thread takes the next
+// unclaimed index until none are left, so items of uneven cost balance out.
+template<typename Function>
+void parallelFor(size_t count, const Function &function) {
+    int extra = 0;
+    if (count > 1 && !ThreadPool::onWorkerThread()) {
+        std::atomic<int> &spare = parallelForSpareThreads();
+        int available = spare.load();
+        do {
+            extra = std::min<int>(available, (int) std::min<size_t>(count - 1, INT32_MAX));
+        } while (extra > 0 && !spare.compare_exchange_weak(available, available - extra));
+        extra = std::max(extra, 0);
+    }
+    if (extra == 0) {
+        for (size_t i = 0; i < count; i++)
+            function(i);
+        return;
+    }
+    std::atomic<size_t> next{0};
+    auto work = [&function, &next, count] {
+        for (size_t i = next++; i < count; i = next++)
+            function(i);
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(extra);
+    for (int t = 0; t < extra; t++)
+        threads.emplace_back(work);
+    work();
+    for (std::thread &thread : threads)
+        thread.join();
+    parallelForSpareThreads() += extra;
+}
 
 #endif //PROJECT_BASE_COMMON_H
@@ -0,0 +1,87 @@
+#ifndef PROJECT_BASE_COMPRESSED_TEXTURE_H
+#define PROJECT_BASE_COMPRESSED_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include <dds.h>
+
+#include <cstring>
+
+// S3TC is an extension on core profiles and is not part of the generated glad loader
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// GL side of cooked textures: format mapping, driver support and upload
+class CompressedTexture {
+public:
+    static GLenum glFormat(BlockFormat format) {
+        switch (format) {
+            case BLOCK_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            case BLOCK_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case BLOCK_BC4: return GL_COMPRESSED_RED_RGTC1;
+            case BLOCK_BC5: return GL_COMPRESSED_RG_RGTC2;
+        }
+        return 0;
+    }
+
+    // RGTC (BC4/BC5) is core since GL 3.0; BC1/BC3 need EXT_texture_compression_s3tc
+    static bool supported(BlockFormat format) {
+        if (format == BLOCK_BC4 || format == BLOCK_BC5)
+            return true;
+        static const bool s3tc = hasExtension("GL_EXT_texture_compression_s3tc");
+        return s3tc;
+    }
+
+    // uploads every stored mip level to the currently bound texture's target (a 2D texture or one cube face)
+    static void uploadLevels(GLenum target, const CompressedImage &image) {
+        int w = image.width, h = image.height;
+        for (size_t level = 0; level < image.levels.size(); level++) {
+            glCompressedTexImage2D(target, (GLint) level, glFormat(image.format), w, h, 0,
+                                   (GLsizei) image.levelSizes[level], image.levels[level]);
+            w = w > 1 ? w / 2 : 1;
+            h = h > 1 ? h / 2 : 1;
+        }
+    }
+
+    // creates a 2D texture from a cooked image, with the same sampling state as UploadTexture
+    static unsigned int upload(const CompressedImage &image) {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        uploadLevels(GL_TEXTURE_2D, image);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) image.levels.size() - 1);
+        applySwizzle(GL_TEXTURE_2D, image.format);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return textureID;
+    }
+
+    // BC4 holds the grayscale bump maps; replicate red so shaders reading .rgb see the original gray
+    static void applySwizzle(GLenum target, BlockFormat format) {
+        if (format == BLOCK_BC4) {
+            glTexParameteri(target, GL_TEXTURE_SWIZZLE_G, GL_RED);
+            glTexParameteri(target, GL_TEXTURE_SWIZZLE_B, GL_RED);
+        }
+    }
+
+private:
+    static bool hasExtension(const char *name) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+            const char *extension = (const char *) glGetStringi(GL_EXTENSIONS, i);
+            if (extension && strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif //PROJECT_BASE_COMPRESSED_TEXTURE_H
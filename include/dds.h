@@ -0,0 +1,148 @@
+#ifndef PROJECT_BASE_DDS_H
+#define PROJECT_BASE_DDS_H
+
+#include <block_compression.h>
+#include <mapped_file.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Minimal DDS reader/writer for the block compressed textures produced by texture_cook. Only the legacy
+// FourCC header is used (DXT1, DXT5, ATI1, ATI2), which every DDS tool understands.
+#define DDS_FOURCC(a, b, c, d) ((uint32_t) (a) | ((uint32_t) (b) << 8) | ((uint32_t) (c) << 16) | ((uint32_t) (d) << 24))
+
+struct DDSPixelFormat {
+    uint32_t size, flags, fourCC, rgbBitCount, rBitMask, gBitMask, bBitMask, aBitMask;
+};
+
+struct DDSHeader {
+    uint32_t size, flags, height, width, pitchOrLinearSize, depth, mipMapCount;
+    uint32_t reserved1[11];
+    DDSPixelFormat pixelFormat;
+    uint32_t caps, caps2, caps3, caps4, reserved2;
+};
+
+// a compressed texture mapped from disk; level pointers stay valid while the object is alive
+struct CompressedImage {
+    MappedFile file;
+    BlockFormat format = BLOCK_BC1;
+    int width = 0, height = 0;
+    std::vector<const unsigned char *> levels;
+    std::vector<size_t> levelSizes;
+
+    bool valid() const { return !levels.empty(); }
+
+    size_t totalSize() const {
+        size_t total = 0;
+        for (size_t size : levelSizes)
+            total += size;
+        return total;
+    }
+};
+
+class DDS {
+public:
+    // "dir/name.jpg" -> "dir/name.dds"
+    static std::string cookedPath(const std::string &sourcePath) {
+        size_t dot = sourcePath.find_last_of('.');
+        size_t slash = sourcePath.find_last_of('/');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            return sourcePath + ".dds";
+        return sourcePath.substr(0, dot) + ".dds";
+    }
+
+    // true if the cooked file exists and is not older than its source, as loose files or in the archive
+    static bool isFresh(const std::string &cooked, const std::string &source) {
+        time_t cookedTime, sourceTime;
+        if (!MappedFile::modifiedTime(cooked, cookedTime))
+            return false;
+        if (!MappedFile::modifiedTime(source, sourceTime))
+            return true;
+        return cookedTime >= sourceTime;
+    }
+
+    static bool write(const std::string &path, BlockFormat format, int width, int height,
+                      const std::vector<std::vector<unsigned char>> &levels) {
+        DDSHeader header;
+        memset(&header, 0, sizeof(header));
+        header.size = sizeof(DDSHeader);
+        header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip count, linear size
+        header.height = (uint32_t) height;
+        header.width = (uint32_t) width;
+        header.pitchOrLinearSize = levels.empty() ? 0 : (uint32_t) levels[0].size();
+        header.mipMapCount = (uint32_t) levels.size();
+        header.pixelFormat.size = sizeof(DDSPixelFormat);
+        header.pixelFormat.flags = 0x4; // fourCC
+        header.pixelFormat.fourCC = fourCC(format);
+        header.caps = 0x1000 | 0x8 | 0x400000; // texture, complex, mipmap
+
+        std::string tmpPath = path + ".tmp";
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out)
+            return false;
+        out.write("DDS ", 4);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (const std::vector<unsigned char> &level : levels)
+            out.write(reinterpret_cast<const char *>(level.data()), level.size());
+        out.close();
+        if (!out || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    static bool read(const std::string &path, CompressedImage &image) {
+        image = CompressedImage();
+        if (!image.file.open(path) || image.file.size() < 4 + sizeof(DDSHeader))
+            return false;
+        const unsigned char *base = image.file.data();
+        if (memcmp(base, "DDS ", 4) != 0)
+            return false;
+        DDSHeader header;
+        memcpy(&header, base + 4, sizeof(header));
+        if (header.size != sizeof(DDSHeader) || !(header.pixelFormat.flags & 0x4))
+            return false;
+
+        switch (header.pixelFormat.fourCC) {
+            case DDS_FOURCC('D', 'X', 'T', '1'): image.format = BLOCK_BC1; break;
+            case DDS_FOURCC('D', 'X', 'T', '5'): image.format = BLOCK_BC3; break;
+            case DDS_FOURCC('A', 'T', 'I', '1'): image.format = BLOCK_BC4; break;
+            case DDS_FOURCC('A', 'T', 'I', '2'): image.format = BLOCK_BC5; break;
+            default: return false;
+        }
+        image.width = (int) header.width;
+        image.height = (int) header.height;
+
+        size_t offset = 4 + sizeof(DDSHeader);
+        uint32_t levelCount = header.mipMapCount ? header.mipMapCount : 1;
+        int w = image.width, h = image.height;
+        for (uint32_t level = 0; level < levelCount; level++) {
+            size_t size = BlockCompressor::compressedSize(image.format, w, h);
+            if (offset + size > image.file.size())
+                break;
+            image.levels.push_back(base + offset);
+            image.levelSizes.push_back(size);
+            offset += size;
+            w = w > 1 ? w / 2 : 1;
+            h = h > 1 ? h / 2 : 1;
+        }
+        return image.valid();
+    }
+
+private:
+    static uint32_t fourCC(BlockFormat format) {
+        switch (format) {
+            case BLOCK_BC1: return DDS_FOURCC('D', 'X', 'T', '1');
+            case BLOCK_BC3: return DDS_FOURCC('D', 'X', 'T', '5');
+            case BLOCK_BC4: return DDS_FOURCC('A', 'T', 'I', '1');
+            case BLOCK_BC5: return DDS_FOURCC('A', 'T', 'I', '2');
+        }
+        return 0;
+    }
+};
+
+#endif //PROJECT_BASE_DDS_H
@@ -0,0 +1,32 @@
+#ifndef PROJECT_BASE_DECODED_IMAGE_H
+#define PROJECT_BASE_DECODED_IMAGE_H
+
+#include <stb_image.h>
+
+#include <utility>
+
+// decoded, not yet uploaded pixels of one texture file. Owns the stb_image allocation.
+struct DecodedImage {
+    unsigned char *pixels = nullptr;
+    int width = 0, height = 0, components = 0;
+
+    DecodedImage() = default;
+    ~DecodedImage() { stbi_image_free(pixels); }
+    DecodedImage(const DecodedImage &) = delete;
+    DecodedImage &operator=(const DecodedImage &) = delete;
+    DecodedImage(DecodedImage &&other) noexcept
+        : pixels(other.pixels), width(other.width), height(other.height), components(other.components)
+    {
+        other.pixels = nullptr;
+    }
+    DecodedImage &operator=(DecodedImage &&other) noexcept
+    {
+        std::swap(pixels, other.pixels);
+        width = other.width;
+        height = other.height;
+        components = other.components;
+        return *this;
+    }
+};
+
+#endif //PROJECT_BASE_DECODED_IMAGE_H
@@ -0,0 +1,135 @@
+#ifndef PROJECT_BASE_FRUSTUM_H
+#define PROJECT_BASE_FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// axis aligned box of some geometry and a sphere around it, both in the same space. The sphere is centred
+// on the box and only as large as the farthest point measured, so it is usually tighter than the box's corners.
+struct Bounds {
+    glm::vec3 min = glm::vec3(0.0f), max = glm::vec3(0.0f);
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    // bounds of count points stride bytes apart
+    static Bounds ofPoints(const glm::vec3 *points, size_t count, size_t stride = sizeof(glm::vec3)) {
+        Bounds bounds;
+        if (count == 0)
+            return bounds;
+        const char *base = reinterpret_cast<const char *>(points);
+        bounds.min = bounds.max = *points;
+        for (size_t i = 1; i < count; i++) {
+            const glm::vec3 &point = *reinterpret_cast<const glm::vec3 *>(base + i * stride);
+            bounds.min = glm::min(bounds.min, point);
+            bounds.max = glm::max(bounds.max, point);
+        }
+        bounds.center = (bounds.min + bounds.max) * 0.5f;
+        float radius2 = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            glm::vec3 offset = *reinterpret_cast<const glm::vec3 *>(base + i * stride) - bounds.center;
+            radius2 = std::max(radius2, glm::dot(offset, offset));
+        }
+        bounds.radius = std::sqrt(radius2);
+        return bounds;
+    }
+
+    // grows these bounds to also hold other's; the sphere stays centred on the box
+    void merge(const Bounds &other) {
+        glm::vec3 oldCenter = center;
+        float oldRadius = radius;
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+        center = (min + max) * 0.5f;
+        radius = std::max(glm::length(oldCenter - center) + oldRadius, glm::length(other.center - center) + other.radius);
+        radius = std::min(radius, glm::length(max - center));
+    }
+
+    // the bounds of the same geometry after transform: the box around the transformed box (Arvo) and the
+    // sphere scaled by the largest axis scale of the matrix
+    Bounds transformed(const glm::mat4 &transform) const {
+        Bounds result;
+        glm::vec3 translation = glm::vec3(transform[3]);
+        result.min = result.max = translation;
+        for (int column = 0; column < 3; column++) {
+            for (int row = 0; row < 3; row++) {
+                float a = transform[column][row] * min[column], b = transform[column][row] * max[column];
+                result.min[row] += std::min(a, b);
+                result.max[row] += std::max(a, b);
+            }
+        }
+        result.center = glm::vec3(transform * glm::vec4(center, 1.0f));
+        float scale2 = std::max(std::max(glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])),
+                                         glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1]))),
+                                glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2])));
+        result.radius = radius * std::sqrt(scale2);
+        return result;
+    }
+};
+
+// the six planes of a view volume, pointing inwards, as ax + by + cz + d >= 0 for points inside
+class Frustum {
+public:
+    Frustum() = default;
+
+    // planes of the volume clip space maps to -w..w, in the space viewProjection maps from (Gribb & Hartmann)
+    static Frustum fromMatrix(const glm::mat4 &viewProjection) {
+        Frustum frustum;
+        glm::vec4 rows[4];
+        for (int row = 0; row < 4; row++)
+            rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+        for (int axis = 0; axis < 3; axis++) {
+            frustum.planes[axis * 2] = rows[3] + rows[axis];
+            frustum.planes[axis * 2 + 1] = rows[3] - rows[axis];
+        }
+        for (glm::vec4 &plane : frustum.planes)
+            plane /= glm::length(glm::vec3(plane));
+        return frustum;
+    }
+
+    // conservative: false only when the bounds lie entirely outside one of the planes. The sphere settles
+    // most cases; only those it straddles test the box corner farthest along the plane's normal.
+    bool intersects(const Bounds &bounds) const {
+        for (const glm::vec4 &plane : planes) {
+            glm::vec3 normal = glm::vec3(plane);
+            float distance = glm::dot(normal, bounds.center) + plane.w;
+            if (distance >= bounds.radius)
+                continue;
+            if (distance < -bounds.radius)
+                return false;
+            glm::vec3 farthest = glm::vec3(normal.x >= 0.0f ? bounds.max.x : bounds.min.x,
+                                           normal.y >= 0.0f ? bounds.max.y : bounds.min.y,
+                                           normal.z >= 0.0f ? bounds.max.z : bounds.min.z);
+            if (glm::dot(normal, farthest) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    glm::vec4 planes[6];
+};
+
+// what a pass can see: the camera's frustum, or the six faces of a shadow cube map, which together see
+// everything within the light's far plane. Bounds touching any of them are drawn.
+struct CullView {
+    Frustum frusta[6];
+    size_t count = 0;
+
+    void add(const glm::mat4 &viewProjection) {
+        if (count < 6)
+            frusta[count++] = Frustum::fromMatrix(viewProjection);
+    }
+
+    bool visible(const Bounds &bounds) const {
+        for (size_t i = 0; i < count; i++) {
+            if (frusta[i].intersects(bounds))
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif //PROJECT_BASE_FRUSTUM_H
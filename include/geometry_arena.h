@@ -0,0 +1,298 @@
+#ifndef PROJECT_BASE_GEOMETRY_ARENA_H
+#define PROJECT_BASE_GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include <gl_object.h>
+#include <memory_tracker.h>
+#include <vertex_format.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+// default capacity of one arena block: about 420k packed vertices and 1M 32-bit indices
+#define GEOMETRY_ARENA_VERTEX_BYTES (8 * 1024 * 1024)
+#define GEOMETRY_ARENA_INDEX_BYTES (4 * 1024 * 1024)
+
+// first-fit suballocator over a linear range, with neighbouring free ranges merged on release
+class RangeAllocator {
+public:
+    static const size_t INVALID = ~(size_t) 0;
+
+    explicit RangeAllocator(size_t capacity = 0) : capacity(capacity) {
+        if (capacity)
+            freeRanges[0] = capacity;
+    }
+
+    // returns the offset of `size` units starting at a multiple of `alignment`, or INVALID
+    size_t allocate(size_t size, size_t alignment = 1) {
+        for (auto range = freeRanges.begin(); range != freeRanges.end(); ++range) {
+            size_t start = (range->first + alignment - 1) / alignment * alignment;
+            size_t end = range->first + range->second;
+            if (start + size > end)
+                continue;
+            size_t before = start - range->first, after = end - (start + size);
+            size_t rangeStart = range->first;
+            freeRanges.erase(range);
+            if (before)
+                freeRanges[rangeStart] = before;
+            if (after)
+                freeRanges[start + size] = after;
+            used += size;
+            return start;
+        }
+        return INVALID;
+    }
+
+    void release(size_t offset, size_t size) {
+        if (size == 0)
+            return;
+        used -= size;
+        auto next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.end() && offset + size == next->first) {
+            size += next->second;
+            next = freeRanges.erase(next);
+        }
+        if (next != freeRanges.begin()) {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == offset) {
+                previous->second += size;
+                return;
+            }
+        }
+        freeRanges[offset] = size;
+    }
+
+    size_t capacityUnits() const { return capacity; }
+    size_t usedUnits() const { return used; }
+
+private:
+    std::map<size_t, size_t> freeRanges; // offset -> size
+    size_t capacity;
+    size_t used = 0;
+};
+
+// where a mesh lives inside the arena; everything glDrawElementsBaseVertex needs
+struct GeometryAllocation {
+    unsigned int block = ~0u;
+    size_t baseVertex = 0, vertexCount = 0;
+    size_t indexByteOffset = 0, indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+
+    bool valid() const { return block != ~0u; }
+};
+
+// Shared storage for all mesh geometry. Vertices in the PackedVertex layout and indices of both widths
+// are suballocated from a few large buffers; each block of buffers has one VAO, so consecutive meshes in
+// the same block are drawn without rebinding anything. 16-bit indices stay valid wherever their mesh
+// lands because the draw adds baseVertex. A block left empty is deleted unless it is the last one.
+// GL thread only.
+class GeometryArena {
+public:
+    static GeometryArena &instance() {
+        static GeometryArena arena;
+        return arena;
+    }
+
+    GeometryAllocation allocate(const PackedVertex *vertices, size_t vertexCount, const void *indices, size_t indexCount, GLenum indexType) {
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        GeometryAllocation allocation;
+        allocation.vertexCount = vertexCount;
+        allocation.indexCount = indexCount;
+        allocation.indexType = indexType;
+
+        for (unsigned int i = 0; i <= blocks.size() && !allocation.valid(); i++) {
+            unsigned int index = i;
+            if (i == blocks.size())
+                index = createBlock(std::max<size_t>(GEOMETRY_ARENA_VERTEX_BYTES, vertexCount * sizeof(PackedVertex)),
+                                    std::max<size_t>(GEOMETRY_ARENA_INDEX_BYTES, indexCount * indexSize));
+            Block &block = blocks[index];
+            size_t baseVertex = block.vertices.allocate(vertexCount);
+            if (baseVertex == RangeAllocator::INVALID)
+                continue;
+            size_t indexOffset = block.indices.allocate(indexCount * indexSize, indexSize);
+            if (indexOffset == RangeAllocator::INVALID) {
+                block.vertices.release(baseVertex, vertexCount);
+                continue;
+            }
+            allocation.block = index;
+            allocation.baseVertex = baseVertex;
+            allocation.indexByteOffset = indexOffset;
+            trackFree(block);
+        }
+
+        // upload through the copy target so the element binding of whatever VAO is bound stays untouched
+        const Block &block = blocks[allocation.block];
+        glBindBuffer(GL_COPY_WRITE_BUFFER, block.vbo.get());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.baseVertex * sizeof(PackedVertex), vertexCount * sizeof(PackedVertex), vertices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, block.ebo.get());
+        glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.indexByteOffset, indexCount * indexSize, indices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return allocation;
+    }
+
+    void release(GeometryAllocation &allocation) {
+        if (!allocation.valid())
+            return;
+        size_t indexSize = allocation.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        Block &block = blocks[allocation.block];
+        block.vertices.release(allocation.baseVertex, allocation.vertexCount);
+        block.indices.release(allocation.indexByteOffset, allocation.indexCount * indexSize);
+        trackFree(block);
+        unsigned int released = allocation.block;
+        allocation = GeometryAllocation();
+
+        size_t liveBlocks = 0;
+        for (const Block &other : blocks)
+            liveBlocks += other.vao ? 1 : 0;
+        if (block.vertices.usedUnits() == 0 && block.indices.usedUnits() == 0 && liveBlocks > 1) {
+            // the buffers go through the delete queue, so draws already issued from them are unaffected
+            block = Block();
+            if (boundBlock == released)
+                boundBlock = ~0u;
+        }
+    }
+
+    void draw(const GeometryAllocation &allocation) {
+        draw(allocation, 0, allocation.indexCount);
+    }
+
+    // draws `count` indices starting at index `first` of the allocation, e.g. one level of detail
+    void draw(const GeometryAllocation &allocation, size_t first, size_t count) {
+        size_t indexSize = allocation.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        bind(allocation.block);
+        glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei) count, allocation.indexType,
+                                 (void *) (allocation.indexByteOffset + first * indexSize), (GLint) allocation.baseVertex);
+    }
+
+    // draws `instances` copies of an index range, instance i reading InstanceData number i starting at
+    // instanceOffset bytes into instanceBuffer
+    void drawInstanced(const GeometryAllocation &allocation, size_t first, size_t count, GLuint instanceBuffer,
+                       size_t instanceOffset, GLsizei instances) {
+        size_t indexSize = allocation.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        bind(allocation.block);
+        Block &block = blocks[allocation.block];
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (GLuint column = 0; column < 4; column++)
+            glVertexAttribPointer(INSTANCE_ATTRIBUTE_MODEL + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void *) (instanceOffset + offsetof(InstanceData, model) + column * sizeof(glm::vec4)));
+        for (GLuint column = 0; column < 3; column++)
+            glVertexAttribPointer(INSTANCE_ATTRIBUTE_NORMAL + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                  (void *) (instanceOffset + offsetof(InstanceData, normalMatrix) + column * sizeof(glm::vec3)));
+        if (!block.instanced) {
+            // enabled only once they point at a buffer, so non-instanced shaders keep working with the VAO
+            for (GLuint location = INSTANCE_ATTRIBUTE_MODEL; location < INSTANCE_ATTRIBUTE_NORMAL + 3; location++) {
+                glEnableVertexAttribArray(location);
+                glVertexAttribDivisor(location, 1);
+            }
+            block.instanced = true;
+        }
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei) count, allocation.indexType,
+                                          (void *) (allocation.indexByteOffset + first * indexSize), instances,
+                                          (GLint) allocation.baseVertex);
+    }
+
+    // binds the block's VAO unless it is already bound
+    void bind(unsigned int block) {
+        if (boundBlock == block)
+            return;
+        glBindVertexArray(blocks[block].vao.get());
+        boundBlock = block;
+    }
+
+    // to be called after binding any other VAO, so the next draw binds its block again
+    void resetBinding() {
+        boundBlock = ~0u;
+    }
+
+    void report(std::ostream &out) const {
+        size_t liveBlocks = 0, vertexBytes = 0, vertexUsed = 0, indexBytes = 0, indexUsed = 0;
+        for (const Block &block : blocks) {
+            liveBlocks += block.vao ? 1 : 0;
+            vertexBytes += block.vertices.capacityUnits() * sizeof(PackedVertex);
+            vertexUsed += block.vertices.usedUnits() * sizeof(PackedVertex);
+            indexBytes += block.indices.capacityUnits();
+            indexUsed += block.indices.usedUnits();
+        }
+        out << "GEOMETRY:: " << liveBlocks << " blocks, vertices " << vertexUsed / (1024.0 * 1024.0) << " of "
+            << vertexBytes / (1024.0 * 1024.0) << " MB, indices " << indexUsed / (1024.0 * 1024.0) << " of "
+            << indexBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+    }
+
+private:
+    struct Block {
+        GLVertexArray vao; // null once the block has been deleted; the slot is reused by the next new block
+        GLBuffer vbo, ebo;
+        RangeAllocator vertices; // in vertices
+        RangeAllocator indices;  // in bytes
+        TrackedMemory unused;    // capacity not handed out to meshes; the meshes account for the rest
+        bool instanced = false;  // the instance attributes are enabled
+    };
+
+    std::vector<Block> blocks;
+    unsigned int boundBlock = ~0u;
+
+    GeometryArena() = default;
+
+    static size_t freeBytes(const Block &block) {
+        return (block.vertices.capacityUnits() - block.vertices.usedUnits()) * sizeof(PackedVertex) +
+               block.indices.capacityUnits() - block.indices.usedUnits();
+    }
+
+    void trackFree(Block &block) {
+        block.unused.resize(freeBytes(block));
+    }
+
+    // returns the index of the new block
+    unsigned int createBlock(size_t vertexBytes, size_t indexBytes) {
+        Block block;
+        block.vertices = RangeAllocator(vertexBytes / sizeof(PackedVertex));
+        block.indices = RangeAllocator(indexBytes);
+
+        block.vao = GLVertexArray::create();
+        block.vbo = GLBuffer::create();
+        block.ebo = GLBuffer::create();
+        glBindVertexArray(block.vao.get());
+        glBindBuffer(GL_ARRAY_BUFFER, block.vbo.get());
+        glBufferData(GL_ARRAY_BUFFER, block.vertices.capacityUnits() * sizeof(PackedVertex), nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.ebo.get());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, nullptr, GL_STATIC_DRAW);
+
+        // vertex Positions
+        glEnableVertexAttribArray(0);
+#if MESH_QUANTIZE_POSITIONS
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+#else
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+#endif
+        // vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+        // vertex texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+        // vertex tangent, w is the bitangent sign
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Tangent));
+
+        glBindVertexArray(0);
+        boundBlock = ~0u;
+        unsigned int index = 0;
+        while (index < blocks.size() && blocks[index].vao)
+            index++;
+        block.unused = TrackedMemory(MEMORY_GEOMETRY_FREE, "GeometryArena", "block " + std::to_string(index), freeBytes(block));
+        if (index == blocks.size())
+            blocks.push_back(std::move(block));
+        else
+            blocks[index] = std::move(block);
+        return index;
+    }
+};
+
+#endif //PROJECT_BASE_GEOMETRY_ARENA_H
@@ -0,0 +1,151 @@
+#ifndef PROJECT_BASE_GL_OBJECT_H
+#define PROJECT_BASE_GL_OBJECT_H
+
+#include <glad/glad.h>
+
+#include <deque>
+#include <utility>
+#include <vector>
+
+// the kinds of GL objects owned through GLObject: how to create and delete one name
+struct GLTextureKind {
+    static void generate(GLuint *name) { glGenTextures(1, name); }
+    static void destroy(GLuint name) { glDeleteTextures(1, &name); }
+};
+struct GLBufferKind {
+    static void generate(GLuint *name) { glGenBuffers(1, name); }
+    static void destroy(GLuint name) { glDeleteBuffers(1, &name); }
+};
+struct GLVertexArrayKind {
+    static void generate(GLuint *name) { glGenVertexArrays(1, name); }
+    static void destroy(GLuint name) { glDeleteVertexArrays(1, &name); }
+};
+struct GLFramebufferKind {
+    static void generate(GLuint *name) { glGenFramebuffers(1, name); }
+    static void destroy(GLuint name) { glDeleteFramebuffers(1, &name); }
+};
+
+// Deferred deletion of GL objects. A name given up during a frame is only deleted once the GPU has passed
+// the fence placed at the end of that frame, so the driver never has to keep an object alive for commands
+// still in flight, and the name cannot be handed out again while something may still refer to it.
+// GL thread only.
+class GLDeleteQueue {
+public:
+    // never destroyed, so owners that are themselves static can still retire their objects on exit
+    static GLDeleteQueue &instance() {
+        static GLDeleteQueue *queue = new GLDeleteQueue();
+        return *queue;
+    }
+
+    void retire(void (*destroy)(GLuint), GLuint name) {
+        if (name)
+            current.emplace_back(destroy, name);
+    }
+
+    // fences everything retired during this frame and deletes what earlier frames retired once their fence
+    // has signalled. Call once per frame after the last draw call. Never blocks.
+    void endFrame() {
+        if (!current.empty()) {
+            Batch batch;
+            batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            batch.objects.swap(current);
+            batches.push_back(std::move(batch));
+        }
+        while (!batches.empty()) {
+            GLenum status = glClientWaitSync(batches.front().fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;
+            destroy(batches.front());
+            batches.pop_front();
+        }
+    }
+
+    // deletes everything right away, e.g. before the context goes away
+    void flush() {
+        glFinish();
+        for (Batch &batch : batches)
+            destroy(batch);
+        batches.clear();
+        for (auto &object : current)
+            object.first(object.second);
+        current.clear();
+    }
+
+    size_t pendingCount() const {
+        size_t count = current.size();
+        for (const Batch &batch : batches)
+            count += batch.objects.size();
+        return count;
+    }
+
+private:
+    typedef std::vector<std::pair<void (*)(GLuint), GLuint>> ObjectList;
+
+    struct Batch {
+        GLsync fence = 0;
+        ObjectList objects;
+    };
+
+    ObjectList current;
+    std::deque<Batch> batches;
+
+    GLDeleteQueue() = default;
+
+    static void destroy(Batch &batch) {
+        glDeleteSync(batch.fence);
+        for (auto &object : batch.objects)
+            object.first(object.second);
+    }
+};
+
+// move-only owner of one GL object name; the object is handed to the GLDeleteQueue when the owner goes away
+template<typename Kind>
+class GLObject {
+public:
+    GLObject() = default;
+    explicit GLObject(GLuint name) : name(name) {}
+    ~GLObject() { reset(); }
+
+    static GLObject create() {
+        GLuint name = 0;
+        Kind::generate(&name);
+        return GLObject(name);
+    }
+
+    GLObject(const GLObject &) = delete;
+    GLObject &operator=(const GLObject &) = delete;
+    GLObject(GLObject &&other) noexcept : name(other.name) { other.name = 0; }
+    GLObject &operator=(GLObject &&other) noexcept {
+        if (this != &other) {
+            reset();
+            name = other.name;
+            other.name = 0;
+        }
+        return *this;
+    }
+
+    GLuint get() const { return name; }
+    explicit operator bool() const { return name != 0; }
+
+    // gives up ownership without deleting the object
+    GLuint release() {
+        GLuint released = name;
+        name = 0;
+        return released;
+    }
+
+    void reset() {
+        GLDeleteQueue::instance().retire(&Kind::destroy, name);
+        name = 0;
+    }
+
+private:
+    GLuint name = 0;
+};
+
+typedef GLObject<GLTextureKind> GLTexture;
+typedef GLObject<GLBufferKind> GLBuffer;
+typedef GLObject<GLVertexArrayKind> GLVertexArray;
+typedef GLObject<GLFramebufferKind> GLFramebuffer;
+
+#endif //PROJECT_BASE_GL_OBJECT_H
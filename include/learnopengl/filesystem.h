@@ -4,6 +4,7 @@
 #include <string>
 #include <cstdlib>
 #include "root_directory.h" // This is a configuration file generated by CMake.
+#include <pak_archive.h>
 
 class FileSystem
 {
@@ -17,6 +18,13 @@ public:
     return (*pathBuilder)(path);
   }
 
+  // serves every file below the root from the archive from now on, if the archive exists (see PakArchive).
+  // Must run before anything is loaded.
+  static bool mountArchive(const std::string& archive)
+  {
+    return PakArchive::instance().mount(getPath(archive), getRoot() != "" ? getRoot() : ".");
+  }
+
 private:
   static std::string const & getRoot()
   {
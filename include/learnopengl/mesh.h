@@ -8,6 +8,14 @@
 
 #include <learnopengl/shader.h>
 
+#include <frustum.h>
+#include <geometry_arena.h>
+#include <memory_tracker.h>
+#include <residency.h>
+#include <vertex_format.h>
+
+#include <algorithm>
+#include <cstdint>
 #include <string>
 #include <vector>
 using namespace std;
@@ -27,46 +35,262 @@ struct Vertex {
 
 
 
+// at most this many levels of detail per mesh, level 0 being the full mesh
+#define MESH_MAX_LODS 4
+
+// one level of detail: a range of the mesh's index buffer, all levels share the vertices
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float    error; // geometric error in model units
+};
+
+// viewer used to pick levels of detail: a level is acceptable while error / distance * pixelsPerUnit
+// stays below maxPixelError
+struct LodView {
+    glm::vec3 eye;
+    float     pixelsPerUnit; // viewport height / (2 * tan(fovY / 2))
+    float     maxPixelError;
+};
+
 struct Texture {
     unsigned int id;
     string type;
     string path;
+    ResidencyId residency; // of the texture's registry entry, when it may be evicted
+};
+
+// CPU-side geometry of one mesh, produced by the importer before anything touches OpenGL.
+// An import fills the full-float vertices and 32-bit indices and then pack()s them into the GPU format
+// (see vertex_format.h); a mesh cache hit only has the packed form, pointing into the mapped file. The
+// pointers may point into the owned vectors, which is why the struct can be moved but not copied.
+struct MeshData {
+    vector<Vertex>       vertices;
+    vector<unsigned int> indices;
+    const Vertex        *vertexData = nullptr; // null when read from the mesh cache
+    size_t               vertexCount = 0;
+    const unsigned int  *indexData = nullptr;
+    size_t               indexCount = 0;
+    vector<PackedVertex> packedVertices;
+    vector<uint16_t>     shortIndices;
+    const PackedVertex  *packedData = nullptr;      // what Mesh uploads, vertexCount of them
+    const void          *packedIndexData = nullptr; // indexCount indices of indexType
+    GLenum               indexType = GL_UNSIGNED_INT;
+    PositionDequantization dequantization;
+    float                uvSpan = 1.0f; // largest texture coordinate range of the vertices
+    vector<Texture>      textures; // type and path only, ids are assigned on upload
+    vector<MeshLod>      lods;     // empty when the whole index buffer is the only level
+    float                opacity = 1.0f; // of the material, below 1 for meshes drawn with blending
+    Bounds               bounds;         // of the vertex positions, in model space
+
+    MeshData() = default;
+    MeshData(MeshData &&) = default;
+    MeshData &operator=(MeshData &&) = default;
+    MeshData(const MeshData &) = delete;
+    MeshData &operator=(const MeshData &) = delete;
+
+    // measures bounds from the vertex data; importers call it once the positions are final
+    void computeBounds()
+    {
+        bounds = Bounds::ofPoints(vertexCount ? &vertexData[0].Position : nullptr, vertexCount, sizeof(Vertex));
+    }
+
+    // converts the final vertices and indices into the GPU format; the importer calls it once the
+    // geometry, levels of detail included, is complete
+    void pack()
+    {
+        glm::vec2 uvMin = vertexCount ? vertexData[0].TexCoords : glm::vec2(0.0f), uvMax = uvMin;
+        for (size_t i = 1; i < vertexCount; i++)
+        {
+            uvMin = glm::min(uvMin, vertexData[i].TexCoords);
+            uvMax = glm::max(uvMax, vertexData[i].TexCoords);
+        }
+        uvSpan = std::max(std::max(uvMax.x - uvMin.x, uvMax.y - uvMin.y), 1e-3f);
+
+        packedVertices = VertexPacker::pack(vertexData, vertexCount, dequantization);
+        packedData = packedVertices.data();
+        // 16-bit indices whenever every index fits; the arena adds baseVertex at draw time
+        if (vertexCount <= 65536)
+        {
+            shortIndices.assign(indexData, indexData + indexCount);
+            packedIndexData = shortIndices.data();
+            indexType = GL_UNSIGNED_SHORT;
+        }
+        else
+        {
+            shortIndices.clear();
+            packedIndexData = indexData;
+            indexType = GL_UNSIGNED_INT;
+        }
+    }
 };
 
 class Mesh {
 public:
-    // mesh Data
+    // mesh Data; vertices and indices are only kept when the mesh was built with keepCpuCopy,
+    // otherwise the geometry lives in the arena alone
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
 
-    unsigned int VAO;
-    std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
-    {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+    vector<MeshLod>      lods;
 
+    GeometryAllocation geometry; // vertices and indices inside the shared GeometryArena
+    PositionDequantization dequantization;
+    Bounds bounds; // model space, from the importer
+    float uvSpan = 1.0f; // largest texture coordinate range of the vertices, > 1 for tiled textures
+    float opacity = 1.0f; // of the material; meshes below 1 are drawn after the opaque ones, blended
+    std::string glslIdentifierPrefix; // set through setUniformPrefix()
+    vector<UniformString> samplerNames; // of each texture, with the prefix
+    UniformString opacityName;
+    TrackedMemory gpuMemory, cpuMemory; // accounted to the owner given at construction, see memory_tracker.h
+
+    // constructor; uploads the packed geometry, which may live in the MeshData's own vectors or in a mapped
+    // mesh cache. With keepCpuCopy the full-float vertices are kept too; a mesh read from the cache, which
+    // only stores the packed form, has none to keep.
+    Mesh(MeshData &&data, vector<Texture> textures, bool keepCpuCopy = false, const std::string &owner = "unowned",
+         const std::string &label = "mesh")
+        : textures(std::move(textures)), lods(std::move(data.lods)), bounds(data.bounds), opacity(data.opacity)
+    {
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(data);
+        setUniformPrefix(std::string());
+        gpuMemory = TrackedMemory(MEMORY_GEOMETRY, owner, label, geometryBytes());
+        if (!keepCpuCopy || !data.vertexData)
+            return;
+        if (data.vertices.data() == data.vertexData && data.indices.data() == data.indexData)
+        {
+            vertices = std::move(data.vertices);
+            indices = std::move(data.indices);
+        }
+        else
+        {
+            vertices.assign(data.vertexData, data.vertexData + data.vertexCount);
+            indices.assign(data.indexData, data.indexData + data.indexCount);
+        }
+        cpuMemory = TrackedMemory(MEMORY_CPU_MESH, owner, label, vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int));
+    }
+
+    // meshes own their arena allocation, so they can be moved but not copied
+    Mesh(Mesh &&other) noexcept
+        : vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)),
+          lods(std::move(other.lods)), geometry(other.geometry), dequantization(other.dequantization),
+          bounds(other.bounds), uvSpan(other.uvSpan), opacity(other.opacity), glslIdentifierPrefix(std::move(other.glslIdentifierPrefix)),
+          samplerNames(std::move(other.samplerNames)), opacityName(std::move(other.opacityName)),
+          gpuMemory(std::move(other.gpuMemory)), cpuMemory(std::move(other.cpuMemory)),
+          materialUniforms(std::move(other.materialUniforms))
+    {
+        other.geometry = GeometryAllocation();
+    }
+
+    Mesh &operator=(Mesh &&other) noexcept
+    {
+        if (this != &other)
+        {
+            GeometryArena::instance().release(geometry);
+            vertices = std::move(other.vertices);
+            indices = std::move(other.indices);
+            textures = std::move(other.textures);
+            lods = std::move(other.lods);
+            geometry = other.geometry;
+            dequantization = other.dequantization;
+            bounds = other.bounds;
+            uvSpan = other.uvSpan;
+            opacity = other.opacity;
+            glslIdentifierPrefix = std::move(other.glslIdentifierPrefix);
+            samplerNames = std::move(other.samplerNames);
+            opacityName = std::move(other.opacityName);
+            gpuMemory = std::move(other.gpuMemory);
+            cpuMemory = std::move(other.cpuMemory);
+            materialUniforms = std::move(other.materialUniforms);
+            other.geometry = GeometryAllocation();
+        }
+        return *this;
     }
 
-    // render the mesh
-    void Draw(Shader &shader)
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+
+    ~Mesh()
     {
-        // bind appropriate textures
+        GeometryArena::instance().release(geometry);
+    }
+
+    // size of the mesh's vertices and indices in the arena
+    size_t geometryBytes() const
+    {
+        size_t indexSize = geometry.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        return geometry.vertexCount * sizeof(PackedVertex) + geometry.indexCount * indexSize;
+    }
+
+    bool resident() const
+    {
+        return geometry.valid();
+    }
+
+    // gives the arena space back; the mesh draws nothing until restore()
+    void evict()
+    {
+        GeometryArena::instance().release(geometry);
+        gpuMemory.resize(0);
+    }
+
+    // uploads the geometry again from a fresh import of the same mesh
+    void restore(const MeshData &data)
+    {
+        if (geometry.valid())
+            return;
+        setupMesh(data);
+        gpuMemory.resize(geometryBytes());
+    }
+
+    // coarsest level whose error, projected from the closest point of the mesh bounds, stays under the
+    // view's pixel threshold. view.eye is in this mesh's model space.
+    unsigned int selectLod(const LodView &view) const
+    {
+        glm::vec3 outside = glm::max(glm::max(bounds.min - view.eye, view.eye - bounds.max), glm::vec3(0.0f));
+        float distance = glm::length(outside);
+        if (distance <= 0.0f)
+            return 0;
+        for (unsigned int level = (unsigned int) lods.size() - 1; level > 0; level--)
+        {
+            if (lods[level].error * view.pixelsPerUnit <= view.maxPixelError * distance)
+                return level;
+        }
+        return 0;
+    }
+
+    // texture coordinate units one screen pixel spans on this mesh, taking the larger bounds extent to carry
+    // the full uvSpan and measuring at the closest point of the bounds. 0 when the eye is inside them,
+    // negative when the whole mesh lies behind the viewer. view.eye and forward are in model space.
+    float uvPerPixel(const LodView &view, const glm::vec3 &forward) const
+    {
+        if (glm::dot(bounds.center - view.eye, forward) < -bounds.radius * glm::length(forward))
+            return -1.0f;
+        glm::vec3 outside = glm::max(glm::max(bounds.min - view.eye, view.eye - bounds.max), glm::vec3(0.0f));
+        float distance = glm::length(outside);
+        if (distance <= 0.0f)
+            return 0.0f;
+        glm::vec3 size = bounds.max - bounds.min;
+        float pixels = std::max(std::max(size.x, size.y), size.z) * view.pixelsPerUnit / distance;
+        return uvSpan / std::max(pixels, 1e-6f);
+    }
+
+    // names the material uniforms prefix + name, e.g. "material." for a struct. The sampler names are built
+    // here once rather than on every bindMaterial().
+    void setUniformPrefix(const std::string &prefix)
+    {
+        glslIdentifierPrefix = prefix;
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
+        samplerNames.clear();
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
-            string name = textures[i].type;
+            const string &name = textures[i].type;
             if(name == "texture_diffuse")
                 number = std::to_string(diffuseNr++);
             else if(name == "texture_specular")
@@ -75,65 +299,70 @@ public:
                 number = std::to_string(normalNr++); // transfer unsigned int to stream
             else if(name == "texture_height")
                 number = std::to_string(heightNr++); // transfer unsigned int to stream
+            samplerNames.emplace_back(prefix + name + number);
+        }
+        opacityName = UniformString(prefix + "opacity");
+        materialUniforms = MaterialUniforms();
+    }
 
+    // binds the textures to consecutive units and points the shader's samplers at them; the shader must be in use
+    void bindMaterial(Shader &shader) const
+    {
+        if (materialUniforms.program != shader.ID)
+            resolveMaterialUniforms(shader);
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            ResidencyManager::instance().use(textures[i].residency);
+            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
+            shader.set(materialUniforms.samplers[i], (int) i);
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
+        shader.set(materialUniforms.opacity, opacity);
+    }
 
+    // draws instanceCount instances of one level of detail with whatever material is bound; the shader is an
+    // INSTANCED variant reading InstanceData from instanceBuffer at instanceOffset
+    void drawInstances(Shader &shader, unsigned int lod, GLuint instanceBuffer, size_t instanceOffset, GLsizei instanceCount) const
+    {
+        // positions are stored quantized to the mesh bounds, see vertex_format.h
+        shader.set(shader.drawUniforms.positionScale, dequantization.scale);
+        shader.set(shader.drawUniforms.positionOffset, dequantization.offset);
+        if (!geometry.valid())
+            return;
+        const MeshLod &level = lods[std::min<size_t>(lod, lods.size() - 1)];
+        GeometryArena::instance().drawInstanced(geometry, level.firstIndex, level.indexCount, instanceBuffer, instanceOffset, instanceCount);
+    }
 
+private:
+    // handles of this mesh's material uniforms in the program it was last bound with; the render queue
+    // binds materials program by program, so they are resolved again only when the program changes
+    struct MaterialUniforms
+    {
+        GLuint program = 0;
+        vector<Uniform<int>> samplers; // per texture
+        Uniform<float> opacity;
+    };
+    mutable MaterialUniforms materialUniforms;
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    void resolveMaterialUniforms(const Shader &shader) const
+    {
+        materialUniforms.program = shader.ID;
+        materialUniforms.samplers.clear();
+        for (const UniformString &name : samplerNames)
+            materialUniforms.samplers.push_back(shader.uniform<int>(name));
+        materialUniforms.opacity = shader.uniform<float>(opacityName);
     }
 
-private:
-    // render data
-    unsigned int VBO, EBO;
-
-    // initializes all the buffer objects/arrays
-    void setupMesh()
-    {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+    // copies the packed vertices and indices straight into the shared geometry arena
+    void setupMesh(const MeshData &data)
+    {
+        if (lods.empty())
+            lods.push_back(MeshLod{0, (uint32_t) data.indexCount, 0.0f});
+        dequantization = data.dequantization;
+        uvSpan = data.uvSpan;
+        geometry = GeometryArena::instance().allocate(data.packedData, data.vertexCount, data.packedIndexData, data.indexCount, data.indexType);
     }
 };
 #endif
\ No newline at end of file
@@ -13,67 +13,281 @@
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
 
+#include <async_io.h>
+#include <compressed_texture.h>
+#include <dds.h>
+#include <decoded_image.h>
+#include <frustum.h>
+#include <mapped_file.h>
+#include <mesh_cache.h>
+#include <mesh_optimizer.h>
+#include <mesh_simplifier.h>
+#include <mip_cache.h>
+#include <startup_trace.h>
+#include <obj_loader.h>
+#include <pak_io_system.h>
+#include <render_queue.h>
+#include <texture_registry.h>
+#include <texture_streamer.h>
+
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+MipChain LoadTextureMips(const char *path, const string &directory, bool srgb = false);
+unsigned int UploadTexture(const MipChain &mips, bool gamma = false);
+void EvictTexture(unsigned int textureID);
+
+// an evicted texture read from disk again, off the GL thread, for ReloadTexture to upload
+struct TextureReload {
+    CompressedImage compressed; // the cooked DDS, when it is current and the driver takes its format
+    MipChain mips;              // the file's mip chain otherwise
+};
+bool ReadTextureReload(const string &filename, bool srgb, bool s3tc, TextureReload &reload);
+void ReloadTexture(unsigned int textureID, const TextureReload &reload);
+
+// post-processing applied to every imported model; part of the mesh cache key
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+// whether imported meshes get the overdraw cluster sort on top of the vertex cache ordering
+const bool MODEL_OPTIMIZE_OVERDRAW = true;
+// triangle ratios of the generated levels of detail after level 0; meshes smaller than the minimum get none
+const float MODEL_LOD_RATIOS[MESH_MAX_LODS - 1] = {0.5f, 0.25f, 0.125f};
+const size_t MODEL_LOD_MIN_TRIANGLES = 64;
+
+// a texture referenced by an imported model, identified for the TextureRegistry
+struct ImportedTexture {
+    string canonicalPath;
+    uint64_t contentHash = 0;
+    bool skipped = false; // not decoded because the registry already held it at import time
+    bool srgb = false;    // color data, mipmapped in linear light
+    MipChain mips;        // from the .mipcache, or decoded and mipmapped on this import
+    CompressedImage compressed; // cooked DDS mapped from disk, preferred over decoding the source
+};
 
+// everything needed to build a Model, produced without touching OpenGL
+struct ModelData {
+    string path;
+    string directory;
+    bool fromCache = false;
+    MappedFile cacheFile;                 // backs the mesh pointers when the geometry came from the mesh cache
+    vector<MeshData> meshes;
+    map<string, ImportedTexture> textures; // keyed by the path stored in the material
+    vector<string> dependencies;           // other files the geometry and materials were read from (an OBJ's .mtl files)
+};
 
-
-class Model
+// CPU stage of model loading: mesh cache lookup or Assimp import, followed by decoding every referenced
+// texture. It owns no shared state, so any number of imports may run concurrently on worker threads.
+class ModelImporter
 {
 public:
-    // model data
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
-    vector<Mesh>    meshes;
-    string directory;
-    bool gammaCorrection;
+    // without textures only the geometry is imported, e.g. to restore evicted buffers
+    static ModelData import(string const &path, bool withTextures = true)
+    {
+        TraceScope trace("import model", "model", path);
+        auto start = std::chrono::steady_clock::now();
+        ModelData data;
+        data.path = path;
+        // retrieve the directory path of the filepath
+        data.directory = path.substr(0, path.find_last_of('/'));
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+        uint64_t sourceHash = 0;
+        {
+            MappedFile source(path);
+            if (source.isOpen())
+            {
+                // the cache holds the materials' textures and opacity, so an edited .mtl invalidates it too
+                if (isObjFile(path))
+                {
+                    for (const string &library : ObjLoader::materialLibraries(reinterpret_cast<const char *>(source.data()), source.size()))
+                        data.dependencies.push_back(data.directory + '/' + library);
+                }
+                sourceHash = MeshCache::sourceHash(source, data.dependencies, MODEL_IMPORT_FLAGS);
+            }
+        }
+        string cachePath = MeshCache::cachePath(path);
+        TraceScope readCache("read mesh cache", "model", path);
+        if (sourceHash != 0 && data.cacheFile.open(cachePath) && MeshCache::read(data.cacheFile, sourceHash, data.meshes))
+        {
+            readCache.end();
+            data.fromCache = true;
+        }
+        else
+        {
+            readCache.end();
+            data.cacheFile.close();
+            data.meshes.clear();
+            TraceScope parse("parse model", "model", path);
+            if (!isObjFile(path) || !ObjLoader::load(path, data.meshes))
+            {
+                // read file via ASSIMP
+                Assimp::Importer importer;
+                if (PakArchive::instance().mounted())
+                    importer.SetIOHandler(new PakIOSystem()); // owned by the importer
+                const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
+                // check for errors
+                if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+                {
+                    cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                    return data;
+                }
+
+                // process ASSIMP's root node recursively
+                data.meshes.reserve(scene->mNumMeshes);
+                processNode(scene->mRootNode, scene, data.meshes);
+            }
+            parse.end();
+            // packed once here, so the cache stores and a cache hit uploads the GPU vertex format
+            for (size_t i = 0; i < data.meshes.size(); i++)
+            {
+                optimizeMesh(path, i, data.meshes[i]);
+                data.meshes[i].pack();
+            }
+
+            if (sourceHash != 0)
+                MeshCache::write(cachePath, sourceHash, data.meshes);
+        }
+        if (!withTextures)
+            return data;
+
+        // diffuse maps hold sRGB colors; everything else (normal, bump, specular) is filtered as linear data
+        map<string, bool> texturePaths;
+        for (const MeshData &mesh : data.meshes)
+        {
+            for (const Texture &texture : mesh.textures)
+                texturePaths[texture.path] = texturePaths[texture.path] || texture.type == "texture_diffuse";
+        }
+        // decoding and mip building dominate a cold import, so the textures are spread over all cores
+        vector<pair<string, bool>> textureList(texturePaths.begin(), texturePaths.end());
+        vector<ImportedTexture> imported(textureList.size());
+        for (const pair<string, bool> &texture : textureList)
+            prefetchTexture(data.directory + '/' + texture.first);
+        parallelFor(textureList.size(), [&](size_t i)
+        {
+            imported[i] = importTexture(textureList[i].first, data.directory, textureList[i].second);
+        });
+        for (size_t i = 0; i < textureList.size(); i++)
+            data.textures.emplace(textureList[i].first, std::move(imported[i]));
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        cout << "MODEL::IMPORTED " << path << " (" << (data.fromCache ? "mesh cache" : isObjFile(path) ? "obj" : "assimp") << ") in " << ms << " ms" << endl;
+        return data;
+    }
+
+private:
+    // Wavefront OBJ goes through ObjLoader; every other format through Assimp
+    static bool isObjFile(const string &path)
     {
-        loadModel(path);
+        size_t dot = path.find_last_of('.');
+        return dot != string::npos && (path.compare(dot, string::npos, ".obj") == 0 || path.compare(dot, string::npos, ".OBJ") == 0);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    // welds and reorders the mesh for the post-transform cache and vertex fetch, and reports the gain
+    static void optimizeMesh(const string &path, size_t index, MeshData &mesh)
     {
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        TraceScope trace("optimize mesh", "model", path + " #" + to_string(index));
+        VertexCacheStats before = MeshOptimizer::analyze(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+        MeshOptimizer::optimize(mesh.vertices, mesh.indices, MODEL_OPTIMIZE_OVERDRAW);
+        VertexCacheStats after = MeshOptimizer::analyze(mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+        mesh.vertexData = mesh.vertices.data();
+        mesh.vertexCount = mesh.vertices.size();
+        mesh.indexData = mesh.indices.data();
+        mesh.indexCount = mesh.indices.size();
+
+        cout << "MESH::OPTIMIZED " << path << " #" << index << ": " << before.vertices << " -> " << after.vertices
+             << " vertices, ACMR " << before.acmr() << " -> " << after.acmr()
+             << ", ATVR " << before.atvr() << " -> " << after.atvr() << endl;
+
+        buildLods(path, index, mesh);
     }
 
-    void SetShaderTextureNamePrefix(std::string prefix) {
-        for (Mesh& mesh: meshes) {
-            mesh.glslIdentifierPrefix = prefix;
+    // appends simplified index ranges for the coarser levels of detail behind the full index buffer
+    static void buildLods(const string &path, size_t index, MeshData &mesh)
+    {
+        size_t baseCount = mesh.indices.size();
+        mesh.lods.assign(1, MeshLod{0, (uint32_t) baseCount, 0.0f});
+        if (baseCount / 3 < MODEL_LOD_MIN_TRIANGLES)
+            return;
+
+        vector<vector<unsigned int>> levels;
+        vector<float> errors;
+        MeshSimplifier::buildLods(mesh.vertices, mesh.indices,
+                                  vector<float>(MODEL_LOD_RATIOS, MODEL_LOD_RATIOS + MESH_MAX_LODS - 1), levels, errors);
+        cout << "MESH::LODS " << path << " #" << index << ": " << baseCount / 3;
+        for (size_t level = 0; level < levels.size(); level++)
+        {
+            vector<size_t> clusters;
+            vector<unsigned int> ordered = MeshOptimizer::tipsify(levels[level], mesh.vertices.size(), MESH_OPTIMIZER_CACHE_SIZE, clusters);
+            mesh.lods.push_back(MeshLod{(uint32_t) mesh.indices.size(), (uint32_t) ordered.size(), errors[level]});
+            mesh.indices.insert(mesh.indices.end(), ordered.begin(), ordered.end());
+            cout << " -> " << ordered.size() / 3 << " (error " << errors[level] << ")";
         }
+        cout << " triangles" << endl;
+
+        mesh.indexData = mesh.indices.data();
+        mesh.indexCount = mesh.indices.size();
     }
-private:
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
-    void loadModel(string const &path)
+
+    // starts reading a texture's source and whichever cooked form importTexture will take it from
+    static void prefetchTexture(const string &filename)
     {
-        // read file via ASSIMP
-        Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
-        // check for errors
-        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
-        {
-            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        if (TextureRegistry::instance().containsPath(TextureRegistry::canonicalPath(filename)))
             return;
+        AsyncIO &io = AsyncIO::instance();
+        io.prefetch(filename);
+        string cooked = DDS::cookedPath(filename);
+        io.prefetch(DDS::isFresh(cooked, filename) ? cooked : MipCache::cachePath(filename));
+    }
+
+    // identifies a texture by canonical path and content hash, and decodes it only if the registry does
+    // not already hold a texture under either key.
+    static ImportedTexture importTexture(const string &path, const string &directory, bool srgb)
+    {
+        TraceScope trace("import texture", "texture", path);
+        ImportedTexture imported;
+        imported.srgb = srgb;
+        string filename = directory + '/' + path;
+        imported.canonicalPath = TextureRegistry::canonicalPath(filename);
+        TextureRegistry &registry = TextureRegistry::instance();
+        if (registry.containsPath(imported.canonicalPath))
+        {
+            imported.skipped = true;
+            return imported;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        MappedFile file(filename);
+        if (!file.isOpen())
+        {
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+            return imported;
+        }
+        imported.contentHash = hashBytes(file.data(), file.size());
+        if (registry.containsHash(imported.contentHash))
+        {
+            imported.skipped = true;
+            return imported;
+        }
+
+        // a texture_cook output next to the source replaces decoding it
+        string cooked = DDS::cookedPath(filename);
+        if (DDS::isFresh(cooked, filename) && DDS::read(cooked, imported.compressed))
+            return imported;
+
+        imported.mips = MipCache::load(filename, file.data(), file.size(), imported.contentHash, srgb);
+        if (!imported.mips.valid())
+            std::cout << "Texture failed to load at path: " << path << std::endl;
+        return imported;
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    static void processNode(aiNode *node, const aiScene *scene, vector<MeshData> &meshes)
     {
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -86,17 +300,19 @@ private:
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, meshes);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    static MeshData processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
         vector<Vertex> vertices;
         vector<unsigned int> indices;
         vector<Texture> textures;
+        vertices.reserve(mesh->mNumVertices);
+        indices.reserve((size_t) mesh->mNumFaces * 3); // faces are triangles after aiProcess_Triangulate
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -161,6 +377,8 @@ private:
         // normal: texture_normalN
         aiColor3D color(0.0f, 0.0f, 0.0f);
         material->Get(AI_MATKEY_COLOR_AMBIENT, color);
+        float opacity = 1.0f;
+        material->Get(AI_MATKEY_OPACITY, opacity);
 
 
         // 1. diffuse maps
@@ -178,82 +396,443 @@ private:
 
 
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // return the extracted mesh data; GPU buffers are created later on the GL thread
+        MeshData data;
+        data.vertices = std::move(vertices);
+        data.indices = std::move(indices);
+        data.textures = std::move(textures);
+        data.opacity = std::min(std::max(opacity, 0.0f), 1.0f);
+        data.vertexData = data.vertices.data();
+        data.vertexCount = data.vertices.size();
+        data.indexData = data.indices.data();
+        data.indexCount = data.indices.size();
+        // the axis aligned box and sphere the renderer culls against
+        data.computeBounds();
+        return data;
     }
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // collects the texture references of a given type. The texture ids are assigned once the model is uploaded.
+    static vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
     {
         vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str.C_Str();
+            textures.push_back(texture);
+        }
+        return textures;
+    }
+};
+
+
+class Model
+{
+public:
+    // model data
+    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
+    vector<Mesh>    meshes;
+    string path;
+    string directory;
+    bool gammaCorrection;
+    bool loadedFromCache = false;
+    vector<string> dependencies; // see ModelData
+    Bounds bounds; // of all the meshes, in model space
+    unsigned int revision = 0; // bumped whenever swapContents() replaces the meshes
+
+    // constructor, expects a filepath to a 3D model.
+    Model(string const &path, bool gamma = false, bool keepCpuCopy = false)
+        : Model(ModelImporter::import(path), gamma, nullptr, keepCpuCopy)
+    {
+    }
+
+    // GPU stage of model loading: creates the buffers and textures for already imported data.
+    // must run on the thread that owns the GL context. With a streamer, textures start out as placeholders
+    // and their pixels are uploaded over the following frames. The imported data is consumed: each mesh's
+    // CPU geometry is freed right after its upload unless keepCpuCopy asks the meshes to hold on to it.
+    // With incremental, nothing is uploaded yet and uploadNextMesh() has to be called until it returns true.
+    Model(ModelData &&data, bool gamma = false, TextureStreamer *streamer = nullptr, bool keepCpuCopy = false,
+          bool incremental = false)
+        : path(data.path), directory(data.directory), gammaCorrection(gamma), loadedFromCache(data.fromCache),
+          dependencies(data.dependencies), streamer(streamer), staged(std::move(data)), keepCpuCopy(keepCpuCopy)
+    {
+        meshes.reserve(staged.meshes.size());
+        if (!incremental)
+            while (!uploadNextMesh()) {}
+    }
+
+    // uploads the next imported mesh with its textures; after the last one the imported data is freed and the
+    // geometry registered with the residency manager. Returns true once every mesh is uploaded.
+    bool uploadNextMesh()
+    {
+        if (uploaded)
+            return true;
+        if (meshes.size() < staged.meshes.size())
+        {
+            MeshData &mesh = staged.meshes[meshes.size()];
+            vector<Texture> textures;
+            textures.reserve(mesh.textures.size());
+            for (const Texture &ref : mesh.textures)
+                textures.push_back(loadTexture(ref, staged.textures));
+            TraceScope trace("upload mesh", "model", path + " #" + std::to_string(meshes.size()));
+            meshes.emplace_back(std::move(mesh), std::move(textures), keepCpuCopy, path, "mesh " + std::to_string(meshes.size()));
+            mesh = MeshData();
+            if (meshes.size() < staged.meshes.size())
+                return false;
+        }
+        staged = ModelData();
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            if (i == 0)
+                bounds = meshes[i].bounds;
+            else
+                bounds.merge(meshes[i].bounds);
+        }
+
+        // the geometry can be evicted under memory pressure and comes back from the mesh cache when drawn again
+        residency = ResidencyManager::instance().add(path, geometryBytes(), [this]() { evictGeometry(); },
+                                                     [this]() { return reloadGeometry(); });
+        uploaded = true;
+        return true;
+    }
+
+    // meshes and the manager's callbacks refer to this model, so it stays where it was created
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
+
+    ~Model()
+    {
+        ResidencyManager::instance().remove(residency);
+    }
+
+    // queues a draw of every resident mesh instead of drawing right away; model is the world matrix and
+    // lod, when given, has its eye in model space. With a cull view, meshes whose world bounds it cannot see
+    // are left out and counted as culled; the caller has already tested the bounds of the whole model.
+    void Submit(RenderQueue &queue, Shader &shader, const glm::mat4 &model, const LodView *lod = nullptr, uint32_t flags = 0,
+                const CullView *cull = nullptr)
+    {
+        ResidencyManager &residencyManager = ResidencyManager::instance();
+        if (!residencyManager.use(residency))
+        {
+            for (const Mesh &mesh : meshes)
+                for (const Texture &texture : mesh.textures)
+                    residencyManager.use(texture.residency);
+            return;
+        }
+        for (const Mesh &mesh : meshes)
+        {
+            if (!mesh.resident())
+                continue;
+            if (cull && meshes.size() > 1 && !cull->visible(mesh.bounds.transformed(model)))
+            {
+                queue.countCulled(1);
+                continue;
+            }
+            queue.submit(shader, mesh, model, lod ? mesh.selectLod(*lod) : 0, flags);
+        }
+    }
+
+    // tells the streamer how much of each streamed texture the view needs (eye and forward in model space)
+    void RequestTextures(const LodView &view, const glm::vec3 &forward)
+    {
+        if (!streamer)
+            return;
+        for (const Mesh &mesh : meshes)
+        {
+            float uvPerPixel = mesh.uvPerPixel(view, forward);
+            if (uvPerPixel < 0.0f)
+                continue;
+            for (const Texture &texture : mesh.textures)
+                streamer->request(texture.id, uvPerPixel);
+        }
+    }
+
+    void SetShaderTextureNamePrefix(std::string prefix) {
+        for (Mesh& mesh: meshes) {
+            mesh.setUniformPrefix(prefix);
+        }
+    }
+
+    // exchanges all GPU resources with another model of the same file, e.g. a freshly re-imported one.
+    // Everything that points at this model draws the new contents from the next draw call on; the old
+    // ones go away with `other`. The shader texture prefix stays with this model.
+    void swapContents(Model &other)
+    {
+        if (!meshes.empty())
+            other.SetShaderTextureNamePrefix(meshes[0].glslIdentifierPrefix);
+        std::swap(textures_loaded, other.textures_loaded);
+        std::swap(meshes, other.meshes);
+        std::swap(path, other.path);
+        std::swap(directory, other.directory);
+        std::swap(gammaCorrection, other.gammaCorrection);
+        std::swap(loadedFromCache, other.loadedFromCache);
+        std::swap(dependencies, other.dependencies);
+        std::swap(bounds, other.bounds);
+        revision++;
+        std::swap(texturesByPath, other.texturesByPath);
+        std::swap(textureHandles, other.textureHandles);
+        std::swap(ownedMemory, other.ownedMemory);
+        std::swap(ownedTextures, other.ownedTextures);
+        ResidencyManager::instance().update(residency, geometryBytes(), true);
+        ResidencyManager::instance().update(other.residency, other.geometryBytes(), other.geometryResident());
+    }
+private:
+    TextureStreamer *streamer = nullptr;
+    unordered_map<string, size_t> texturesByPath; // index into textures_loaded
+    vector<TextureHandle> textureHandles;         // keeps this model's registry entries alive
+    vector<TrackedMemory> ownedMemory;            // textures loaded outside the registry
+    vector<GLTexture> ownedTextures;              // their GL names
+    ResidencyId residency;                        // of the geometry of all meshes, once uploaded
+    ModelData staged;                             // the meshes uploadNextMesh() has yet to upload
+    bool keepCpuCopy = false;
+    bool uploaded = false;
+
+    size_t geometryBytes() const
+    {
+        size_t bytes = 0;
+        for (const Mesh &mesh : meshes)
+            bytes += mesh.geometryBytes();
+        return bytes;
+    }
+
+    bool geometryResident() const
+    {
+        for (const Mesh &mesh : meshes)
+            if (!mesh.resident())
+                return false;
+        return true;
+    }
+
+    void evictGeometry()
+    {
+        for (Mesh &mesh : meshes)
+            mesh.evict();
+    }
+
+    // imports the geometry again on a worker, which normally only maps the mesh cache; the GL thread then
+    // only uploads each mesh's buffers
+    ResidencyLoad reloadGeometry()
+    {
+        string source = path;
+        Model *model = this;
+        return [source, model]() -> ResidencyUpload
+        {
+            std::shared_ptr<ModelData> data = std::make_shared<ModelData>(ModelImporter::import(source, false));
+            return [model, data]() { return model->restoreGeometry(*data); };
+        };
+    }
+
+    bool restoreGeometry(const ModelData &data)
+    {
+        TraceScope trace("restore geometry", "model", path);
+        if (data.meshes.size() != meshes.size())
+            return false;
+        for (size_t i = 0; i < meshes.size(); i++)
+            meshes[i].restore(data.meshes[i]);
+        return true;
+    }
+
+    // resolves a single texture, reusing it if this model or any other has already uploaded the same file.
+    Texture loadTexture(const Texture &ref, map<string, ImportedTexture> &imported)
+    {
+        // check if this model loaded the texture before and if so, skip loading a new texture
+        auto loaded = texturesByPath.find(ref.path);
+        if (loaded != texturesByPath.end())
+            return textures_loaded[loaded->second]; // a texture with the same filepath has already been loaded. (optimization)
+        TraceScope trace("upload texture", "texture", ref.path);
+
+        Texture texture = ref;
+        auto source = imported.find(ref.path);
+        if (source == imported.end())
+        {
+            MipChain mips = LoadTextureMips(ref.path.c_str(), directory, ref.type == "texture_diffuse");
+            texture.id = UploadTexture(mips, gammaCorrection);
+            ownedTextures.emplace_back(texture.id);
+            ownedMemory.emplace_back(MEMORY_TEXTURE, path, ref.path, mips.complete() ? mips.totalSize() : mips.totalSize() * 4 / 3);
+        }
+        else
+        {
+            ImportedTexture &import = source->second;
+            bool streamed = false, created = false;
+            TextureHandle handle = TextureRegistry::instance().acquire(import.canonicalPath, import.contentHash, path, [&](size_t &bytes) -> unsigned int
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                created = true;
+                if (import.compressed.valid() && CompressedTexture::supported(import.compressed.format))
                 {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
+                    bytes = import.compressed.totalSize();
+                    return CompressedTexture::upload(import.compressed);
                 }
+                // either another model's texture was expected to be reused but has been released since,
+                // or the cooked format is not supported by this driver
+                if (import.skipped || import.compressed.valid())
+                    import.mips = LoadTextureMips(ref.path.c_str(), directory, ref.type == "texture_diffuse");
+                bytes = import.mips.complete() ? import.mips.totalSize() : import.mips.totalSize() * 4 / 3;
+                if (!streamer)
+                    return UploadTexture(import.mips, gammaCorrection);
+                streamed = import.mips.levels.size() > 1;
+                return streamer->enqueue(std::move(import.mips), ref.type == "texture_normal", path, import.canonicalPath);
+            }, import.srgb);
+            if (created && streamer)
+            {
+                // the streamer may still hold uploads for the id, streamed levels or a whole image queued here
+                // or by a hot reload, and must drop them before the id can be reused
+                TextureStreamer *owner = streamer;
+                handle->onRelease = [owner](unsigned int id) { owner->forget(id); };
             }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+            if (streamed)
+            {
+                // only some levels are resident at a time; the streamer accounts for them
+                handle->memory.resize(0);
+            }
+            else if (created)
+            {
+                // whole textures are evicted and reloaded by the residency manager
+                RegisteredTexture *entry = handle.get();
+                string filename = import.canonicalPath;
+                bool srgb = ref.type == "texture_diffuse";
+                entry->residency = ResidencyManager::instance().add(filename, entry->bytes,
+                    [entry]() { EvictTexture(entry->id); entry->memory.resize(0); },
+                    [entry, filename, srgb]() -> ResidencyLoad {
+                        // asks the driver, so it has to happen here rather than on the worker
+                        bool s3tc = CompressedTexture::supported(BLOCK_BC1);
+                        return [entry, filename, srgb, s3tc]() -> ResidencyUpload {
+                            std::shared_ptr<TextureReload> reload = std::make_shared<TextureReload>();
+                            if (!ReadTextureReload(filename, srgb, s3tc, *reload))
+                                return ResidencyUpload();
+                            return [entry, reload]() {
+                                ReloadTexture(entry->id, *reload);
+                                entry->memory.resize(entry->bytes);
+                                return true;
+                            };
+                        };
+                    });
             }
+            textureHandles.push_back(handle);
+            texture.id = handle->id;
+            texture.residency = handle->residency;
         }
-        return textures;
+        texturesByPath[ref.path] = textures_loaded.size();
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
     }
 };
 
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
 {
-    string filename = string(path);
-    filename = directory + '/' + filename;
+    return UploadTexture(LoadTextureMips(path, directory, gamma), gamma);
+}
+
+// the full mip chain of an image file relative to directory, read from its .mipcache when that is current
+// and decoded and mipmapped (then cached) otherwise. Thread safe; failures are reported and yield an
+// invalid chain.
+MipChain LoadTextureMips(const char *path, const string &directory, bool srgb)
+{
+    TraceScope trace("load texture mips", "texture", path);
+    string filename = directory + '/' + string(path);
+    MappedFile file(filename);
+    MipChain mips;
+    if (file.isOpen())
+        mips = MipCache::load(filename, file.data(), file.size(), hashBytes(file.data(), file.size()), srgb);
+    if (!mips.valid())
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+    return mips;
+}
+
+// specifies every level of the chain on the texture bound to GL_TEXTURE_2D; glGenerateMipmap only runs when
+// the chain holds level 0 alone
+void UploadMipLevels(const MipChain &mips)
+{
+    GLenum format = GL_RGBA;
+    if (mips.components == 1)
+        format = GL_RED;
+    else if (mips.components == 2)
+        format = GL_RG;
+    else if (mips.components == 3)
+        format = GL_RGB;
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    int w = mips.width, h = mips.height;
+    for (size_t level = 0; level < mips.levels.size(); level++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, (GLint) level, format, w, h, 0, format, GL_UNSIGNED_BYTE, mips.levels[level]);
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mips.complete() ? (GLint) mips.levels.size() - 1 : 1000);
+    if (!mips.complete())
+        glGenerateMipmap(GL_TEXTURE_2D);
+}
 
+unsigned int UploadTexture(const MipChain &mips, bool gamma)
+{
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    if (mips.valid())
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        UploadMipLevels(mips);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
     }
 
     return textureID;
 }
+
+// frees the storage of a whole texture, leaving a grey 1x1 placeholder under the same id
+void EvictTexture(unsigned int textureID)
+{
+    static const unsigned char grey[4] = {128, 128, 128, 255};
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    for (GLint level = 1; level < MIP_CACHE_MAX_LEVELS; level++)
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+}
+
+// reads an evicted texture from disk again like the importer does: its cooked DDS when that is current and
+// its format supported (BC4/BC5 always, BC1/BC3 with s3tc), the file's mip chain otherwise. Touches no GL
+// state, so it runs on a worker.
+bool ReadTextureReload(const string &filename, bool srgb, bool s3tc, TextureReload &reload)
+{
+    TraceScope trace("read texture reload", "texture", filename);
+    string cooked = DDS::cookedPath(filename);
+    if (DDS::isFresh(cooked, filename) && DDS::read(cooked, reload.compressed) &&
+        (s3tc || reload.compressed.format == BLOCK_BC4 || reload.compressed.format == BLOCK_BC5))
+        return true;
+    reload.compressed = CompressedImage();
+    MappedFile file(filename);
+    if (!file.isOpen())
+        return false;
+    reload.mips = MipCache::load(filename, file.data(), file.size(), hashBytes(file.data(), file.size()), srgb);
+    return reload.mips.valid();
+}
+
+// uploads what ReadTextureReload read into the evicted texture's id
+void ReloadTexture(unsigned int textureID, const TextureReload &reload)
+{
+    TraceScope trace("reload texture", "texture", std::to_string(textureID));
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    if (reload.compressed.valid())
+    {
+        CompressedTexture::uploadLevels(GL_TEXTURE_2D, reload.compressed);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) reload.compressed.levels.size() - 1);
+        CompressedTexture::applySwizzle(GL_TEXTURE_2D, reload.compressed.format);
+        return;
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_GREEN);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_BLUE);
+    UploadMipLevels(reload.mips);
+}
 #endif
@@ -4,19 +4,108 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 #include <common.h>
+#include <startup_trace.h>
+#include <uniform_blocks.h>
+
+// FNV-1a of a uniform name; constexpr, so the compiler can hash names written as literals
+constexpr uint32_t hashUniformName(const char *name, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// a uniform name and its hash, as the Shader lookups take them. String literals convert implicitly and
+// hash at compile time where the name is a constant expression (constexpr UniformName n("model")); a
+// std::string is hashed on the spot and must outlive the UniformName.
+struct UniformName
+{
+    const char *text;
+    size_t length;
+    uint32_t hash;
+
+    template <size_t N>
+    constexpr UniformName(const char (&name)[N]) : text(name), length(N - 1), hash(hashUniformName(name, N - 1)) {}
+    UniformName(const std::string &name) : text(name.c_str()), length(name.size()), hash(hashUniformName(name.c_str(), name.size())) {}
+    constexpr UniformName(const char *text, size_t length, uint32_t hash) : text(text), length(length), hash(hash) {}
+};
+
+// a uniform name assembled at run time and set often, e.g. per mesh sampler names: hashed once when built
+class UniformString
+{
+public:
+    UniformString() : hash(hashUniformName("", 0)) {}
+    explicit UniformString(std::string name) : text(std::move(name)), hash(hashUniformName(text.c_str(), text.size())) {}
+
+    operator UniformName() const
+    {
+        return UniformName(text.c_str(), text.size(), hash);
+    }
+
+    const std::string &str() const
+    {
+        return text;
+    }
+
+private:
+    std::string text;
+    uint32_t hash;
+};
+
+// the GL uniform types a C++ value type may be set on, checked when a handle is resolved
+template <typename T> struct UniformType;
+template <> struct UniformType<bool>      { static bool accepts(GLenum type) { return type == GL_BOOL || type == GL_INT; } };
+template <> struct UniformType<int>       { static bool accepts(GLenum type) { return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_CUBE; } };
+template <> struct UniformType<float>     { static bool accepts(GLenum type) { return type == GL_FLOAT; } };
+template <> struct UniformType<glm::vec2> { static bool accepts(GLenum type) { return type == GL_FLOAT_VEC2; } };
+template <> struct UniformType<glm::vec3> { static bool accepts(GLenum type) { return type == GL_FLOAT_VEC3; } };
+template <> struct UniformType<glm::vec4> { static bool accepts(GLenum type) { return type == GL_FLOAT_VEC4; } };
+template <> struct UniformType<glm::mat3> { static bool accepts(GLenum type) { return type == GL_FLOAT_MAT3; } };
+template <> struct UniformType<glm::mat4> { static bool accepts(GLenum type) { return type == GL_FLOAT_MAT4; } };
+
+// a uniform of one program resolved ahead of time; setting it through Shader::set costs one glUniform call.
+// Handles of uniforms the program does not use stay at -1, which GL ignores like an unknown name.
+template <typename T>
+struct Uniform
+{
+    GLint location = -1;
+
+    bool valid() const
+    {
+        return location >= 0;
+    }
+};
+
+// the uniforms the renderer sets for every draw, resolved once per program when it is linked
+struct DrawUniforms
+{
+    Uniform<glm::vec3> positionScale, positionOffset; // dequantization of the packed positions, see vertex_format.h
+};
+
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    DrawUniforms drawUniforms;
+    // constructor generates the shader on the fly; defines (e.g. "INSTANCED") are #defined in every stage,
+    // separated by spaces, to compile a variant of the same sources
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const char* defines = nullptr)
     {
+        TraceScope trace("compile shader", "shader", vertexPath);
         std::string vertexPathString(vertexPath);
         std::string fragmentPathString(fragmentPath);
 
@@ -26,43 +115,24 @@ public:
         std::string vertexCode;
         std::string fragmentCode;
         std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
+        // read through the mounted resource archive, if any
+        vertexCode = readFileContents(vertexPath);
+        fragmentCode = readFileContents(fragmentPath);
+        // if geometry shader path is present, also load a geometry shader
+        if(geometryPath != nullptr)
+            geometryCode = readFileContents(geometryPath);
+        if (vertexCode.empty() || fragmentCode.empty() || (geometryPath != nullptr && geometryCode.empty()))
         {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
-            {
-                std::string geometryPathString(geometryPath);
-                geometryPath = geometryPathString.c_str();
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
-            }
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
-        catch (std::ifstream::failure& e)
+        vertexCode = includeUniformBlocks(vertexCode);
+        fragmentCode = includeUniformBlocks(fragmentCode);
+        geometryCode = includeUniformBlocks(geometryCode);
+        if (defines != nullptr)
         {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            vertexCode = addDefines(vertexCode, defines);
+            fragmentCode = addDefines(fragmentCode, defines);
+            geometryCode = addDefines(geometryCode, defines);
         }
         const char* vShaderCode = vertexCode.c_str();
         const char * fShaderCode = fragmentCode.c_str();
@@ -101,7 +171,10 @@ public:
         glDeleteShader(fragment);
         if(geometryPath != nullptr)
             glDeleteShader(geometry);
-
+        bindUniformBlocks();
+        reflectUniforms();
+        drawUniforms.positionScale = uniform<glm::vec3>("positionScale");
+        drawUniforms.positionOffset = uniform<glm::vec3>("positionOffset");
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -111,64 +184,217 @@ public:
     }
     // utility uniform functions
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    void setBool(UniformName name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(location(name), (int)value); 
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    void setInt(UniformName name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(location(name), value); 
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    void setFloat(UniformName name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(location(name), value); 
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
+    void setVec2(UniformName name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(location(name), 1, &value[0]); 
     }
-    void setVec2(const std::string &name, float x, float y) const
+    void setVec2(UniformName name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(location(name), x, y); 
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
+    void setVec3(UniformName name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(location(name), 1, &value[0]); 
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
+    void setVec3(UniformName name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(location(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
+    void setVec4(UniformName name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(location(name), 1, &value[0]); 
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) 
+    void setVec4(UniformName name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(location(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setMat2(UniformName name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    void setMat3(UniformName name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setMat4(UniformName name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
     }
 
+    // location of an active uniform, from the table built at link time; -1 for names the program does not use
+    GLint location(UniformName name) const
+    {
+        const UniformSlot *slot = find(name);
+        return slot ? slot->location : -1;
+    }
+
+    // resolves a handle once, e.g. after construction, to set the uniform every frame without any lookup.
+    // Reports a uniform whose GLSL type does not take T.
+    template <typename T>
+    Uniform<T> uniform(UniformName name) const
+    {
+        Uniform<T> handle;
+        const UniformSlot *slot = find(name);
+        if (!slot)
+            return handle;
+        if (!UniformType<T>::accepts(slot->type))
+            std::cout << "ERROR::SHADER::UNIFORM_TYPE " << slot->name << " does not match the handle's type" << std::endl;
+        else
+            handle.location = slot->location;
+        return handle;
+    }
+
+    // typed setters for resolved handles; the program must be in use
+    void set(Uniform<bool> uniform, bool value) const { glUniform1i(uniform.location, (int) value); }
+    void set(Uniform<int> uniform, int value) const { glUniform1i(uniform.location, value); }
+    void set(Uniform<float> uniform, float value) const { glUniform1f(uniform.location, value); }
+    void set(Uniform<glm::vec2> uniform, const glm::vec2 &value) const { glUniform2fv(uniform.location, 1, &value[0]); }
+    void set(Uniform<glm::vec3> uniform, const glm::vec3 &value) const { glUniform3fv(uniform.location, 1, &value[0]); }
+    void set(Uniform<glm::vec4> uniform, const glm::vec4 &value) const { glUniform4fv(uniform.location, 1, &value[0]); }
+    void set(Uniform<glm::mat3> uniform, const glm::mat3 &value) const { glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &value[0][0]); }
+    void set(Uniform<glm::mat4> uniform, const glm::mat4 &value) const { glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &value[0][0]); }
+
 private:
+    // one active uniform; arrays get a slot per element ("a[2]") plus one for the bare name, which is element 0
+    struct UniformSlot
+    {
+        std::string name;
+        uint32_t hash;
+        GLint location;
+        GLenum type;
+    };
+    std::vector<UniformSlot> uniformTable; // open addressing with linear probing, power of two size; empty slots have no name
+
+    // builds the uniform table from the linked program's active uniforms. Members of uniform blocks have
+    // no location and are left out.
+    void reflectUniforms()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<UniformSlot> active;
+        std::vector<char> buffer((size_t) std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint) i, (GLsizei) buffer.size(), &length, &size, &type, buffer.data());
+            if (length <= 0)
+                continue;
+            std::string name(buffer.data(), (size_t) length);
+            size_t brackets = name.size() >= 3 ? name.rfind("[0]") : std::string::npos;
+            if (brackets == std::string::npos || brackets != name.size() - 3)
+            {
+                GLint location = glGetUniformLocation(ID, name.c_str());
+                if (location >= 0)
+                    active.push_back(UniformSlot{name, 0, location, type});
+                continue;
+            }
+            std::string base = name.substr(0, brackets);
+            for (GLint element = 0; element < size; element++)
+            {
+                std::string elementName = base + "[" + std::to_string(element) + "]";
+                GLint location = glGetUniformLocation(ID, elementName.c_str());
+                if (location < 0)
+                    continue;
+                if (element == 0)
+                    active.push_back(UniformSlot{base, 0, location, type});
+                active.push_back(UniformSlot{elementName, 0, location, type});
+            }
+        }
+
+        size_t capacity = 16;
+        while (capacity < active.size() * 2)
+            capacity *= 2;
+        uniformTable.assign(capacity, UniformSlot{std::string(), 0, -1, 0});
+        for (UniformSlot &slot : active)
+        {
+            slot.hash = hashUniformName(slot.name.c_str(), slot.name.size());
+            size_t index = slot.hash & (capacity - 1);
+            while (!uniformTable[index].name.empty())
+                index = (index + 1) & (capacity - 1);
+            uniformTable[index] = std::move(slot);
+        }
+    }
+
+    const UniformSlot *find(UniformName name) const
+    {
+        if (uniformTable.empty())
+            return nullptr;
+        size_t mask = uniformTable.size() - 1;
+        for (size_t index = name.hash & mask; !uniformTable[index].name.empty(); index = (index + 1) & mask)
+        {
+            const UniformSlot &slot = uniformTable[index];
+            if (slot.hash == name.hash && slot.name.size() == name.length && memcmp(slot.name.data(), name.text, name.length) == 0)
+                return &slot;
+        }
+        return nullptr;
+    }
+
+    // replaces the line #include "uniform_blocks.glsl" with the declarations of the shared uniform blocks
+    static std::string includeUniformBlocks(const std::string &code)
+    {
+        static const std::string directive = "#include \"uniform_blocks.glsl\"";
+        size_t include = code.find(directive);
+        if (include == std::string::npos)
+            return code;
+        return std::string(code).replace(include, directive.size(), UNIFORM_BLOCKS_GLSL);
+    }
+
+    // points each shared block the program uses at its fixed binding point, see uniform_blocks.h
+    void bindUniformBlocks()
+    {
+        for (GLuint binding = 0; binding < UNIFORM_BINDING_COUNT; binding++)
+        {
+            GLuint index = glGetUniformBlockIndex(ID, UNIFORM_BLOCK_NAMES[binding]);
+            if (index != GL_INVALID_INDEX)
+                glUniformBlockBinding(ID, index, binding);
+        }
+    }
+
+    // inserts a #define per name right after the #version line, which has to stay first
+    static std::string addDefines(const std::string &code, const char *defines)
+    {
+        if (code.empty())
+            return code;
+        std::string lines;
+        std::istringstream names(defines);
+        std::string name;
+        while (names >> name)
+            lines += "#define " + name + "\n";
+        size_t insert = 0;
+        size_t version = code.find("#version");
+        if (version != std::string::npos)
+        {
+            size_t lineEnd = code.find('\n', version);
+            if (lineEnd == std::string::npos)
+                return code + '\n' + lines;
+            insert = lineEnd + 1;
+        }
+        return std::string(code).insert(insert, lines);
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
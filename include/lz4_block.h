@@ -0,0 +1,165 @@
+#ifndef PROJECT_BASE_LZ4_BLOCK_H
+#define PROJECT_BASE_LZ4_BLOCK_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Codec for the LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md), so data
+// packed here can also be read by the reference library and vice versa. The compressor is the greedy
+// single-probe hash table of LZ4's fast mode; the decompressor checks every length and offset against
+// both buffers, so a damaged block yields false instead of reading or writing out of bounds.
+class LZ4Block {
+public:
+    // worst case size of compress()'s output for size input bytes
+    static size_t bound(size_t size) {
+        return size + size / 255 + 16;
+    }
+
+    // compresses size bytes (less than 4 GB) into dst, which must hold bound(size) bytes; returns the compressed size
+    static size_t compress(const unsigned char *src, size_t size, unsigned char *dst) {
+        unsigned char *out = dst;
+        size_t anchor = 0, pos = 0;
+        if (size > MF_LIMIT) {
+            std::vector<uint32_t> table((size_t) 1 << HASH_BITS, (uint32_t) NO_POSITION);
+            size_t matchLimit = size - LAST_LITERALS;
+            while (pos <= size - MF_LIMIT) {
+                uint32_t sequence = read32(src + pos);
+                uint32_t &slot = table[hash(sequence)];
+                size_t candidate = slot;
+                slot = (uint32_t) pos;
+                if (candidate == NO_POSITION || pos - candidate > MAX_OFFSET || read32(src + candidate) != sequence) {
+                    pos++;
+                    continue;
+                }
+                while (pos > anchor && candidate > 0 && src[pos - 1] == src[candidate - 1]) {
+                    pos--;
+                    candidate--;
+                }
+                size_t length = MIN_MATCH;
+                while (pos + length < matchLimit && src[pos + length] == src[candidate + length])
+                    length++;
+                out = writeSequence(out, src + anchor, pos - anchor, pos - candidate, length);
+                pos += length;
+                anchor = pos;
+            }
+        }
+        // the block ends with a sequence of literals only
+        size_t literals = size - anchor;
+        *out++ = (unsigned char) (std::min<size_t>(literals, 15) << 4);
+        out = writeLength(out, literals);
+        if (literals)
+            memcpy(out, src + anchor, literals);
+        out += literals;
+        return (size_t) (out - dst);
+    }
+
+    // decompresses a whole block into exactly dstSize bytes; false if the block is malformed or does not
+    // decompress to that size
+    static bool decompress(const unsigned char *src, size_t srcSize, unsigned char *dst, size_t dstSize) {
+        size_t in = 0, out = 0;
+        while (in < srcSize) {
+            unsigned int token = src[in++];
+            size_t literals = token >> 4;
+            if (!readLength(src, srcSize, in, literals))
+                return false;
+            if (literals > srcSize - in || literals > dstSize - out)
+                return false;
+            if (literals <= 16 && srcSize - in >= 16 && dstSize - out >= 16)
+                memcpy(dst + out, src + in, 16); // a fixed size copy is a couple of moves; the excess is overwritten later
+            else if (literals)
+                memcpy(dst + out, src + in, literals);
+            in += literals;
+            out += literals;
+            if (in == srcSize)
+                break;
+
+            if (srcSize - in < 2)
+                return false;
+            size_t offset = src[in] | (size_t) src[in + 1] << 8;
+            in += 2;
+            if (offset == 0 || offset > out)
+                return false;
+            size_t length = token & 15;
+            if (!readLength(src, srcSize, in, length))
+                return false;
+            length += MIN_MATCH;
+            if (length > dstSize - out)
+                return false;
+            const unsigned char *match = dst + out - offset;
+            if (offset >= 8 && dstSize - out >= length + 8) {
+                // 8 bytes at a time, each copy reads only bytes already written, even when the match overlaps
+                for (size_t i = 0; i < length; i += 8)
+                    memcpy(dst + out + i, match + i, 8);
+            } else if (offset >= length) {
+                memcpy(dst + out, match, length);
+            } else {
+                // the match overlaps what it produces, e.g. a run of one repeated byte
+                for (size_t i = 0; i < length; i++)
+                    dst[out + i] = match[i];
+            }
+            out += length;
+        }
+        return out == dstSize;
+    }
+
+private:
+    static const size_t MIN_MATCH = 4;
+    static const size_t LAST_LITERALS = 5; // the format requires the last 5 bytes to be literals
+    static const size_t MF_LIMIT = 12;     // and the last match to start at least 12 bytes before the end
+    static const size_t MAX_OFFSET = 65535;
+    static const int HASH_BITS = 16;
+    static const uint32_t NO_POSITION = ~0u;
+
+    static uint32_t read32(const unsigned char *p) {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static uint32_t hash(uint32_t sequence) {
+        return (sequence * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    // the part of a length that does not fit into its 4 bits of the token, as a run of 255s and a remainder
+    static unsigned char *writeLength(unsigned char *out, size_t length) {
+        if (length < 15)
+            return out;
+        length -= 15;
+        while (length >= 255) {
+            *out++ = 255;
+            length -= 255;
+        }
+        *out++ = (unsigned char) length;
+        return out;
+    }
+
+    static unsigned char *writeSequence(unsigned char *out, const unsigned char *literals, size_t literalCount,
+                                        size_t offset, size_t matchLength) {
+        size_t matchCode = matchLength - MIN_MATCH;
+        *out++ = (unsigned char) (std::min<size_t>(literalCount, 15) << 4 | std::min<size_t>(matchCode, 15));
+        out = writeLength(out, literalCount);
+        memcpy(out, literals, literalCount);
+        out += literalCount;
+        *out++ = (unsigned char) (offset & 0xff);
+        *out++ = (unsigned char) (offset >> 8);
+        return writeLength(out, matchCode);
+    }
+
+    static bool readLength(const unsigned char *src, size_t srcSize, size_t &in, size_t &length) {
+        if (length != 15)
+            return true;
+        unsigned int byte;
+        do {
+            if (in >= srcSize)
+                return false;
+            byte = src[in++];
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+};
+
+#endif //PROJECT_BASE_LZ4_BLOCK_H
@@ -0,0 +1,156 @@
+#ifndef PROJECT_BASE_MAPPED_FILE_H
+#define PROJECT_BASE_MAPPED_FILE_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <pak_archive.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+
+// read-only memory mapping of a whole file, unmapped when the object goes out of scope. Files held by the
+// mounted PakArchive are served from it: stored ones in place, compressed ones decompressed into memory.
+// Files that AsyncIO has prefetched are taken over from it instead of being opened again.
+class MappedFile {
+public:
+    // lets a prefetching service hand over the contents of path; returns false to open path as usual
+    typedef bool (*OpenHook)(const std::string &path, MappedFile &file);
+
+    static std::atomic<OpenHook> &openHook() {
+        static std::atomic<OpenHook> hook{nullptr};
+        return hook;
+    }
+
+    // takes ownership of size bytes allocated with malloc or posix_memalign
+    static MappedFile adopt(unsigned char *buffer, size_t size) {
+        MappedFile file;
+        file.bytes = buffer;
+        file.length = size;
+        file.backing = buffer ? HEAP : NONE;
+        return file;
+    }
+
+    MappedFile() = default;
+    explicit MappedFile(const std::string &path) { open(path); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept : bytes(other.bytes), length(other.length), backing(other.backing) {
+        other.bytes = nullptr;
+        other.length = 0;
+        other.backing = NONE;
+    }
+    MappedFile &operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            close();
+            bytes = other.bytes;
+            length = other.length;
+            backing = other.backing;
+            other.bytes = nullptr;
+            other.length = 0;
+            other.backing = NONE;
+        }
+        return *this;
+    }
+
+    bool open(const std::string &path) {
+        close();
+        OpenHook hook = openHook().load(std::memory_order_acquire);
+        if (hook && hook(path, *this))
+            return true;
+        if (openFromArchive(path))
+            return true;
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *ptr = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (ptr != MAP_FAILED) {
+                bytes = static_cast<const unsigned char *>(ptr);
+                length = (size_t) st.st_size;
+                backing = MAPPING;
+            }
+        }
+        ::close(fd);
+        return bytes != nullptr;
+    }
+
+    void close() {
+        if (backing == MAPPING)
+            munmap((void *) bytes, length);
+        else if (backing == HEAP)
+            free((void *) bytes);
+        bytes = nullptr;
+        length = 0;
+        backing = NONE;
+    }
+
+    // whether the archive or the disk holds path
+    static bool exists(const std::string &path) {
+        struct stat st;
+        return PakArchive::instance().find(path) || stat(path.c_str(), &st) == 0;
+    }
+
+    // modification time of path, from the archive when it holds the file
+    static bool modifiedTime(const std::string &path, time_t &time) {
+        if (const PakEntry *entry = PakArchive::instance().find(path)) {
+            time = (time_t) entry->modified;
+            return true;
+        }
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0)
+            return false;
+        time = st.st_mtime;
+        return true;
+    }
+
+    bool isOpen() const { return bytes != nullptr; }
+    const unsigned char *data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    enum Backing {
+        NONE,
+        MAPPING, // of the file itself
+        ARCHIVE, // points into the archive's mapping
+        HEAP,    // read or decompressed into memory, freed with free()
+    };
+
+    const unsigned char *bytes = nullptr;
+    size_t length = 0;
+    Backing backing = NONE;
+
+    bool openFromArchive(const std::string &path) {
+        const PakArchive &archive = PakArchive::instance();
+        const PakEntry *entry = archive.find(path);
+        if (!entry || entry->size == 0)
+            return false;
+        if (entry->compression == PAK_STORED) {
+            bytes = archive.data(*entry);
+            backing = ARCHIVE;
+        } else {
+            unsigned char *buffer = static_cast<unsigned char *>(malloc(entry->size));
+            if (!buffer || !archive.extract(*entry, buffer)) {
+                std::cout << "ERROR::PAK:: damaged entry " << path << std::endl;
+                free(buffer);
+                return false;
+            }
+            bytes = buffer;
+            backing = HEAP;
+        }
+        length = entry->size;
+        return true;
+    }
+};
+
+#endif //PROJECT_BASE_MAPPED_FILE_H
@@ -0,0 +1,242 @@
+#ifndef PROJECT_BASE_MEMORY_TRACKER_H
+#define PROJECT_BASE_MEMORY_TRACKER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+enum MemoryDomain {
+    MEMORY_RAM,
+    MEMORY_VRAM,
+    MEMORY_DOMAIN_COUNT
+};
+
+enum MemoryCategory {
+    MEMORY_GEOMETRY,       // mesh vertices and indices in the geometry arena
+    MEMORY_GEOMETRY_FREE,  // arena capacity not used by any mesh
+    MEMORY_TEXTURE,        // model textures, including their mip chains
+    MEMORY_ENVIRONMENT,    // skybox cubemap and its vertices
+    MEMORY_RENDER_TARGET,  // shadow maps and other attachments
+    MEMORY_STAGING,        // pixel unpack buffers of the texture streamer
+    MEMORY_INSTANCES,      // per instance transforms of the render queues
+    MEMORY_UNIFORMS,       // uniform block buffers shared by the programs
+    MEMORY_CPU_MESH,       // CPU copies of mesh geometry kept after upload
+    MEMORY_CPU_TEXTURE,    // decoded pixels waiting for upload
+    MEMORY_CATEGORY_COUNT
+};
+
+const char *memoryCategoryName(MemoryCategory category) {
+    static const char *names[MEMORY_CATEGORY_COUNT] = {
+            "geometry", "geometry (free)", "texture", "environment", "render target", "staging", "instances", "uniforms",
+            "cpu mesh", "cpu texture"};
+    return names[category];
+}
+
+MemoryDomain memoryCategoryDomain(MemoryCategory category) {
+    return category == MEMORY_CPU_MESH || category == MEMORY_CPU_TEXTURE ? MEMORY_RAM : MEMORY_VRAM;
+}
+
+// current and highest byte count of one group of allocations
+struct MemoryUsage {
+    size_t current = 0;
+    size_t peak = 0;
+
+    void add(size_t bytes) {
+        current += bytes;
+        peak = std::max(peak, current);
+    }
+    void remove(size_t bytes) {
+        current -= std::min(current, bytes);
+    }
+};
+
+// usage of one owner, split by domain
+struct MemoryOwnerUsage {
+    MemoryUsage domains[MEMORY_DOMAIN_COUNT];
+};
+
+// one live allocation as shown in reports
+struct MemoryRecord {
+    MemoryCategory category;
+    std::string owner; // model path, or the subsystem for shared resources
+    std::string label; // what the allocation is, e.g. a texture path
+    size_t bytes;
+};
+
+// Process-wide accounting of every GPU buffer, texture and render target and of the larger CPU-side copies.
+// The driver does not report actual sizes, so callers record what they asked for: width * height * texel
+// size summed over the mip chain for textures, the buffer size for buffers. Allocations are grouped by
+// category and by owner; current and peak values are kept for both and for each domain (RAM/VRAM).
+// Thread safe, though GL resources are only created and destroyed on the GL thread.
+class MemoryTracker {
+public:
+    // never destroyed, so other singletons may release their allocations from their destructors
+    static MemoryTracker &instance() {
+        static MemoryTracker *tracker = new MemoryTracker();
+        return *tracker;
+    }
+
+    // records an allocation and returns its id (never 0)
+    uint64_t track(MemoryCategory category, const std::string &owner, const std::string &label, size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t id = ++nextId;
+        records[id] = MemoryRecord{category, owner, label, bytes};
+        add(records[id], bytes);
+        return id;
+    }
+
+    void resize(uint64_t id, size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto record = records.find(id);
+        if (record == records.end())
+            return;
+        remove(record->second, record->second.bytes);
+        record->second.bytes = bytes;
+        add(record->second, bytes);
+    }
+
+    void release(uint64_t id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto record = records.find(id);
+        if (record == records.end())
+            return;
+        remove(record->second, record->second.bytes);
+        records.erase(record);
+    }
+
+    MemoryUsage domainUsage(MemoryDomain domain) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return domains[domain];
+    }
+
+    MemoryUsage categoryUsage(MemoryCategory category) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return categories[category];
+    }
+
+    std::map<std::string, MemoryOwnerUsage> ownerUsage() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return owners;
+    }
+
+    std::vector<MemoryRecord> snapshot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<MemoryRecord> list;
+        list.reserve(records.size());
+        for (const auto &record : records)
+            list.push_back(record.second);
+        return list;
+    }
+
+    // resident set size of the whole process, for comparison with the tracked RAM
+    static size_t residentBytes() {
+        FILE *statm = fopen("/proc/self/statm", "r");
+        if (!statm)
+            return 0;
+        unsigned long pages = 0, resident = 0;
+        int read = fscanf(statm, "%lu %lu", &pages, &resident);
+        fclose(statm);
+        return read == 2 ? (size_t) resident * (size_t) sysconf(_SC_PAGESIZE) : 0;
+    }
+
+    void report(std::ostream &out) {
+        std::vector<MemoryRecord> list = snapshot();
+        std::lock_guard<std::mutex> lock(mutex);
+        out << std::fixed << std::setprecision(2);
+        out << "MEMORY:: VRAM " << megabytes(domains[MEMORY_VRAM].current) << " MB (peak " << megabytes(domains[MEMORY_VRAM].peak)
+            << " MB), tracked RAM " << megabytes(domains[MEMORY_RAM].current) << " MB (peak " << megabytes(domains[MEMORY_RAM].peak)
+            << " MB), process resident " << megabytes(residentBytes()) << " MB" << std::endl;
+        out << "MEMORY:: by category" << std::endl;
+        for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+            out << "  " << std::left << std::setw(16) << memoryCategoryName((MemoryCategory) c) << std::right << std::setw(10)
+                << megabytes(categories[c].current) << " MB  peak " << std::setw(10) << megabytes(categories[c].peak) << " MB" << std::endl;
+        }
+        out << "MEMORY:: by owner (VRAM / RAM)" << std::endl;
+        for (const auto &owner : owners) {
+            out << "  " << std::left << std::setw(48) << owner.first << std::right << std::setw(10)
+                << megabytes(owner.second.domains[MEMORY_VRAM].current) << " / " << megabytes(owner.second.domains[MEMORY_RAM].current)
+                << " MB  peak " << megabytes(owner.second.domains[MEMORY_VRAM].peak) << " / " << megabytes(owner.second.domains[MEMORY_RAM].peak)
+                << " MB" << std::endl;
+        }
+        std::sort(list.begin(), list.end(), [](const MemoryRecord &a, const MemoryRecord &b) { return a.bytes > b.bytes; });
+        out << "MEMORY:: " << list.size() << " live allocations, largest first" << std::endl;
+        for (const MemoryRecord &record : list) {
+            out << "  " << std::setw(10) << megabytes(record.bytes) << " MB  " << std::left << std::setw(16)
+                << memoryCategoryName(record.category) << std::right << record.owner << ": " << record.label << std::endl;
+        }
+        out << std::defaultfloat;
+    }
+
+    static double megabytes(size_t bytes) {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+private:
+    std::mutex mutex;
+    uint64_t nextId = 0;
+    std::unordered_map<uint64_t, MemoryRecord> records;
+    MemoryUsage domains[MEMORY_DOMAIN_COUNT];
+    MemoryUsage categories[MEMORY_CATEGORY_COUNT];
+    std::map<std::string, MemoryOwnerUsage> owners;
+
+    MemoryTracker() = default;
+
+    void add(const MemoryRecord &record, size_t bytes) {
+        MemoryDomain domain = memoryCategoryDomain(record.category);
+        domains[domain].add(bytes);
+        categories[record.category].add(bytes);
+        owners[record.owner].domains[domain].add(bytes);
+    }
+
+    void remove(const MemoryRecord &record, size_t bytes) {
+        MemoryDomain domain = memoryCategoryDomain(record.category);
+        domains[domain].remove(bytes);
+        categories[record.category].remove(bytes);
+        owners[record.owner].domains[domain].remove(bytes);
+    }
+};
+
+// move-only handle of one tracked allocation; releases it when destroyed
+class TrackedMemory {
+public:
+    TrackedMemory() = default;
+    TrackedMemory(MemoryCategory category, const std::string &owner, const std::string &label, size_t bytes)
+        : id(MemoryTracker::instance().track(category, owner, label, bytes)) {}
+    ~TrackedMemory() { reset(); }
+
+    TrackedMemory(const TrackedMemory &) = delete;
+    TrackedMemory &operator=(const TrackedMemory &) = delete;
+    TrackedMemory(TrackedMemory &&other) noexcept : id(other.id) { other.id = 0; }
+    TrackedMemory &operator=(TrackedMemory &&other) noexcept {
+        if (this != &other) {
+            reset();
+            id = other.id;
+            other.id = 0;
+        }
+        return *this;
+    }
+
+    void resize(size_t bytes) {
+        if (id)
+            MemoryTracker::instance().resize(id, bytes);
+    }
+
+    void reset() {
+        if (id)
+            MemoryTracker::instance().release(id);
+        id = 0;
+    }
+
+private:
+    uint64_t id = 0;
+};
+
+#endif //PROJECT_BASE_MEMORY_TRACKER_H
@@ -0,0 +1,227 @@
+#ifndef PROJECT_BASE_MESH_CACHE_H
+#define PROJECT_BASE_MESH_CACHE_H
+
+#include <learnopengl/mesh.h>
+
+#include <common.h>
+#include <mapped_file.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Binary cache of everything ModelImporter extracts from Assimp, written next to the source file as
+// "<file>.meshcache". Layout (little endian, all offsets from the start of the file):
+//
+//   MeshCacheHeader
+//   MeshCacheEntry[meshCount] (with the levels of detail' index ranges, the index width, the position
+//   dequantization, the texture coordinate span, the material opacity and the bounds)
+//   texture references: { uint32 typeLength, uint32 pathLength, type chars, path chars } per texture
+//   PackedVertex and index blobs, each aligned to MESH_CACHE_ALIGNMENT
+//
+// The blobs are already in the format the geometry arena takes, so a cache hit uploads straight from the
+// mapping. The cache is only used when its version, vertex stride and source hash all match. The source hash
+// covers the model file, the MTL files an OBJ names with mtllib and the import flags, so editing any of those
+// or changing the PackedVertex layout silently falls back to a full import. Textures are not part of it: the cache
+// only stores their paths, and their pixels are cached separately.
+#define MESH_CACHE_VERSION 7
+#define MESH_CACHE_ALIGNMENT 16
+
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t vertexStride;
+    uint32_t meshCount;
+};
+
+struct MeshCacheEntry {
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureOffset;
+    uint32_t textureCount;
+    uint32_t lodCount;
+    uint32_t indexSize; // 2 or 4 bytes
+    MeshLod lods[MESH_MAX_LODS];
+    PositionDequantization dequantization;
+    float uvSpan;
+    float opacity;
+    Bounds bounds;
+};
+
+class MeshCache {
+public:
+    static std::string cachePath(const std::string &sourcePath) {
+        return sourcePath + ".meshcache";
+    }
+
+    // hash of the source file contents, the contents of the files it depends on (an OBJ's material libraries)
+    // and the import flags used to process it. A dependency that cannot be opened contributes only its path.
+    static uint64_t sourceHash(const MappedFile &source, const std::vector<std::string> &dependencies, unsigned int importFlags) {
+        uint64_t hash = hashBytes(source.data(), source.size());
+        for (const std::string &dependency : dependencies) {
+            hash = hashBytes(dependency.data(), dependency.size(), hash);
+            MappedFile file(dependency);
+            uint64_t size = file.size();
+            hash = hashBytes(&size, sizeof(size), hash);
+            if (file.isOpen())
+                hash = hashBytes(file.data(), file.size(), hash);
+        }
+        return hashBytes(&importFlags, sizeof(importFlags), hash);
+    }
+
+    // validates the mapped file and fills meshes with views into it; the packed vertex/index pointers are
+    // only valid while the file stays mapped. Returns false on any mismatch.
+    static bool read(const MappedFile &file, uint64_t expectedHash, vector<MeshData> &meshes) {
+        meshes.clear();
+        const unsigned char *base = file.data();
+        size_t size = file.size();
+        if (!file.isOpen() || size < sizeof(MeshCacheHeader))
+            return false;
+
+        MeshCacheHeader header;
+        memcpy(&header, base, sizeof(header));
+        if (memcmp(header.magic, "RGMC", 4) != 0 || header.version != MESH_CACHE_VERSION ||
+            header.vertexStride != sizeof(PackedVertex) || header.sourceHash != expectedHash)
+            return false;
+
+        size_t tableEnd = sizeof(MeshCacheHeader) + (size_t) header.meshCount * sizeof(MeshCacheEntry);
+        if (tableEnd > size)
+            return false;
+
+        meshes.reserve(header.meshCount);
+        for (uint32_t i = 0; i < header.meshCount; i++) {
+            MeshCacheEntry entry;
+            memcpy(&entry, base + sizeof(MeshCacheHeader) + i * sizeof(MeshCacheEntry), sizeof(entry));
+            if ((entry.indexSize != sizeof(uint16_t) && entry.indexSize != sizeof(uint32_t)) ||
+                entry.vertexOffset + (uint64_t) entry.vertexCount * sizeof(PackedVertex) > size ||
+                entry.indexOffset + (uint64_t) entry.indexCount * entry.indexSize > size ||
+                entry.vertexOffset % MESH_CACHE_ALIGNMENT != 0 || entry.indexOffset % MESH_CACHE_ALIGNMENT != 0)
+                return false;
+
+            MeshData mesh;
+            mesh.packedData = reinterpret_cast<const PackedVertex *>(base + entry.vertexOffset);
+            mesh.vertexCount = entry.vertexCount;
+            mesh.packedIndexData = base + entry.indexOffset;
+            mesh.indexCount = entry.indexCount;
+            mesh.indexType = entry.indexSize == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+            mesh.dequantization = entry.dequantization;
+            mesh.uvSpan = entry.uvSpan;
+            mesh.opacity = entry.opacity;
+            mesh.bounds = entry.bounds;
+            if (entry.lodCount > MESH_MAX_LODS)
+                return false;
+            for (uint32_t l = 0; l < entry.lodCount; l++) {
+                if ((uint64_t) entry.lods[l].firstIndex + entry.lods[l].indexCount > entry.indexCount)
+                    return false;
+                mesh.lods.push_back(entry.lods[l]);
+            }
+
+            size_t cursor = entry.textureOffset;
+            for (uint32_t t = 0; t < entry.textureCount; t++) {
+                uint32_t lengths[2];
+                if (cursor + sizeof(lengths) > size)
+                    return false;
+                memcpy(lengths, base + cursor, sizeof(lengths));
+                cursor += sizeof(lengths);
+                if (cursor + lengths[0] + lengths[1] > size)
+                    return false;
+                Texture texture;
+                texture.id = 0;
+                texture.type.assign(reinterpret_cast<const char *>(base + cursor), lengths[0]);
+                texture.path.assign(reinterpret_cast<const char *>(base + cursor + lengths[0]), lengths[1]);
+                cursor += lengths[0] + lengths[1];
+                mesh.textures.push_back(texture);
+            }
+            meshes.push_back(std::move(mesh));
+        }
+        return true;
+    }
+
+    // serializes the given imported meshes, which must have been packed. The file is written under a temporary name
+    // and renamed into place so a crash mid-write never leaves a truncated cache behind.
+    static bool write(const std::string &path, uint64_t sourceHash, const vector<MeshData> &meshes) {
+        MeshCacheHeader header;
+        memcpy(header.magic, "RGMC", 4);
+        header.version = MESH_CACHE_VERSION;
+        header.sourceHash = sourceHash;
+        header.vertexStride = sizeof(PackedVertex);
+        header.meshCount = (uint32_t) meshes.size();
+
+        std::string textureSection;
+        vector<MeshCacheEntry> entries(meshes.size());
+        size_t textureBase = sizeof(MeshCacheHeader) + meshes.size() * sizeof(MeshCacheEntry);
+        for (size_t i = 0; i < meshes.size(); i++) {
+            entries[i].textureOffset = (uint32_t) (textureBase + textureSection.size());
+            entries[i].textureCount = (uint32_t) meshes[i].textures.size();
+            for (const Texture &texture : meshes[i].textures) {
+                uint32_t lengths[2] = {(uint32_t) texture.type.size(), (uint32_t) texture.path.size()};
+                textureSection.append(reinterpret_cast<const char *>(lengths), sizeof(lengths));
+                textureSection += texture.type;
+                textureSection += texture.path;
+            }
+        }
+
+        size_t offset = align(textureBase + textureSection.size());
+        for (size_t i = 0; i < meshes.size(); i++) {
+            entries[i].vertexOffset = offset;
+            entries[i].vertexCount = (uint32_t) meshes[i].vertexCount;
+            offset = align(offset + meshes[i].vertexCount * sizeof(PackedVertex));
+            entries[i].indexOffset = offset;
+            entries[i].indexCount = (uint32_t) meshes[i].indexCount;
+            entries[i].indexSize = meshes[i].indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+            entries[i].dequantization = meshes[i].dequantization;
+            entries[i].uvSpan = meshes[i].uvSpan;
+            entries[i].lodCount = (uint32_t) std::min<size_t>(meshes[i].lods.size(), MESH_MAX_LODS);
+            memset(entries[i].lods, 0, sizeof(entries[i].lods));
+            std::copy(meshes[i].lods.begin(), meshes[i].lods.begin() + entries[i].lodCount, entries[i].lods);
+            entries[i].opacity = meshes[i].opacity;
+            entries[i].bounds = meshes[i].bounds;
+            offset = align(offset + meshes[i].indexCount * entries[i].indexSize);
+        }
+
+        std::string tmpPath = path + ".tmp";
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "ERROR::MESH_CACHE:: could not write " << tmpPath << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(MeshCacheEntry));
+        out.write(textureSection.data(), textureSection.size());
+        for (size_t i = 0; i < meshes.size(); i++) {
+            pad(out, entries[i].vertexOffset);
+            out.write(reinterpret_cast<const char *>(meshes[i].packedData), meshes[i].vertexCount * sizeof(PackedVertex));
+            pad(out, entries[i].indexOffset);
+            out.write(reinterpret_cast<const char *>(meshes[i].packedIndexData), meshes[i].indexCount * entries[i].indexSize);
+        }
+        out.close();
+        if (!out || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            std::cout << "ERROR::MESH_CACHE:: could not write " << path << std::endl;
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static size_t align(size_t offset) {
+        return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(size_t) (MESH_CACHE_ALIGNMENT - 1);
+    }
+
+    static void pad(std::ofstream &out, uint64_t offset) {
+        static const char zeros[MESH_CACHE_ALIGNMENT] = {};
+        uint64_t position = (uint64_t) out.tellp();
+        if (position < offset)
+            out.write(zeros, offset - position);
+    }
+};
+
+#endif //PROJECT_BASE_MESH_CACHE_H
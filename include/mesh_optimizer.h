@@ -0,0 +1,241 @@
+#ifndef PROJECT_BASE_MESH_OPTIMIZER_H
+#define PROJECT_BASE_MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <common.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+// FIFO post-transform cache size the optimizer targets and measures against
+#define MESH_OPTIMIZER_CACHE_SIZE 16
+
+// efficiency of an index buffer on a simulated FIFO post-transform cache:
+// ACMR = vertex shader invocations per triangle (0.5 is ideal for large grids, 3 is the worst case),
+// ATVR = invocations per unique vertex (1.0 is ideal)
+struct VertexCacheStats {
+    size_t vertices = 0, triangles = 0, misses = 0;
+
+    float acmr() const { return triangles ? (float) misses / triangles : 0.0f; }
+    float atvr() const { return vertices ? (float) misses / vertices : 0.0f; }
+};
+
+// Import-time optimization of indexed triangle lists: vertex welding, Tipsify vertex cache ordering
+// (Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"),
+// the same paper's cluster sort for overdraw, and vertex fetch reordering. VertexT must be a plain
+// struct of floats with a glm::vec3 Position member.
+class MeshOptimizer {
+public:
+    // runs every stage in order; overdraw trades a little cache efficiency for front-to-back clusters
+    template<typename VertexT>
+    static void optimize(std::vector<VertexT> &vertices, std::vector<unsigned int> &indices, bool overdraw = true) {
+        weld(vertices, indices);
+        std::vector<size_t> clusters;
+        indices = tipsify(indices, vertices.size(), MESH_OPTIMIZER_CACHE_SIZE, clusters);
+        if (overdraw)
+            indices = sortClusters(vertices, indices, clusters);
+        reorderVertexFetch(vertices, indices);
+    }
+
+    // merges bitwise identical vertices and rewrites the indices to the first copy
+    template<typename VertexT>
+    static void weld(std::vector<VertexT> &vertices, std::vector<unsigned int> &indices) {
+        std::unordered_multimap<uint64_t, unsigned int> seen;
+        seen.reserve(vertices.size());
+        std::vector<unsigned int> remap(vertices.size());
+        std::vector<VertexT> welded;
+        welded.reserve(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            uint64_t hash = hashBytes(&vertices[i], sizeof(VertexT));
+            unsigned int target = (unsigned int) welded.size();
+            auto range = seen.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (memcmp(&welded[it->second], &vertices[i], sizeof(VertexT)) == 0) {
+                    target = it->second;
+                    break;
+                }
+            }
+            if (target == welded.size()) {
+                seen.emplace(hash, target);
+                welded.push_back(vertices[i]);
+            }
+            remap[i] = target;
+        }
+        for (unsigned int &index : indices)
+            index = remap[index];
+        vertices.swap(welded);
+    }
+
+    // Tipsify: fans around the most recently cached vertex, so the order is good for any cache of at least
+    // cacheSize entries. clusterStarts receives the triangle index of every restart after a dead end.
+    static std::vector<unsigned int> tipsify(const std::vector<unsigned int> &indices, size_t vertexCount, int cacheSize,
+                                             std::vector<size_t> &clusterStarts) {
+        size_t triangleCount = indices.size() / 3;
+        std::vector<unsigned int> out;
+        out.reserve(triangleCount * 3);
+        clusterStarts.clear();
+        if (triangleCount == 0)
+            return out;
+
+        // vertex -> triangle adjacency in compressed rows
+        std::vector<int> live(vertexCount, 0);
+        for (unsigned int index : indices)
+            live[index]++;
+        std::vector<size_t> offsets(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] = offsets[v] + live[v];
+        std::vector<unsigned int> adjacency(indices.size());
+        std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = (unsigned int) (i / 3);
+
+        std::vector<int> cacheTime(vertexCount, 0);
+        std::vector<char> emitted(triangleCount, 0);
+        std::vector<unsigned int> deadEnd;
+        std::vector<unsigned int> candidates;
+        int time = cacheSize + 1;
+        size_t cursor = 0;
+        int fan = 0;
+        clusterStarts.push_back(0);
+
+        while (fan >= 0) {
+            candidates.clear();
+            for (size_t a = offsets[fan]; a < offsets[fan + 1]; a++) {
+                unsigned int triangle = adjacency[a];
+                if (emitted[triangle])
+                    continue;
+                emitted[triangle] = 1;
+                for (int k = 0; k < 3; k++) {
+                    unsigned int v = indices[triangle * 3 + k];
+                    out.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    live[v]--;
+                    if (time - cacheTime[v] > cacheSize)
+                        cacheTime[v] = time++;
+                }
+            }
+
+            // prefer a candidate that is still in the cache and whose remaining triangles fit before eviction
+            int next = -1, best = -1;
+            for (unsigned int v : candidates) {
+                if (live[v] <= 0)
+                    continue;
+                int priority = 0;
+                if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+                    priority = time - cacheTime[v];
+                if (priority > best) {
+                    best = priority;
+                    next = (int) v;
+                }
+            }
+            if (next == -1) {
+                next = skipDeadEnd(live, deadEnd, cursor);
+                if (next >= 0 && out.size() / 3 != clusterStarts.back())
+                    clusterStarts.push_back(out.size() / 3);
+            }
+            fan = next;
+        }
+        return out;
+    }
+
+    // orders the clusters so those facing away from the mesh centre, which tend to occlude the rest, are drawn first
+    template<typename VertexT>
+    static std::vector<unsigned int> sortClusters(const std::vector<VertexT> &vertices, const std::vector<unsigned int> &indices,
+                                                  const std::vector<size_t> &clusterStarts) {
+        size_t triangleCount = indices.size() / 3;
+        if (clusterStarts.size() < 2)
+            return indices;
+
+        glm::vec3 meshCentroid(0.0f);
+        for (unsigned int index : indices)
+            meshCentroid += vertices[index].Position;
+        meshCentroid /= (float) indices.size();
+
+        std::vector<float> sortKey(clusterStarts.size());
+        for (size_t c = 0; c < clusterStarts.size(); c++) {
+            size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            for (size_t t = clusterStarts[c]; t < end; t++) {
+                const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+                const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+                centroid += p0 + p1 + p2;
+                normal += glm::cross(p1 - p0, p2 - p0); // area weighted
+            }
+            centroid /= (float) ((end - clusterStarts[c]) * 3);
+            float length = glm::length(normal);
+            sortKey[c] = length > 0.0f ? glm::dot(centroid - meshCentroid, normal / length) : 0.0f;
+        }
+
+        std::vector<size_t> order(clusterStarts.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+        std::vector<unsigned int> out;
+        out.reserve(indices.size());
+        for (size_t c : order) {
+            size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+            out.insert(out.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + end * 3);
+        }
+        return out;
+    }
+
+    // renumbers vertices in the order the index buffer first uses them and drops unreferenced ones
+    template<typename VertexT>
+    static void reorderVertexFetch(std::vector<VertexT> &vertices, std::vector<unsigned int> &indices) {
+        const unsigned int unassigned = ~0u;
+        std::vector<unsigned int> remap(vertices.size(), unassigned);
+        std::vector<VertexT> ordered;
+        ordered.reserve(vertices.size());
+        for (unsigned int &index : indices) {
+            if (remap[index] == unassigned) {
+                remap[index] = (unsigned int) ordered.size();
+                ordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(ordered);
+    }
+
+    static VertexCacheStats analyze(const unsigned int *indices, size_t indexCount, size_t vertexCount,
+                                    int cacheSize = MESH_OPTIMIZER_CACHE_SIZE) {
+        VertexCacheStats stats;
+        stats.vertices = vertexCount;
+        stats.triangles = indexCount / 3;
+        // FIFO cache: a vertex is resident if it entered less than cacheSize misses ago
+        std::vector<size_t> enteredAt(vertexCount, 0);
+        for (size_t i = 0; i < indexCount; i++) {
+            unsigned int v = indices[i];
+            if (enteredAt[v] == 0 || stats.misses - enteredAt[v] >= (size_t) cacheSize) {
+                stats.misses++;
+                enteredAt[v] = stats.misses;
+            }
+        }
+        return stats;
+    }
+
+private:
+    // first unfinished vertex from the dead-end stack, else the next one in input order, else -1
+    static int skipDeadEnd(const std::vector<int> &live, std::vector<unsigned int> &deadEnd, size_t &cursor) {
+        while (!deadEnd.empty()) {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (live[v] > 0)
+                return (int) v;
+        }
+        while (cursor < live.size()) {
+            if (live[cursor] > 0)
+                return (int) cursor++;
+            cursor++;
+        }
+        return -1;
+    }
+};
+
+#endif //PROJECT_BASE_MESH_OPTIMIZER_H
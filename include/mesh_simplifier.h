@@ -0,0 +1,294 @@
+#ifndef PROJECT_BASE_MESH_SIMPLIFIER_H
+#define PROJECT_BASE_MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+// sum of squared distances to a set of planes (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics")
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+
+    void addPlane(const glm::vec3 &n, float d) {
+        a2 += n.x * n.x; ab += n.x * n.y; ac += n.x * n.z; ad += n.x * d;
+        b2 += n.y * n.y; bc += n.y * n.z; bd += n.y * d;
+        c2 += n.z * n.z; cd += n.z * d;
+        d2 += (double) d * d;
+    }
+
+    Quadric &operator+=(const Quadric &q) {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+        bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+        return *this;
+    }
+
+    double error(const glm::vec3 &p) const {
+        double x = p.x, y = p.y, z = p.z;
+        double e = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                 + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                 + c2 * z * z + 2 * cd * z + d2;
+        return std::max(e, 0.0);
+    }
+};
+
+// Index-only level of detail generation. Edges are collapsed in order of quadric error on the mesh's
+// positions; every level keeps using the original vertex buffer, so LODs cost nothing but indices.
+// Vertices that share a position (normal or UV seams, flat shading) collapse together, and each corner
+// moves to the vertex at the target position with the closest normal and UV. Open borders are locked so
+// silhouettes of open meshes such as the castle walls do not shrink. VertexT needs Position, Normal and
+// TexCoords members.
+class MeshSimplifier {
+public:
+    // one simplified index buffer per ratio of the original triangle count, coarser ratios later.
+    // errors[i] receives the geometric error of level i in model units. Levels stop early once a ratio
+    // can no longer be reached without locking up.
+    template<typename VertexT>
+    static void buildLods(const std::vector<VertexT> &vertices, const std::vector<unsigned int> &indices,
+                          const std::vector<float> &ratios, std::vector<std::vector<unsigned int>> &levels,
+                          std::vector<float> &errors) {
+        levels.clear();
+        errors.clear();
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0 || ratios.empty())
+            return;
+
+        // positions shared by several vertices collapse as one
+        std::vector<unsigned int> positionOf(vertices.size());
+        std::vector<glm::vec3> positions;
+        std::vector<std::vector<unsigned int>> verticesAt;
+        {
+            std::unordered_map<uint64_t, unsigned int> byPosition;
+            for (size_t v = 0; v < vertices.size(); v++) {
+                uint64_t key = positionKey(vertices[v].Position);
+                auto found = byPosition.find(key);
+                if (found == byPosition.end()) {
+                    found = byPosition.emplace(key, (unsigned int) positions.size()).first;
+                    positions.push_back(vertices[v].Position);
+                    verticesAt.emplace_back();
+                }
+                positionOf[v] = found->second;
+                verticesAt[found->second].push_back((unsigned int) v);
+            }
+        }
+        size_t positionCount = positions.size();
+
+        std::vector<std::array<unsigned int, 3>> triangles;
+        triangles.reserve(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++) {
+            std::array<unsigned int, 3> tri = {indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]};
+            unsigned int p0 = positionOf[tri[0]], p1 = positionOf[tri[1]], p2 = positionOf[tri[2]];
+            if (p0 != p1 && p1 != p2 && p0 != p2)
+                triangles.push_back(tri);
+        }
+
+        std::vector<Quadric> quadrics(positionCount);
+        std::vector<std::vector<unsigned int>> trianglesAt(positionCount);
+        std::unordered_map<uint64_t, int> edgeUse;
+        for (size_t t = 0; t < triangles.size(); t++) {
+            unsigned int p[3];
+            for (int k = 0; k < 3; k++)
+                p[k] = positionOf[triangles[t][k]];
+            glm::vec3 n = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+            float length = glm::length(n);
+            if (length > 0.0f) {
+                n /= length;
+                Quadric q;
+                q.addPlane(n, -glm::dot(n, positions[p[0]]));
+                for (int k = 0; k < 3; k++)
+                    quadrics[p[k]] += q;
+            }
+            for (int k = 0; k < 3; k++) {
+                trianglesAt[p[k]].push_back((unsigned int) t);
+                edgeUse[edgeKey(p[k], p[(k + 1) % 3])]++;
+            }
+        }
+
+        // border and non-manifold edges lock both ends
+        std::vector<char> locked(positionCount, 0);
+        for (const auto &edge : edgeUse) {
+            if (edge.second != 2) {
+                locked[edge.first >> 32] = 1;
+                locked[edge.first & 0xffffffffu] = 1;
+            }
+        }
+
+        std::vector<char> triangleAlive(triangles.size(), 1), positionAlive(positionCount, 1);
+        std::vector<uint32_t> version(positionCount, 0);
+        std::priority_queue<Collapse> heap;
+        for (unsigned int p = 0; p < positionCount; p++)
+            pushEdges(p, triangles, positionOf, trianglesAt, triangleAlive, quadrics, positions, locked, version, heap);
+
+        size_t alive = triangles.size();
+        double maxError = 0.0;
+        size_t level = 0;
+        while (level < ratios.size()) {
+            size_t target = (size_t) (triangleCount * ratios[level]);
+            while (alive > target && !heap.empty()) {
+                Collapse collapse = heap.top();
+                heap.pop();
+                unsigned int from = collapse.from, to = collapse.to;
+                if (!positionAlive[from] || !positionAlive[to] || version[from] != collapse.fromVersion ||
+                    version[to] != collapse.toVersion)
+                    continue;
+                if (!collapseKeepsOrientation(from, to, triangles, positionOf, trianglesAt, triangleAlive, positions))
+                    continue;
+
+                for (unsigned int t : trianglesAt[from]) {
+                    if (!triangleAlive[t])
+                        continue;
+                    std::array<unsigned int, 3> &tri = triangles[t];
+                    bool touchesTarget = positionOf[tri[0]] == to || positionOf[tri[1]] == to || positionOf[tri[2]] == to;
+                    if (touchesTarget) {
+                        triangleAlive[t] = 0;
+                        alive--;
+                        continue;
+                    }
+                    for (int k = 0; k < 3; k++) {
+                        if (positionOf[tri[k]] == from)
+                            tri[k] = closestVertex(vertices, vertices[tri[k]], verticesAt[to]);
+                    }
+                    trianglesAt[to].push_back(t);
+                }
+                quadrics[to] += quadrics[from];
+                positionAlive[from] = 0;
+                version[to]++;
+                maxError = std::max(maxError, collapse.cost);
+                // costs of every edge around the merged position changed
+                std::vector<unsigned int> neighbours = neighbourPositions(to, triangles, positionOf, trianglesAt, triangleAlive);
+                for (unsigned int n : neighbours)
+                    version[n]++;
+                for (unsigned int n : neighbours)
+                    pushEdges(n, triangles, positionOf, trianglesAt, triangleAlive, quadrics, positions, locked, version, heap);
+                pushEdges(to, triangles, positionOf, trianglesAt, triangleAlive, quadrics, positions, locked, version, heap);
+                compact(trianglesAt[to], triangleAlive);
+            }
+
+            size_t previous = levels.empty() ? triangleCount : levels.back().size() / 3;
+            // not worth a level when the collapses ran out before getting meaningfully coarser
+            if (alive == 0 || alive > previous * 4 / 5)
+                break;
+            std::vector<unsigned int> out;
+            out.reserve(alive * 3);
+            for (size_t t = 0; t < triangles.size(); t++) {
+                if (triangleAlive[t])
+                    out.insert(out.end(), triangles[t].begin(), triangles[t].end());
+            }
+            levels.push_back(std::move(out));
+            errors.push_back((float) std::sqrt(maxError));
+            level++;
+        }
+    }
+
+private:
+    struct Collapse {
+        double cost;
+        unsigned int from, to;
+        uint32_t fromVersion, toVersion;
+
+        // std::priority_queue pops the largest element, so the cheapest collapse has to compare greatest
+        bool operator<(const Collapse &other) const { return cost > other.cost; }
+    };
+
+    static uint64_t positionKey(const glm::vec3 &p) {
+        uint32_t bits[3];
+        memcpy(bits, &p, sizeof(bits));
+        uint64_t hash = 14695981039346656037ull;
+        for (uint32_t b : bits)
+            hash = (hash ^ b) * 1099511628211ull;
+        return hash;
+    }
+
+    static uint64_t edgeKey(unsigned int a, unsigned int b) {
+        if (a > b)
+            std::swap(a, b);
+        return ((uint64_t) a << 32) | b;
+    }
+
+    static void compact(std::vector<unsigned int> &list, const std::vector<char> &triangleAlive) {
+        list.erase(std::remove_if(list.begin(), list.end(), [&](unsigned int t) { return !triangleAlive[t]; }), list.end());
+    }
+
+    static std::vector<unsigned int> neighbourPositions(unsigned int p, const std::vector<std::array<unsigned int, 3>> &triangles,
+                                                        const std::vector<unsigned int> &positionOf,
+                                                        const std::vector<std::vector<unsigned int>> &trianglesAt,
+                                                        const std::vector<char> &triangleAlive) {
+        std::vector<unsigned int> neighbours;
+        for (unsigned int t : trianglesAt[p]) {
+            if (!triangleAlive[t])
+                continue;
+            for (int k = 0; k < 3; k++) {
+                unsigned int q = positionOf[triangles[t][k]];
+                if (q != p && std::find(neighbours.begin(), neighbours.end(), q) == neighbours.end())
+                    neighbours.push_back(q);
+            }
+        }
+        return neighbours;
+    }
+
+    static void pushEdges(unsigned int from, const std::vector<std::array<unsigned int, 3>> &triangles,
+                          const std::vector<unsigned int> &positionOf, const std::vector<std::vector<unsigned int>> &trianglesAt,
+                          const std::vector<char> &triangleAlive, const std::vector<Quadric> &quadrics,
+                          const std::vector<glm::vec3> &positions, const std::vector<char> &locked,
+                          const std::vector<uint32_t> &version, std::priority_queue<Collapse> &heap) {
+        if (locked[from])
+            return;
+        for (unsigned int to : neighbourPositions(from, triangles, positionOf, trianglesAt, triangleAlive)) {
+            Quadric q = quadrics[from];
+            q += quadrics[to];
+            heap.push(Collapse{q.error(positions[to]), from, to, version[from], version[to]});
+        }
+    }
+
+    // rejects collapses that would flip or flatten a remaining triangle around `from`
+    static bool collapseKeepsOrientation(unsigned int from, unsigned int to, const std::vector<std::array<unsigned int, 3>> &triangles,
+                                         const std::vector<unsigned int> &positionOf,
+                                         const std::vector<std::vector<unsigned int>> &trianglesAt,
+                                         const std::vector<char> &triangleAlive, const std::vector<glm::vec3> &positions) {
+        for (unsigned int t : trianglesAt[from]) {
+            if (!triangleAlive[t])
+                continue;
+            unsigned int p[3];
+            bool touchesTarget = false;
+            for (int k = 0; k < 3; k++) {
+                p[k] = positionOf[triangles[t][k]];
+                touchesTarget = touchesTarget || p[k] == to;
+            }
+            if (touchesTarget)
+                continue;
+            glm::vec3 before = glm::cross(positions[p[1]] - positions[p[0]], positions[p[2]] - positions[p[0]]);
+            glm::vec3 moved[3];
+            for (int k = 0; k < 3; k++)
+                moved[k] = positions[p[k] == from ? to : p[k]];
+            glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            if (glm::dot(before, after) <= 0.2f * glm::length(before) * glm::length(after))
+                return false;
+        }
+        return true;
+    }
+
+    // the vertex among candidates whose normal and texture coordinate are closest to v's
+    template<typename VertexT>
+    static unsigned int closestVertex(const std::vector<VertexT> &vertices, const VertexT &v, const std::vector<unsigned int> &candidates) {
+        unsigned int best = candidates[0];
+        float bestDistance = 1e30f;
+        for (unsigned int c : candidates) {
+            glm::vec3 dn = vertices[c].Normal - v.Normal;
+            glm::vec2 dt = vertices[c].TexCoords - v.TexCoords;
+            float distance = glm::dot(dn, dn) + glm::dot(dt, dt);
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = c;
+            }
+        }
+        return best;
+    }
+};
+
+#endif //PROJECT_BASE_MESH_SIMPLIFIER_H
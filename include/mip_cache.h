@@ -0,0 +1,308 @@
+#ifndef PROJECT_BASE_MIP_CACHE_H
+#define PROJECT_BASE_MIP_CACHE_H
+
+#include <decoded_image.h>
+#include <mapped_file.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Decoded texture cache, written next to the source as "<file>.mipcache". Layout (little endian):
+//
+//   MipCacheHeader
+//   every level's texels, tightly packed rows, each level aligned to MIP_CACHE_ALIGNMENT
+//
+// Valid while version, content hash of the source and color space match; anything else re-decodes.
+#define MIP_CACHE_VERSION 1
+#define MIP_CACHE_ALIGNMENT 16
+#define MIP_CACHE_MAX_LEVELS 16
+
+// every mip level of one texture, either mapped from the cache, built in memory, or a single decoded level
+// that still needs glGenerateMipmap
+struct MipChain {
+    MappedFile file;                    // backing when read from the cache
+    std::vector<unsigned char> storage; // backing when built in memory
+    DecodedImage image;                 // backing of a lone level 0
+    int width = 0, height = 0, components = 0;
+    std::vector<const unsigned char *> levels;
+    std::vector<size_t> levelSizes;
+
+    MipChain() = default;
+    MipChain(MipChain &&) = default;
+    MipChain &operator=(MipChain &&) = default;
+    MipChain(const MipChain &) = delete;
+    MipChain &operator=(const MipChain &) = delete;
+
+    // wraps decoded pixels without copying them
+    explicit MipChain(DecodedImage &&decoded)
+        : image(std::move(decoded)), width(image.width), height(image.height), components(image.components) {
+        if (image.pixels) {
+            levels.push_back(image.pixels);
+            levelSizes.push_back((size_t) width * height * components);
+        }
+    }
+
+    bool valid() const { return !levels.empty(); }
+
+    // true when every level down to 1x1 is present, so the GPU does not have to build any
+    bool complete() const { return levels.size() > 1 || (width == 1 && height == 1); }
+
+    size_t totalSize() const {
+        size_t total = 0;
+        for (size_t size : levelSizes)
+            total += size;
+        return total;
+    }
+};
+
+struct MipCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    int32_t width, height;
+    uint32_t components;
+    uint32_t levelCount;
+    uint32_t srgb;
+    uint32_t reserved;
+    uint64_t levelOffsets[MIP_CACHE_MAX_LEVELS];
+};
+
+// Builds mip chains on the CPU and caches them. Downsampling is a 2x2 box filter evaluated in linear
+// light: sRGB color channels are converted through a lookup table to linear floats, averaged, and only
+// re-encoded when each level is written, so darkening does not accumulate down the chain the way it does
+// when averaging the encoded bytes. Alpha and linear data (normal and bump maps) are averaged as they are.
+// The averaging runs on whole rows with SSE2 when available.
+class MipCache {
+public:
+    static std::string cachePath(const std::string &sourcePath) {
+        return sourcePath + ".mipcache";
+    }
+
+    static unsigned int levelCount(int width, int height) {
+        unsigned int count = 1;
+        while ((width > 1 || height > 1) && count < MIP_CACHE_MAX_LEVELS) {
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            count++;
+        }
+        return count;
+    }
+
+    // the full chain for the encoded file in data: from the cache if it matches, otherwise decoded, built
+    // and written back. An invalid chain means the file could not be decoded.
+    static MipChain load(const std::string &sourcePath, const unsigned char *data, size_t size, uint64_t contentHash, bool srgb) {
+        MipChain chain;
+        std::string path = cachePath(sourcePath);
+        if (read(path, contentHash, srgb, chain))
+            return chain;
+
+        DecodedImage image;
+        image.pixels = stbi_load_from_memory(data, (int) size, &image.width, &image.height, &image.components, 0);
+        if (!image.pixels)
+            return chain;
+        chain = build(image, srgb);
+        write(path, contentHash, srgb, chain);
+        return chain;
+    }
+
+    static bool read(const std::string &path, uint64_t contentHash, bool srgb, MipChain &chain) {
+        MappedFile file(path);
+        if (!file.isOpen() || file.size() < sizeof(MipCacheHeader))
+            return false;
+        MipCacheHeader header;
+        memcpy(&header, file.data(), sizeof(header));
+        if (memcmp(header.magic, "RGMP", 4) != 0 || header.version != MIP_CACHE_VERSION || header.sourceHash != contentHash ||
+            header.srgb != (srgb ? 1u : 0u) || header.width <= 0 || header.height <= 0 || header.components < 1 ||
+            header.components > 4 || header.levelCount != levelCount(header.width, header.height))
+            return false;
+
+        MipChain loaded;
+        loaded.width = header.width;
+        loaded.height = header.height;
+        loaded.components = (int) header.components;
+        int w = header.width, h = header.height;
+        for (uint32_t level = 0; level < header.levelCount; level++) {
+            size_t levelSize = (size_t) w * h * header.components;
+            if (header.levelOffsets[level] + levelSize > file.size())
+                return false;
+            loaded.levels.push_back(file.data() + header.levelOffsets[level]);
+            loaded.levelSizes.push_back(levelSize);
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+        loaded.file = std::move(file);
+        chain = std::move(loaded);
+        return true;
+    }
+
+    // written under a per-thread temporary name and renamed into place, since several models may
+    // import the same texture at once
+    static bool write(const std::string &path, uint64_t contentHash, bool srgb, const MipChain &chain) {
+        MipCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "RGMP", 4);
+        header.version = MIP_CACHE_VERSION;
+        header.sourceHash = contentHash;
+        header.width = chain.width;
+        header.height = chain.height;
+        header.components = (uint32_t) chain.components;
+        header.levelCount = (uint32_t) chain.levels.size();
+        header.srgb = srgb ? 1 : 0;
+        size_t offset = align(sizeof(header));
+        for (size_t level = 0; level < chain.levels.size(); level++) {
+            header.levelOffsets[level] = offset;
+            offset = align(offset + chain.levelSizes[level]);
+        }
+
+        std::string tmpPath = path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cout << "ERROR::MIP_CACHE:: could not write " << tmpPath << std::endl;
+            return false;
+        }
+        static const char zeros[MIP_CACHE_ALIGNMENT] = {};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (size_t level = 0; level < chain.levels.size(); level++) {
+            out.write(zeros, header.levelOffsets[level] - (uint64_t) out.tellp());
+            out.write(reinterpret_cast<const char *>(chain.levels[level]), chain.levelSizes[level]);
+        }
+        out.close();
+        if (!out || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            std::cout << "ERROR::MIP_CACHE:: could not write " << path << std::endl;
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // the complete chain of a decoded image, level 0 included, in one allocation
+    static MipChain build(const DecodedImage &image, bool srgb) {
+        MipChain chain;
+        chain.width = image.width;
+        chain.height = image.height;
+        chain.components = image.components;
+        unsigned int count = levelCount(image.width, image.height);
+
+        std::vector<size_t> offsets;
+        size_t total = 0;
+        int w = image.width, h = image.height;
+        for (unsigned int level = 0; level < count; level++) {
+            offsets.push_back(total);
+            chain.levelSizes.push_back((size_t) w * h * image.components);
+            total = align(total + chain.levelSizes.back());
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+        chain.storage.resize(total);
+        memcpy(chain.storage.data(), image.pixels, chain.levelSizes[0]);
+
+        int c = image.components;
+        // alpha stays linear even in sRGB textures
+        bool encoded[4] = {srgb, srgb && c >= 3, srgb && c >= 3, false};
+        if (c == 2)
+            encoded[1] = false;
+        std::vector<float> current((size_t) image.width * image.height * c), next;
+        const float *toLinear = srgbToLinearTable();
+        for (size_t i = 0; i < current.size(); i++)
+            current[i] = encoded[i % c] ? toLinear[image.pixels[i]] : image.pixels[i] * (1.0f / 255.0f);
+
+        w = image.width;
+        h = image.height;
+        for (unsigned int level = 1; level < count; level++) {
+            int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+            next.resize((size_t) nw * nh * c);
+            downsample(current.data(), w, h, c, next.data());
+            unsigned char *out = chain.storage.data() + offsets[level];
+            for (size_t i = 0; i < next.size(); i++)
+                out[i] = encoded[i % c] ? linearToSrgb(next[i]) : (unsigned char) (std::min(std::max(next[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+            current.swap(next);
+            w = nw;
+            h = nh;
+        }
+
+        for (unsigned int level = 0; level < count; level++)
+            chain.levels.push_back(chain.storage.data() + offsets[level]);
+        return chain;
+    }
+
+private:
+    static size_t align(size_t offset) {
+        return (offset + MIP_CACHE_ALIGNMENT - 1) & ~(size_t) (MIP_CACHE_ALIGNMENT - 1);
+    }
+
+    static const float *srgbToLinearTable() {
+        static const std::vector<float> table = [] {
+            std::vector<float> values(256);
+            for (int i = 0; i < 256; i++) {
+                float v = i / 255.0f;
+                values[i] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    // 4096 linear steps are finer than one 8-bit sRGB step everywhere
+    static unsigned char linearToSrgb(float linear) {
+        static const std::vector<unsigned char> table = [] {
+            std::vector<unsigned char> values(4096);
+            for (int i = 0; i < 4096; i++) {
+                float v = i / 4095.0f;
+                float s = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+                values[i] = (unsigned char) (std::min(std::max(s, 0.0f), 1.0f) * 255.0f + 0.5f);
+            }
+            return values;
+        }();
+        int index = (int) (std::min(std::max(linear, 0.0f), 1.0f) * 4095.0f + 0.5f);
+        return table[index];
+    }
+
+    // 2x2 box filter; the last row/column is repeated when a dimension is odd or 1
+    static void downsample(const float *src, int w, int h, int c, float *dst) {
+        int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+        size_t rowLength = (size_t) w * c;
+        std::vector<float> rowSum(rowLength);
+        for (int y = 0; y < nh; y++) {
+            const float *row0 = src + (size_t) std::min(2 * y, h - 1) * rowLength;
+            const float *row1 = src + (size_t) std::min(2 * y + 1, h - 1) * rowLength;
+            size_t i = 0;
+#ifdef __SSE2__
+            const __m128 quarter = _mm_set1_ps(0.25f);
+            for (; i + 4 <= rowLength; i += 4)
+                _mm_storeu_ps(&rowSum[i], _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(row0 + i), _mm_loadu_ps(row1 + i)), quarter));
+#endif
+            for (; i < rowLength; i++)
+                rowSum[i] = (row0[i] + row1[i]) * 0.25f;
+
+            float *out = dst + (size_t) y * nw * c;
+            int x = 0;
+#ifdef __SSE2__
+            if (c == 4) {
+                // one RGBA pixel per vector: out = left + right
+                for (; 2 * x + 1 < w; x++)
+                    _mm_storeu_ps(out + 4 * x, _mm_add_ps(_mm_loadu_ps(&rowSum[8 * x]), _mm_loadu_ps(&rowSum[8 * x + 4])));
+            }
+#endif
+            for (; x < nw; x++) {
+                int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+                for (int k = 0; k < c; k++)
+                    out[x * c + k] = rowSum[x0 * c + k] + rowSum[x1 * c + k];
+            }
+        }
+    }
+};
+
+#endif //PROJECT_BASE_MIP_CACHE_H
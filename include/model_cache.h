@@ -0,0 +1,85 @@
+#ifndef PROJECT_BASE_MODEL_CACHE_H
+#define PROJECT_BASE_MODEL_CACHE_H
+
+#include <learnopengl/model.h>
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// shared ownership of an uploaded model; its meshes and textures are released when the last handle goes away
+typedef std::shared_ptr<Model> ModelHandle;
+
+// Process-wide cache of uploaded models. Objects that show the same file with the same import settings
+// share one Model, so placing a file many times costs one import and one set of buffers and textures.
+// Entries are keyed by canonical path, import flags and gamma correction and hold the model only weakly:
+// it lives as long as some handle does. Lookups may happen from any thread; models are created and
+// destroyed on the GL thread only.
+class ModelCache {
+public:
+    static ModelCache &instance() {
+        static ModelCache cache;
+        return cache;
+    }
+
+    // everything that changes what an import of path produces
+    static std::string key(const std::string &path, bool gamma = false) {
+        return TextureRegistry::canonicalPath(path) + '|' + std::to_string(MODEL_IMPORT_FLAGS) + '|' +
+               (MODEL_OPTIMIZE_OVERDRAW ? "o" : "") + (gamma ? "g" : "");
+    }
+
+    // the live model stored under key, or null
+    ModelHandle find(const std::string &key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = models.find(key);
+        if (entry == models.end())
+            return ModelHandle();
+        ModelHandle model = entry->second.lock();
+        if (model)
+            hits++;
+        return model;
+    }
+
+    // takes ownership of a freshly uploaded model and stores it under key. If another model was stored
+    // under the same key in the meantime, that one is returned and the new one is deleted.
+    ModelHandle insert(const std::string &key, Model *model) {
+        ModelHandle handle(model);
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto entry = models.begin(); entry != models.end();) {
+            if (entry->second.expired())
+                entry = models.erase(entry);
+            else
+                ++entry;
+        }
+        auto existing = models.find(key);
+        if (existing != models.end())
+            return existing->second.lock();
+        models[key] = handle;
+        loads++;
+        return handle;
+    }
+
+    // the cached model, or a synchronous import and upload of the file; call on the GL thread
+    ModelHandle load(const std::string &path, bool gamma = false, TextureStreamer *streamer = nullptr) {
+        std::string cacheKey = key(path, gamma);
+        if (ModelHandle cached = find(cacheKey))
+            return cached;
+        return insert(cacheKey, new Model(ModelImporter::import(path), gamma, streamer));
+    }
+
+    void report(std::ostream &out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "MODELS:: " << loads << " loaded, " << hits << " reused" << std::endl;
+    }
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::weak_ptr<Model>> models;
+    size_t loads = 0, hits = 0;
+
+    ModelCache() = default;
+};
+
+#endif //PROJECT_BASE_MODEL_CACHE_H
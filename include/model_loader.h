@@ -0,0 +1,154 @@
+#ifndef PROJECT_BASE_MODEL_LOADER_H
+#define PROJECT_BASE_MODEL_LOADER_H
+
+#include <learnopengl/model.h>
+
+#include <async_io.h>
+#include <model_cache.h>
+#include <thread_pool.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Asynchronous model loading. Worker threads run ModelImporter (mesh cache or Assimp, processMesh and
+// texture decoding) and push the finished CPU-side data onto a queue; the GL thread drains that queue in
+// poll()/finish(), where only the VAOs, buffers and textures are created. Models go through the
+// ModelCache: a file that is already loaded is handed out again, and one that is being imported is
+// imported only once no matter how many times it is requested.
+class ModelLoader {
+public:
+    // threadCount == 0 uses one worker per hardware thread. Textures of uploaded models go through the
+    // streamer when one is given, and are uploaded synchronously otherwise. The workers also read evicted
+    // geometry and textures back in for the ResidencyManager while the loader exists.
+    explicit ModelLoader(TextureStreamer *streamer = nullptr, unsigned int threadCount = 0)
+        : streamer(streamer), pool(threadCount) {
+        ResidencyManager::instance().setWorkers(&pool);
+    }
+
+    ~ModelLoader() {
+        if (ResidencyManager::instance().workerPool() == &pool)
+            ResidencyManager::instance().setWorkers(nullptr);
+    }
+
+    ModelLoader(const ModelLoader &) = delete;
+    ModelLoader &operator=(const ModelLoader &) = delete;
+
+    // queues a model for import; onLoaded runs on the GL thread with the uploaded model, right away when
+    // the model is cached already. Call from the GL thread.
+    void load(const std::string &path, std::function<void(ModelHandle)> onLoaded) {
+        std::string key = ModelCache::key(path);
+        if (ModelHandle cached = ModelCache::instance().find(key)) {
+            onLoaded(cached);
+            return;
+        }
+        std::shared_ptr<Request> request;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto importing = imports.find(key);
+            if (importing != imports.end()) {
+                importing->second->onLoaded.push_back(std::move(onLoaded));
+                return;
+            }
+            request = std::make_shared<Request>();
+            request->key = key;
+            request->onLoaded.push_back(std::move(onLoaded));
+            imports[key] = request;
+            inFlight++;
+        }
+        // the source and its mesh cache are read while the request waits for a free worker
+        AsyncIO::instance().prefetch(path);
+        AsyncIO::instance().prefetch(MeshCache::cachePath(path));
+        pool.submit([this, path, request] {
+            request->data = ModelImporter::import(path);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.push_back(request);
+            }
+            dataReady.notify_one();
+        });
+    }
+
+    // uploads every model whose import has finished; call from the GL thread, e.g. once per frame.
+    // returns the number of models uploaded.
+    size_t poll() {
+        size_t uploaded = 0;
+        for (;;) {
+            std::shared_ptr<Request> request;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (finished.empty())
+                    return uploaded;
+                request = finished.front();
+                finished.pop_front();
+            }
+            upload(*request);
+            uploaded++;
+        }
+    }
+
+    // blocks until every queued model has been imported and uploaded. Uploads happen as soon as each
+    // import completes, so GPU work on the GL thread overlaps with imports still running on the workers.
+    void finish() {
+        for (;;) {
+            std::shared_ptr<Request> request;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                dataReady.wait(lock, [this] { return !finished.empty() || inFlight == 0; });
+                if (finished.empty())
+                    return;
+                request = finished.front();
+                finished.pop_front();
+            }
+            upload(*request);
+        }
+    }
+
+    // number of models queued but not yet uploaded
+    size_t pending() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return inFlight;
+    }
+
+    unsigned int threadCount() const {
+        return pool.size();
+    }
+
+private:
+    struct Request {
+        std::string key; // ModelCache key
+        ModelData data;
+        std::vector<std::function<void(ModelHandle)>> onLoaded;
+    };
+
+    std::mutex mutex;
+    std::condition_variable dataReady;
+    std::unordered_map<std::string, std::shared_ptr<Request>> imports; // by key, until uploaded
+    std::deque<std::shared_ptr<Request>> finished;
+    size_t inFlight = 0;
+    TextureStreamer *streamer;
+    // declared last so the workers are joined before the queue they write to is destroyed
+    ThreadPool pool;
+
+    void upload(Request &request) {
+        TraceScope trace("upload model", "model", request.data.path);
+        ModelHandle model = ModelCache::instance().insert(request.key, new Model(std::move(request.data), false, streamer));
+        std::vector<std::function<void(ModelHandle)>> onLoaded;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            imports.erase(request.key);
+            onLoaded.swap(request.onLoaded);
+        }
+        for (const std::function<void(ModelHandle)> &callback : onLoaded)
+            callback(model);
+        std::lock_guard<std::mutex> lock(mutex);
+        inFlight--;
+    }
+};
+
+#endif //PROJECT_BASE_MODEL_LOADER_H
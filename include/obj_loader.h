@@ -0,0 +1,583 @@
+#ifndef PROJECT_BASE_OBJ_LOADER_H
+#define PROJECT_BASE_OBJ_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+
+#include <common.h>
+#include <mapped_file.h>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// files are split into chunks of at least this many bytes, each parsed on its own thread
+#define OBJ_LOADER_CHUNK_BYTES (128 * 1024)
+
+// one polygon corner; indices are 0-based, OBJ_MISSING when the corner has no such attribute
+struct ObjCorner {
+    int position, texCoord, normal;
+};
+
+// a usemtl/o/g statement, applied before the face with index faceIndex of its chunk
+struct ObjEvent {
+    enum Type { MATERIAL, OBJECT };
+    Type type;
+    size_t faceIndex;
+    std::string name;
+};
+
+// everything parsed from one byte range of the file. Negative (relative) OBJ indices are stored relative
+// to the chunk's own counts and flagged in `relative`, as the chunk does not know how many elements precede it.
+struct ObjChunk {
+    std::vector<glm::vec3> positions, normals;
+    std::vector<glm::vec2> texCoords;
+    std::vector<ObjCorner> corners;
+    std::vector<uint8_t> relative;     // per corner: bit 0 position, bit 1 texCoord, bit 2 normal
+    std::vector<uint32_t> faceSizes;   // corners per polygon
+    std::vector<ObjEvent> events;
+    std::vector<std::string> materialLibraries;
+};
+
+// what processMesh takes from a material: its texture maps and its opacity (MTL "d", or 1 - "Tr")
+struct ObjMaterial {
+    std::vector<Texture> textures;
+    float opacity = 1.0f;
+};
+
+// Wavefront OBJ/MTL importer for the bundled assets, used instead of Assimp for .obj files. It produces
+// the same MeshData that ModelImporter builds from Assimp with MODEL_IMPORT_FLAGS: polygons triangulated
+// as fans, smooth normals generated when a mesh has none, tangents from the UVs, V flipped, and one mesh
+// per run of faces sharing an object and material. The mapped file is parsed in parallel line-aligned
+// chunks; numbers go through a SWAR parser that converts eight digits per step.
+class ObjLoader {
+public:
+    static const int OBJ_MISSING = INT_MIN;
+
+    static bool load(const std::string &path, std::vector<MeshData> &meshes) {
+        MappedFile file(path);
+        if (!file.isOpen()) {
+            std::cout << "ERROR::OBJ:: could not open " << path << std::endl;
+            return false;
+        }
+        std::vector<ObjChunk> chunks = parse(reinterpret_cast<const char *>(file.data()), file.size());
+
+        std::string directory = path.substr(0, path.find_last_of('/'));
+        std::map<std::string, ObjMaterial> materials;
+        for (const ObjChunk &chunk : chunks) {
+            for (const std::string &library : chunk.materialLibraries)
+                loadMaterials(directory + '/' + library, materials);
+        }
+        build(chunks, materials, meshes);
+        return true;
+    }
+
+    // the mtllib file names in an OBJ file, relative to its directory, found without parsing anything else
+    static std::vector<std::string> materialLibraries(const char *data, size_t size) {
+        std::vector<std::string> libraries;
+        const char *end = data + size;
+        for (const char *p = data; p < end;) {
+            const char *lineEnd = findLineEnd(p, end);
+            skipSpaces(p, lineEnd);
+            if (lineEnd - p > 6 && *p == 'm' && readToken(p, lineEnd) == "mtllib")
+                libraries.push_back(readRest(p, lineEnd));
+            p = lineEnd + 1;
+        }
+        return libraries;
+    }
+
+    // splits the buffer at line boundaries and parses the pieces concurrently
+    static std::vector<ObjChunk> parse(const char *data, size_t size) {
+        size_t chunkCount = std::max<size_t>(1, std::min<size_t>(size / OBJ_LOADER_CHUNK_BYTES, std::max(1u, std::thread::hardware_concurrency())));
+        std::vector<const char *> bounds(chunkCount + 1, data + size);
+        bounds[0] = data;
+        for (size_t i = 1; i < chunkCount; i++) {
+            const char *split = data + size * i / chunkCount;
+            split = split < bounds[i - 1] ? bounds[i - 1] : split;
+            const char *newline = static_cast<const char *>(memchr(split, '\n', data + size - split));
+            bounds[i] = newline ? newline + 1 : data + size;
+        }
+
+        std::vector<ObjChunk> chunks(chunkCount);
+        parallelFor(chunkCount, [&](size_t i) { parseChunk(bounds[i], bounds[i + 1], chunks[i]); });
+        return chunks;
+    }
+
+    // reads the texture maps of every material in an MTL file, in the order processMesh collects them, and its opacity
+    static void loadMaterials(const std::string &path, std::map<std::string, ObjMaterial> &materials) {
+        MappedFile file(path);
+        if (!file.isOpen()) {
+            std::cout << "ERROR::OBJ:: could not open material library " << path << std::endl;
+            return;
+        }
+        // diffuse, specular, normal (Assimp's HEIGHT, i.e. bump) and height (Assimp's AMBIENT) slots
+        static const char *typeNames[4] = {"texture_diffuse", "texture_specular", "texture_normal", "texture_height"};
+        std::map<std::string, std::array<std::string, 4>> maps;
+        std::map<std::string, float> opacities;
+        std::string current;
+        const char *p = reinterpret_cast<const char *>(file.data()), *end = p + file.size();
+        while (p < end) {
+            const char *lineEnd = findLineEnd(p, end);
+            std::string keyword = readToken(p, lineEnd);
+            if (keyword == "newmtl") {
+                current = readRest(p, lineEnd);
+                maps[current];
+            } else if (!current.empty()) {
+                int slot = keyword == "map_Kd" ? 0 : keyword == "map_Ks" ? 1 :
+                           keyword == "map_bump" || keyword == "map_Bump" || keyword == "bump" ? 2 :
+                           keyword == "map_Ka" ? 3 : -1;
+                if (slot >= 0) {
+                    maps[current][slot] = readTexturePath(p, lineEnd);
+                } else if (keyword == "d" || keyword == "Tr") {
+                    float value = std::min(std::max(parseFloat(p, lineEnd), 0.0f), 1.0f);
+                    opacities[current] = keyword == "d" ? value : 1.0f - value;
+                }
+            }
+            p = lineEnd + 1;
+        }
+        for (auto &material : maps) {
+            ObjMaterial &parsed = materials[material.first];
+            auto opacity = opacities.find(material.first);
+            parsed.opacity = opacity != opacities.end() ? opacity->second : 1.0f;
+            std::vector<Texture> &textures = parsed.textures;
+            textures.clear();
+            for (int slot = 0; slot < 4; slot++) {
+                if (material.second[slot].empty())
+                    continue;
+                Texture texture;
+                texture.id = 0;
+                texture.type = typeNames[slot];
+                texture.path = material.second[slot];
+                textures.push_back(texture);
+            }
+        }
+    }
+
+private:
+    static const char *findLineEnd(const char *p, const char *end) {
+        const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+        return newline ? newline : end;
+    }
+
+    static void skipSpaces(const char *&p, const char *end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+            p++;
+    }
+
+    static std::string readToken(const char *&p, const char *end) {
+        skipSpaces(p, end);
+        const char *start = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+            p++;
+        return std::string(start, p);
+    }
+
+    // the remainder of the line without surrounding whitespace; names and file names may contain spaces
+    static std::string readRest(const char *&p, const char *end) {
+        skipSpaces(p, end);
+        const char *last = end;
+        while (last > p && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r'))
+            last--;
+        std::string rest(p, last);
+        p = end;
+        return rest;
+    }
+
+    // skips MTL texture options such as "-bm 0.04" or "-o 0 0 0" in front of the file name
+    static std::string readTexturePath(const char *&p, const char *end) {
+        for (;;) {
+            skipSpaces(p, end);
+            if (p >= end || *p != '-')
+                return readRest(p, end);
+            std::string option = readToken(p, end);
+            int arguments = option == "-o" || option == "-s" || option == "-t" ? 3 : option == "-mm" ? 2 : 1;
+            for (int i = 0; i < arguments; i++) {
+                const char *save = p;
+                std::string argument = readToken(p, end);
+                // -o/-s/-t take up to three numbers
+                if (argument.empty() || (i > 0 && !(isdigit((unsigned char) argument[0]) || argument[0] == '-' || argument[0] == '.'))) {
+                    p = save;
+                    break;
+                }
+            }
+        }
+    }
+
+    static bool isEightDigits(uint64_t chars) {
+        return (((chars + 0x4646464646464646ull) | (chars - 0x3030303030303030ull)) & 0x8080808080808080ull) == 0;
+    }
+
+    // eight ASCII digits (first digit in the lowest byte) to their value with three multiplies
+    static uint32_t parseEightDigits(uint64_t chars) {
+        chars = (chars & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+        chars = (chars & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+        return (uint32_t) ((chars & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32);
+    }
+
+    static uint64_t readDigits(const char *&p, const char *end, int &digitCount) {
+        uint64_t value = 0;
+        digitCount = 0;
+        while (end - p >= 8 && digitCount <= 11) {
+            uint64_t chars;
+            memcpy(&chars, p, 8);
+            if (!isEightDigits(chars))
+                break;
+            value = value * 100000000ull + parseEightDigits(chars);
+            p += 8;
+            digitCount += 8;
+        }
+        while (p < end && (unsigned) (*p - '0') < 10) {
+            if (digitCount < 19)
+                value = value * 10 + (uint64_t) (*p - '0');
+            digitCount++;
+            p++;
+        }
+        return value;
+    }
+
+    static float parseFloat(const char *&p, const char *end) {
+        static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        skipSpaces(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        int integerDigits, fractionDigits = 0, exponent = 0;
+        uint64_t mantissa = readDigits(p, end, integerDigits);
+        if (integerDigits > 19)
+            exponent += integerDigits - 19;
+        if (p < end && *p == '.') {
+            p++;
+            const char *fractionStart = p;
+            uint64_t fraction = readDigits(p, end, fractionDigits);
+            // keep at most 19 significant digits in the mantissa
+            int usable = std::max(0, std::min(fractionDigits, 19 - std::min(integerDigits, 19)));
+            if (usable < fractionDigits) {
+                fraction = 0;
+                for (int i = 0; i < usable; i++)
+                    fraction = fraction * 10 + (uint64_t) (fractionStart[i] - '0');
+            }
+            for (int i = 0; i < usable; i++)
+                mantissa *= 10;
+            mantissa += fraction;
+            exponent -= usable;
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+                negativeExponent = *p++ == '-';
+            int digits;
+            int value = (int) std::min<uint64_t>(readDigits(p, end, digits), 1000);
+            exponent += negativeExponent ? -value : value;
+        }
+
+        double result = (double) mantissa;
+        if (exponent < 0)
+            result = exponent >= -22 ? result / powers[-exponent] : result * std::pow(10.0, exponent);
+        else if (exponent > 0)
+            result = exponent <= 22 ? result * powers[exponent] : result * std::pow(10.0, exponent);
+        return (float) (negative ? -result : result);
+    }
+
+    // one "v/vt/vn" reference; returns false at the end of the face
+    static bool parseCorner(const char *&p, const char *end, const ObjChunk &chunk, ObjCorner &corner, uint8_t &relative) {
+        skipSpaces(p, end);
+        if (p >= end)
+            return false;
+        int *targets[3] = {&corner.position, &corner.texCoord, &corner.normal};
+        size_t counts[3] = {chunk.positions.size(), chunk.texCoords.size(), chunk.normals.size()};
+        corner.position = corner.texCoord = corner.normal = OBJ_MISSING;
+        relative = 0;
+        for (int component = 0; component < 3; component++) {
+            if (component > 0) {
+                if (p >= end || *p != '/')
+                    break;
+                p++;
+            }
+            bool negative = p < end && *p == '-';
+            if (negative)
+                p++;
+            int digits;
+            int64_t value = (int64_t) readDigits(p, end, digits);
+            if (digits == 0)
+                continue; // "v//vn"
+            if (negative) {
+                *targets[component] = (int) ((int64_t) counts[component] - value);
+                relative |= (uint8_t) (1 << component);
+            } else {
+                *targets[component] = (int) (value - 1);
+            }
+        }
+        return corner.position != OBJ_MISSING;
+    }
+
+    static void parseChunk(const char *p, const char *end, ObjChunk &chunk) {
+        while (p < end) {
+            const char *lineEnd = findLineEnd(p, end);
+            skipSpaces(p, lineEnd);
+            if (p + 1 < lineEnd) {
+                char c0 = p[0], c1 = p[1];
+                if (c0 == 'v' && (c1 == ' ' || c1 == '\t')) {
+                    p += 2;
+                    glm::vec3 v;
+                    v.x = parseFloat(p, lineEnd);
+                    v.y = parseFloat(p, lineEnd);
+                    v.z = parseFloat(p, lineEnd);
+                    chunk.positions.push_back(v);
+                } else if (c0 == 'v' && c1 == 't') {
+                    p += 2;
+                    glm::vec2 v;
+                    v.x = parseFloat(p, lineEnd);
+                    v.y = parseFloat(p, lineEnd);
+                    chunk.texCoords.push_back(v);
+                } else if (c0 == 'v' && c1 == 'n') {
+                    p += 2;
+                    glm::vec3 v;
+                    v.x = parseFloat(p, lineEnd);
+                    v.y = parseFloat(p, lineEnd);
+                    v.z = parseFloat(p, lineEnd);
+                    chunk.normals.push_back(v);
+                } else if (c0 == 'f' && (c1 == ' ' || c1 == '\t')) {
+                    p += 2;
+                    uint32_t size = 0;
+                    ObjCorner corner;
+                    uint8_t relative;
+                    while (parseCorner(p, lineEnd, chunk, corner, relative)) {
+                        chunk.corners.push_back(corner);
+                        chunk.relative.push_back(relative);
+                        size++;
+                    }
+                    if (size >= 3) {
+                        chunk.faceSizes.push_back(size);
+                    } else {
+                        // points and lines are not rendered
+                        chunk.corners.resize(chunk.corners.size() - size);
+                        chunk.relative.resize(chunk.relative.size() - size);
+                    }
+                } else if (c0 != '#') {
+                    std::string keyword = readToken(p, lineEnd);
+                    if (keyword == "usemtl")
+                        chunk.events.push_back(ObjEvent{ObjEvent::MATERIAL, chunk.faceSizes.size(), readRest(p, lineEnd)});
+                    else if (keyword == "o" || keyword == "g")
+                        chunk.events.push_back(ObjEvent{ObjEvent::OBJECT, chunk.faceSizes.size(), readRest(p, lineEnd)});
+                    else if (keyword == "mtllib")
+                        chunk.materialLibraries.push_back(readRest(p, lineEnd));
+                }
+            }
+            p = lineEnd + 1;
+        }
+    }
+
+    // faces of one output mesh, with corners already resolved to global indices
+    struct MeshFaces {
+        std::string material;
+        std::vector<ObjCorner> corners;
+        std::vector<uint32_t> faceSizes;
+    };
+
+    static void build(const std::vector<ObjChunk> &chunks, const std::map<std::string, ObjMaterial> &materials,
+                      std::vector<MeshData> &meshes) {
+        // concatenate the attribute arrays and remember where each chunk's elements start
+        std::vector<glm::vec3> positions, normals;
+        std::vector<glm::vec2> texCoords;
+        std::vector<int> bases[3];
+        for (const ObjChunk &chunk : chunks) {
+            bases[0].push_back((int) positions.size());
+            bases[1].push_back((int) texCoords.size());
+            bases[2].push_back((int) normals.size());
+            positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+            texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+            normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        }
+        int limits[3] = {(int) positions.size(), (int) texCoords.size(), (int) normals.size()};
+
+        // split the face stream into meshes at every object or material change
+        std::vector<MeshFaces> groups(1);
+        for (size_t c = 0; c < chunks.size(); c++) {
+            const ObjChunk &chunk = chunks[c];
+            size_t corner = 0, event = 0;
+            for (size_t face = 0; face <= chunk.faceSizes.size(); face++) {
+                for (; event < chunk.events.size() && chunk.events[event].faceIndex == face; event++) {
+                    const ObjEvent &e = chunk.events[event];
+                    std::string material = e.type == ObjEvent::MATERIAL ? e.name : groups.back().material;
+                    if (!groups.back().faceSizes.empty())
+                        groups.emplace_back();
+                    groups.back().material = material;
+                }
+                if (face == chunk.faceSizes.size())
+                    break;
+
+                MeshFaces &group = groups.back();
+                bool valid = true;
+                size_t first = group.corners.size();
+                for (uint32_t i = 0; i < chunk.faceSizes[face]; i++, corner++) {
+                    ObjCorner resolved = chunk.corners[corner];
+                    int *components[3] = {&resolved.position, &resolved.texCoord, &resolved.normal};
+                    for (int k = 0; k < 3; k++) {
+                        if (*components[k] == OBJ_MISSING)
+                            continue;
+                        if (chunk.relative[corner] & (1 << k))
+                            *components[k] += bases[k][c];
+                        if (*components[k] < 0 || *components[k] >= limits[k])
+                            *components[k] = k == 0 ? (valid = false, 0) : OBJ_MISSING;
+                    }
+                    group.corners.push_back(resolved);
+                }
+                if (valid) {
+                    group.faceSizes.push_back(chunk.faceSizes[face]);
+                } else {
+                    std::cout << "ERROR::OBJ:: face references a missing vertex" << std::endl;
+                    group.corners.resize(first);
+                }
+            }
+        }
+        groups.erase(std::remove_if(groups.begin(), groups.end(), [](const MeshFaces &g) { return g.faceSizes.empty(); }), groups.end());
+
+        size_t firstMesh = meshes.size();
+        meshes.resize(firstMesh + groups.size());
+        parallelFor(groups.size(), [&](size_t i) {
+            buildMesh(groups[i], positions, texCoords, normals, meshes[firstMesh + i]);
+            auto material = materials.find(groups[i].material);
+            if (material != materials.end()) {
+                meshes[firstMesh + i].textures = material->second.textures;
+                meshes[firstMesh + i].opacity = material->second.opacity;
+            }
+        });
+    }
+
+    static void buildMesh(const MeshFaces &faces, const std::vector<glm::vec3> &positions, const std::vector<glm::vec2> &texCoords,
+                          const std::vector<glm::vec3> &normals, MeshData &mesh) {
+        bool hasNormals = false, hasTexCoords = false;
+        for (const ObjCorner &corner : faces.corners) {
+            hasNormals = hasNormals || corner.normal != OBJ_MISSING;
+            hasTexCoords = hasTexCoords || corner.texCoord != OBJ_MISSING;
+        }
+
+        // one vertex per polygon corner, fan triangulated, as Assimp's OBJ importer does
+        mesh.vertices.resize(faces.corners.size());
+        size_t triangles = 0;
+        for (uint32_t size : faces.faceSizes)
+            triangles += size > 2 ? size - 2 : 0;
+        mesh.indices.reserve(triangles * 3);
+        size_t corner = 0;
+        for (uint32_t size : faces.faceSizes) {
+            for (uint32_t i = 2; i < size; i++) {
+                mesh.indices.push_back((unsigned int) corner);
+                mesh.indices.push_back((unsigned int) (corner + i - 1));
+                mesh.indices.push_back((unsigned int) (corner + i));
+            }
+            corner += size;
+        }
+        for (size_t i = 0; i < faces.corners.size(); i++) {
+            const ObjCorner &c = faces.corners[i];
+            Vertex &vertex = mesh.vertices[i];
+            vertex.Position = positions[c.position];
+            vertex.Normal = c.normal != OBJ_MISSING ? normals[c.normal] : glm::vec3(0.0f);
+            vertex.TexCoords = c.texCoord != OBJ_MISSING ? texCoords[c.texCoord] : glm::vec2(0.0f);
+            vertex.Tangent = vertex.Bitangent = glm::vec3(0.0f);
+        }
+
+        // aiProcess_GenSmoothNormals: average the face normals around every shared position
+        if (!hasNormals) {
+            std::unordered_map<int, glm::vec3> smooth;
+            for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+                glm::vec3 normal = faceNormal(mesh, t);
+                for (int k = 0; k < 3; k++)
+                    smooth.emplace(faces.corners[mesh.indices[t + k]].position, glm::vec3(0.0f)).first->second += normal;
+            }
+            for (size_t i = 0; i < faces.corners.size(); i++) {
+                glm::vec3 normal = smooth.at(faces.corners[i].position);
+                float length = glm::length(normal);
+                mesh.vertices[i].Normal = length > 0.0f ? normal / length : normal;
+            }
+        }
+
+        // aiProcess_CalcTangentSpace, averaged over corners that share position, normal and texture coordinate
+        // so those corners stay identical and can be welded by the mesh optimizer
+        if (hasTexCoords) {
+            std::unordered_map<uint64_t, std::pair<glm::vec3, glm::vec3>> sums;
+            std::vector<uint64_t> keys(faces.corners.size());
+            for (size_t i = 0; i < faces.corners.size(); i++) {
+                const ObjCorner &c = faces.corners[i];
+                const Vertex &v = mesh.vertices[i];
+                uint64_t key = hashBytes(&c.position, sizeof(int));
+                key = hashBytes(&v.Normal, sizeof(glm::vec3), key);
+                keys[i] = hashBytes(&v.TexCoords, sizeof(glm::vec2), key);
+            }
+            for (size_t t = 0; t < mesh.indices.size(); t += 3) {
+                glm::vec3 tangent, bitangent;
+                faceTangents(mesh, t, tangent, bitangent);
+                for (int k = 0; k < 3; k++) {
+                    unsigned int index = mesh.indices[t + k];
+                    const glm::vec3 &n = mesh.vertices[index].Normal;
+                    std::pair<glm::vec3, glm::vec3> &sum = sums.emplace(keys[index], std::make_pair(glm::vec3(0.0f), glm::vec3(0.0f))).first->second;
+                    sum.first += safeNormalize(tangent - n * glm::dot(tangent, n));
+                    sum.second += safeNormalize(bitangent - n * glm::dot(bitangent, n));
+                }
+            }
+            for (size_t i = 0; i < mesh.vertices.size(); i++) {
+                auto sum = sums.find(keys[i]);
+                if (sum == sums.end())
+                    continue;
+                mesh.vertices[i].Tangent = safeNormalize(sum->second.first);
+                mesh.vertices[i].Bitangent = safeNormalize(sum->second.second);
+            }
+        }
+
+        // aiProcess_FlipUVs runs after the tangent space is computed
+        for (Vertex &vertex : mesh.vertices)
+            vertex.TexCoords.y = 1.0f - vertex.TexCoords.y;
+
+        mesh.vertexData = mesh.vertices.data();
+        mesh.vertexCount = mesh.vertices.size();
+        mesh.indexData = mesh.indices.data();
+        mesh.indexCount = mesh.indices.size();
+        mesh.computeBounds();
+    }
+
+    static glm::vec3 safeNormalize(const glm::vec3 &v) {
+        float length = glm::length(v);
+        return length > 0.0f ? v / length : v;
+    }
+
+    static glm::vec3 faceNormal(const MeshData &mesh, size_t t) {
+        const glm::vec3 &p0 = mesh.vertices[mesh.indices[t]].Position;
+        const glm::vec3 &p1 = mesh.vertices[mesh.indices[t + 1]].Position;
+        const glm::vec3 &p2 = mesh.vertices[mesh.indices[t + 2]].Position;
+        return safeNormalize(glm::cross(p1 - p0, p2 - p0));
+    }
+
+    // the per-face tangent and bitangent Assimp derives from the texture coordinate gradients
+    static void faceTangents(const MeshData &mesh, size_t t, glm::vec3 &tangent, glm::vec3 &bitangent) {
+        const Vertex &v0 = mesh.vertices[mesh.indices[t]];
+        const Vertex &v1 = mesh.vertices[mesh.indices[t + 1]];
+        const Vertex &v2 = mesh.vertices[mesh.indices[t + 2]];
+        glm::vec3 v = v1.Position - v0.Position, w = v2.Position - v0.Position;
+        float sx = v1.TexCoords.x - v0.TexCoords.x, sy = v1.TexCoords.y - v0.TexCoords.y;
+        float tx = v2.TexCoords.x - v0.TexCoords.x, ty = v2.TexCoords.y - v0.TexCoords.y;
+        float direction = (tx * sy - ty * sx) < 0.0f ? -1.0f : 1.0f;
+        if (sx * ty == sy * tx) {
+            sx = 0.0f;
+            sy = 1.0f;
+            tx = 1.0f;
+            ty = 0.0f;
+        }
+        tangent = (w * sy - v * ty) * direction;
+        bitangent = (w * sx - v * tx) * direction;
+    }
+};
+
+#endif //PROJECT_BASE_OBJ_LOADER_H
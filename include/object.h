@@ -6,6 +6,10 @@
 #include <learnopengl/model.h>
 #include <learnopengl/shader.h>
 
+#include <frustum.h>
+#include <model_cache.h>
+#include <render_queue.h>
+
 #include <iostream>
 #include <map>
 #include <string>
@@ -16,7 +20,12 @@ private:
     glm::vec3 position;
     glm::mat4 rotation;
     glm::vec3 scale;
-    Model* model;
+    ModelHandle model;
+    bool doubleSided = false;
+    Bounds worldBounds; // of the model under modelMatrix(), see getWorldBounds()
+    const Model *boundsModel = nullptr; // the model and revision worldBounds was computed for
+    unsigned int boundsRevision = 0;
+    bool boundsDirty = true;
 public:
     Object();
     ~Object() = default;
@@ -24,54 +33,116 @@ public:
     void setPosition(glm::vec3 p);
     void setRotation(glm::mat4 r);
     void setScale(glm::vec3 s);
-    void setModel(Model* m);
+    void setModel(ModelHandle m);
+    void setDoubleSided(bool d);
 
     glm::vec3 getPosition();
+    const Bounds *getWorldBounds();
 
     void translate(glm::vec3 t);
     void rotate(glm::mat4 r);
-    void render(Shader *sh);
+    void submit(RenderQueue &queue, Shader *sh, const LodView *lod = nullptr, const CullView *cull = nullptr);
+    void requestTextures(const LodView &view, glm::vec3 forward);
+private:
+    glm::mat4 modelMatrix();
 };
 
 Object::Object() {
     position = glm::vec3(0);
     rotation = glm::mat4(1.0f);
     scale = glm::vec3(1);
-    model = nullptr;
 };
 
 void Object::setPosition(glm::vec3 p) {
     position = p;
+    boundsDirty = true;
 }
 void Object::setRotation(glm::mat4 r) {
     rotation = r;
+    boundsDirty = true;
 }
 void Object::setScale(glm::vec3 s) {
     scale = s;
+    boundsDirty = true;
 }
-void Object::setModel(Model *m) {
-    model = m;
-    model->SetShaderTextureNamePrefix("material.");
+// the model may be shared with other objects; null detaches it
+void Object::setModel(ModelHandle m) {
+    model = std::move(m);
+    if (model)
+        model->SetShaderTextureNamePrefix("material.");
+}
+
+// drawn without back face culling, for models whose faces are visible from both sides
+void Object::setDoubleSided(bool d) {
+    doubleSided = d;
 }
 
 glm::vec3 Object::getPosition() {
     return position;
 }
 
+// world space bounds of the model, recomputed only after the object moved or its model changed or was
+// reloaded; null while the model is still loading
+const Bounds *Object::getWorldBounds() {
+    if (!model)
+        return nullptr;
+    if (boundsDirty || boundsModel != model.get() || boundsRevision != model->revision) {
+        worldBounds = model->bounds.transformed(modelMatrix());
+        boundsModel = model.get();
+        boundsRevision = model->revision;
+        boundsDirty = false;
+    }
+    return &worldBounds;
+}
+
 void Object::translate(glm::vec3 t) {
     position += t;
+    boundsDirty = true;
 }
 void Object::rotate(glm::mat4 r) {
     rotation *= r;
+    boundsDirty = true;
 }
-void Object::render(Shader *sh) {
+glm::mat4 Object::modelMatrix() {
     glm::mat4 modelMatrix = glm::mat4(1.0f);
     modelMatrix = glm::scale(modelMatrix, scale);
     modelMatrix *= rotation;
     modelMatrix = glm::translate(modelMatrix, position);
+    return modelMatrix;
+}
+
+// queues the model's meshes for the queue's pass; lod is in world space, and without one every mesh draws at
+// full detail. With a cull view the object, and then each of its meshes, is only queued when the view can see
+// its bounds.
+void Object::submit(RenderQueue &queue, Shader *sh, const LodView *lod, const CullView *cull) {
+    // the model may still be loading asynchronously
+    if (!model)
+        return;
+    if (cull && !cull->visible(*getWorldBounds())) {
+        queue.countCulled(model->meshes.size());
+        return;
+    }
+    glm::mat4 modelMatrix = this->modelMatrix();
+    uint32_t flags = doubleSided ? (uint32_t) DRAW_DOUBLE_SIDED : 0;
+    if (!lod) {
+        model->Submit(queue, *sh, modelMatrix, nullptr, flags, cull);
+        return;
+    }
+    // error / distance is scale invariant, so only the eye has to move into model space
+    LodView local = *lod;
+    local.eye = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(lod->eye, 1.0f));
+    model->Submit(queue, *sh, modelMatrix, &local, flags, cull);
+}
 
-    sh->setMat4("model", modelMatrix);
-    model->Draw(*sh);
+// view and forward (the camera's viewing direction) are in world space
+void Object::requestTextures(const LodView &view, glm::vec3 forward) {
+    if (!model)
+        return;
+    glm::mat4 modelMatrix = this->modelMatrix();
+    LodView local = view;
+    local.eye = glm::vec3(glm::inverse(modelMatrix) * glm::vec4(view.eye, 1.0f));
+    // the plane through the eye facing forward, in model space; its normal goes with the transposed matrix
+    model->RequestTextures(local, glm::transpose(glm::mat3(modelMatrix)) * forward);
 }
 
 #endif //PROJECT_BASE_OBJECT_H
@@ -0,0 +1,270 @@
+#ifndef PROJECT_BASE_PAK_ARCHIVE_H
+#define PROJECT_BASE_PAK_ARCHIVE_H
+
+#include <lz4_block.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define PAK_MAGIC 0x4b504752u // "RGPK"
+#define PAK_VERSION 1
+// stored entries of at least this size start on a multiple of it, so they can be mapped on their own;
+// everything else starts on a multiple of PAK_MIN_ALIGNMENT, enough for the caches read in place
+#define PAK_ALIGNMENT (64 * 1024)
+#define PAK_MIN_ALIGNMENT 16
+
+enum PakCompression : uint32_t {
+    PAK_STORED = 0,
+    PAK_LZ4 = 1,
+};
+
+// Archive layout: this header, the entry data, then the index. The index is a power-of-two table of slots
+// (entry index + 1, 0 = empty) probed linearly from the name hash, followed by the entries and a block
+// holding their names.
+struct PakHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t slotCount;
+    uint64_t indexOffset;
+    uint64_t indexSize;
+};
+
+struct PakEntry {
+    uint64_t nameHash;
+    uint64_t offset; // of the stored bytes
+    uint64_t storedSize;
+    uint64_t size;   // once decompressed
+    int64_t modified; // of the packed file, seconds since the epoch
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t compression;
+    uint32_t reserved;
+};
+
+// A mounted resource archive. Once mounted, every file under the archive's root is read from the single
+// mapping instead of being opened on its own: MappedFile, and with it the model, mesh cache, texture and
+// shader loaders, asks the archive first and only falls back to the loose file for paths the archive does
+// not hold. Entry names are paths relative to the root; lookups hash the lexically normalized path.
+// Mount before any loader thread starts; lookups are thread safe afterwards.
+class PakArchive {
+public:
+    // never destroyed: files read from the archive may still be released during static destruction
+    static PakArchive &instance() {
+        static PakArchive *archive = new PakArchive();
+        return *archive;
+    }
+
+    static uint64_t hashName(const char *name, size_t length) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < length; i++) {
+            hash ^= (unsigned char) name[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // absolute path without "." and ".." components or repeated separators; relative paths start at cwd
+    static std::string normalize(const std::string &path, const std::string &cwd) {
+        std::string full = !path.empty() && path[0] == '/' ? path : cwd + '/' + path;
+        std::vector<std::string> parts;
+        size_t start = 0;
+        while (start <= full.size()) {
+            size_t end = full.find('/', start);
+            if (end == std::string::npos)
+                end = full.size();
+            std::string part = full.substr(start, end - start);
+            if (part == "..") {
+                if (!parts.empty())
+                    parts.pop_back();
+            } else if (!part.empty() && part != ".") {
+                parts.push_back(part);
+            }
+            start = end + 1;
+        }
+        std::string normalized;
+        for (const std::string &part : parts)
+            normalized += '/' + part;
+        return normalized.empty() ? "/" : normalized;
+    }
+
+    static std::string currentDirectory() {
+        char cwd[PATH_MAX];
+        return getcwd(cwd, sizeof(cwd)) ? cwd : ".";
+    }
+
+    // maps the archive and serves the files under root from it. A missing archive is not an error: the
+    // loose files are used as before. Only one archive can be mounted, and it stays mapped until exit
+    // because files read from it point into the mapping.
+    bool mount(const std::string &archivePath, const std::string &root) {
+        if (mounted()) {
+            std::cout << "ERROR::PAK:: cannot mount " << archivePath << ", an archive is already mounted" << std::endl;
+            return false;
+        }
+        int fd = ::open(archivePath.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        void *mapping = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(PakHeader))
+            mapping = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            std::cout << "ERROR::PAK:: could not map " << archivePath << std::endl;
+            return false;
+        }
+        const unsigned char *mapped = static_cast<const unsigned char *>(mapping);
+        if (!validate(mapped, (size_t) st.st_size)) {
+            std::cout << "ERROR::PAK:: " << archivePath << " is not a valid version " << PAK_VERSION << " archive" << std::endl;
+            munmap(mapping, (size_t) st.st_size);
+            return false;
+        }
+
+        bytes = mapped;
+        header = reinterpret_cast<const PakHeader *>(bytes);
+        slots = reinterpret_cast<const uint32_t *>(bytes + header->indexOffset);
+        entries = reinterpret_cast<const PakEntry *>(slots + header->slotCount);
+        names = reinterpret_cast<const char *>(entries + header->entryCount);
+        overridden.reset(new std::atomic<bool>[header->entryCount]);
+        for (uint32_t i = 0; i < header->entryCount; i++)
+            overridden[i] = false;
+
+        cwd = currentDirectory();
+        roots.clear();
+        roots.push_back(withSeparator(normalize(root, cwd)));
+        char resolved[PATH_MAX];
+        if (realpath(root.c_str(), resolved) && withSeparator(resolved) != roots[0])
+            roots.push_back(withSeparator(resolved));
+        std::cout << "PAK:: mounted " << archivePath << " with " << header->entryCount << " files" << std::endl;
+        return true;
+    }
+
+    bool mounted() const {
+        return bytes != nullptr;
+    }
+
+    size_t fileCount() const {
+        return mounted() ? header->entryCount : 0;
+    }
+
+    // the archive's entry for path, or null if it holds none or the loose file overrides it
+    const PakEntry *find(const std::string &path) const {
+        const PakEntry *entry = lookup(path);
+        return entry && !overridden[entry - entries] ? entry : nullptr;
+    }
+
+    // the stored bytes of an entry; for PAK_STORED entries the file itself, mapped in place
+    const unsigned char *data(const PakEntry &entry) const {
+        return bytes + entry.offset;
+    }
+
+    // writes the file's entry.size bytes to dst
+    bool extract(const PakEntry &entry, unsigned char *dst) const {
+        if (entry.compression == PAK_STORED) {
+            memcpy(dst, data(entry), entry.size);
+            return true;
+        }
+        return LZ4Block::decompress(data(entry), entry.storedSize, dst, entry.size);
+    }
+
+    // starts reading the entry's pages in the background, so touching them later does not block on the disk
+    void willNeed(const PakEntry &entry) const {
+        size_t page = (size_t) sysconf(_SC_PAGESIZE);
+        size_t start = (size_t) entry.offset / page * page;
+        madvise((void *) (bytes + start), (size_t) (entry.offset + entry.storedSize - start), MADV_WILLNEED);
+    }
+
+    // lookups of path fall through to the loose file from now on, e.g. once it has been edited. Thread safe.
+    void overrideWithLooseFile(const std::string &path) {
+        if (const PakEntry *entry = lookup(path))
+            overridden[entry - entries] = true;
+    }
+
+private:
+    const unsigned char *bytes = nullptr;
+    const PakHeader *header = nullptr;
+    const uint32_t *slots = nullptr;
+    const PakEntry *entries = nullptr;
+    const char *names = nullptr;
+    std::unique_ptr<std::atomic<bool>[]> overridden;
+    std::string cwd;
+    std::vector<std::string> roots; // the root as given and with symlinks resolved, each ending in '/'
+
+    PakArchive() = default;
+
+    static std::string withSeparator(const std::string &path) {
+        return !path.empty() && path.back() == '/' ? path : path + '/';
+    }
+
+    // checks everything lookups rely on, so a truncated or foreign file is rejected at mount time
+    static bool validate(const unsigned char *data, size_t size) {
+        const PakHeader *header = reinterpret_cast<const PakHeader *>(data);
+        if (header->magic != PAK_MAGIC || header->version != PAK_VERSION)
+            return false;
+        if (header->slotCount == 0 || (header->slotCount & (header->slotCount - 1)) || header->slotCount <= header->entryCount)
+            return false;
+        if (header->indexOffset % 8 || header->indexOffset > size || header->indexSize > size - header->indexOffset)
+            return false;
+        uint64_t tables = (uint64_t) header->slotCount * sizeof(uint32_t) + (uint64_t) header->entryCount * sizeof(PakEntry);
+        if (tables > header->indexSize)
+            return false;
+        const uint32_t *slots = reinterpret_cast<const uint32_t *>(data + header->indexOffset);
+        uint32_t used = 0;
+        for (uint32_t i = 0; i < header->slotCount; i++) {
+            if (slots[i] > header->entryCount)
+                return false;
+            used += slots[i] != 0;
+        }
+        if (used != header->entryCount) // leaves an empty slot to end every probe
+            return false;
+        const PakEntry *entries = reinterpret_cast<const PakEntry *>(slots + header->slotCount);
+        uint64_t nameBytes = header->indexSize - tables;
+        for (uint32_t i = 0; i < header->entryCount; i++) {
+            const PakEntry &entry = entries[i];
+            if (entry.offset > header->indexOffset || entry.storedSize > header->indexOffset - entry.offset)
+                return false;
+            if ((uint64_t) entry.nameOffset + entry.nameLength > nameBytes)
+                return false;
+            if (entry.compression != PAK_STORED && entry.compression != PAK_LZ4)
+                return false;
+            if (entry.compression == PAK_STORED && entry.storedSize != entry.size)
+                return false;
+        }
+        return true;
+    }
+
+    // the entry for path relative to one of the roots, whether or not it is overridden
+    const PakEntry *lookup(const std::string &path) const {
+        if (!mounted())
+            return nullptr;
+        std::string normalized = normalize(path, cwd);
+        for (const std::string &root : roots) {
+            if (normalized.compare(0, root.size(), root) != 0)
+                continue;
+            const char *name = normalized.c_str() + root.size();
+            size_t nameLength = normalized.size() - root.size();
+            uint64_t hash = hashName(name, nameLength);
+            uint32_t mask = header->slotCount - 1;
+            for (uint32_t slot = (uint32_t) hash & mask; slots[slot] != 0; slot = (slot + 1) & mask) {
+                const PakEntry &entry = entries[slots[slot] - 1];
+                if (entry.nameHash == hash && entry.nameLength == nameLength && memcmp(names + entry.nameOffset, name, nameLength) == 0)
+                    return &entry;
+            }
+        }
+        return nullptr;
+    }
+};
+
+#endif //PROJECT_BASE_PAK_ARCHIVE_H
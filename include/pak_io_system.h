@@ -0,0 +1,90 @@
+#ifndef PROJECT_BASE_PAK_IO_SYSTEM_H
+#define PROJECT_BASE_PAK_IO_SYSTEM_H
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include <mapped_file.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+// read-only Assimp stream over a MappedFile
+class MappedIOStream : public Assimp::IOStream {
+public:
+    explicit MappedIOStream(MappedFile &&file) : file(std::move(file)) {}
+
+    size_t Read(void *buffer, size_t size, size_t count) override {
+        if (size == 0)
+            return 0;
+        count = std::min(count, (file.size() - position) / size);
+        memcpy(buffer, file.data() + position, size * count);
+        position += size * count;
+        return count;
+    }
+
+    size_t Write(const void *buffer, size_t size, size_t count) override {
+        return 0;
+    }
+
+    aiReturn Seek(size_t offset, aiOrigin origin) override {
+        size_t target;
+        if (origin == aiOrigin_SET)
+            target = offset;
+        else if (origin == aiOrigin_CUR)
+            target = position + offset;
+        else if (origin == aiOrigin_END && offset <= file.size())
+            target = file.size() - offset;
+        else
+            return aiReturn_FAILURE;
+        if (target > file.size())
+            return aiReturn_FAILURE;
+        position = target;
+        return aiReturn_SUCCESS;
+    }
+
+    size_t Tell() const override {
+        return position;
+    }
+
+    size_t FileSize() const override {
+        return file.size();
+    }
+
+    void Flush() override {}
+
+private:
+    MappedFile file;
+    size_t position = 0;
+};
+
+// Lets Assimp read a model and the files it references (materials, embedded textures) the way the rest
+// of the loaders do: from the mounted PakArchive, falling back to loose files. Read-only.
+class PakIOSystem : public Assimp::IOSystem {
+public:
+    using Assimp::IOSystem::Exists;
+
+    bool Exists(const char *path) const override {
+        return MappedFile::exists(path);
+    }
+
+    char getOsSeparator() const override {
+        return '/';
+    }
+
+    Assimp::IOStream *Open(const char *path, const char *mode = "rb") override {
+        if (strchr(mode, 'w') || strchr(mode, 'a') || strchr(mode, '+'))
+            return nullptr;
+        MappedFile file(path);
+        if (!file.isOpen())
+            return nullptr;
+        return new MappedIOStream(std::move(file));
+    }
+
+    void Close(Assimp::IOStream *stream) override {
+        delete stream;
+    }
+};
+
+#endif //PROJECT_BASE_PAK_IO_SYSTEM_H
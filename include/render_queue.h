@@ -0,0 +1,332 @@
+#ifndef PROJECT_BASE_RENDER_QUEUE_H
+#define PROJECT_BASE_RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader.h>
+
+#include <gl_object.h>
+#include <memory_tracker.h>
+#include <vertex_format.h>
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+// the kinds of pass a RenderQueue sorts for
+enum RenderPass {
+    RENDER_PASS_SCENE,  // lit: opaque front to back grouped by state, then transparent back to front
+    RENDER_PASS_SHADOW, // depth only: no materials, front to back within each program and VAO
+};
+
+// per packet render state
+enum DrawFlags : uint32_t {
+    DRAW_DOUBLE_SIDED = 1, // drawn with back face culling off
+};
+
+// one instanced draw of a mesh: everything execute() needs to issue it without going back to the objects
+struct DrawPacket {
+    uint64_t key;
+    Shader *shader;
+    const Mesh *mesh;
+    unsigned int lod;
+    uint32_t flags;
+    float depth;            // of the nearest instance
+    uint32_t firstInstance; // into the instance buffer, once sorted
+    uint32_t instanceCount;
+};
+
+// state changes and draws issued by the last execute()
+struct RenderQueueStats {
+    size_t draws = 0;     // draw calls
+    size_t instances = 0; // meshes drawn by them
+    size_t programChanges = 0;
+    size_t materialChanges = 0;
+    size_t geometryChanges = 0; // switches between GeometryArena blocks, i.e. VAO binds
+    size_t cullChanges = 0;
+    size_t culled = 0; // meshes left out before submission because the pass could not see them
+};
+
+// Draws of one pass, collected from the objects, sorted by a packed 64-bit key and issued in that order
+// with redundant program, material, VAO and cull state changes left out. Keys, from the top bit down:
+//
+//   scene, opaque:      layer 0 | program 8 | cull 1 | material 16 | VAO 8 | depth 30 (near first)
+//   scene, transparent: layer 1 | depth 30 (far first) | program 8 | cull 1 | material 16 | VAO 8
+//   shadow:             program 8 | cull 1 | VAO 8 | depth 30 (near first)
+//
+// The program is the shader's GL name, the material the GL name of the mesh's first texture and the VAO
+// its GeometryArena block; the fields only need to group equal state, execute() compares the real state.
+// Depth is the distance from the viewer to the centre of the mesh bounds.
+//
+// Every draw is instanced: submissions of the same mesh and level of detail with the same shader and flags
+// become one packet, drawn with one glDrawElementsInstanced, and their model and normal matrices go into
+// an instance buffer uploaded once per execute(). Transparent meshes are not merged, as they have to be
+// blended in depth order. Shaders drawn through the queue must be compiled with INSTANCED defined, see
+// vertex_format.h for the instance attributes. GL thread only.
+class RenderQueue {
+public:
+    explicit RenderQueue(RenderPass pass) : pass(pass) {}
+
+    RenderQueue(const RenderQueue &) = delete;
+    RenderQueue &operator=(const RenderQueue &) = delete;
+
+    // starts collecting a frame's draws as seen from eye (world space)
+    void clear(const glm::vec3 &eye) {
+        viewer = eye;
+        packets.clear();
+        batches.clear();
+        instances.clear();
+        instanceOwners.clear();
+        culled = 0;
+        sorted = false;
+    }
+
+    // records meshes the culling stage left out of this frame's pass
+    void countCulled(size_t meshes) {
+        culled += meshes;
+    }
+
+    // queues one mesh; model is its world matrix, lod the level of detail to draw
+    void submit(Shader &shader, const Mesh &mesh, const glm::mat4 &model, unsigned int lod, uint32_t flags = 0) {
+        glm::vec3 center = glm::vec3(model * glm::vec4(mesh.bounds.center, 1.0f));
+        float depth = glm::length(center - viewer);
+        uint32_t packetIndex;
+        BatchKey batch = {&shader, &mesh, lod, flags};
+        auto existing = batches.find(batch);
+        if (existing != batches.end() && !(pass == RENDER_PASS_SCENE && isTransparent(mesh))) {
+            packetIndex = existing->second;
+            DrawPacket &packet = packets[packetIndex];
+            packet.depth = std::min(packet.depth, depth);
+            packet.instanceCount++;
+        } else {
+            packetIndex = (uint32_t) packets.size();
+            DrawPacket packet = {};
+            packet.shader = &shader;
+            packet.mesh = &mesh;
+            packet.lod = lod;
+            packet.flags = flags;
+            packet.depth = depth;
+            packet.instanceCount = 1;
+            packets.push_back(packet);
+            batches[batch] = packetIndex;
+        }
+        InstanceData instance;
+        instance.model = model;
+        instance.normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+        instances.push_back(instance);
+        instanceOwners.push_back(packetIndex);
+    }
+
+    // gathers every packet's instances into one range and orders the packets by key: a least significant
+    // digit radix sort of (key, index) pairs, 8 bits per pass, skipping the passes in which every key has
+    // the same digit
+    void sort() {
+        size_t count = packets.size();
+        uint32_t offset = 0;
+        for (DrawPacket &packet : packets) {
+            packet.key = makeKey(*packet.shader, *packet.mesh, packet.flags, packet.depth);
+            packet.firstInstance = offset;
+            offset += packet.instanceCount;
+        }
+        gathered.resize(instances.size());
+        cursor.resize(count);
+        for (size_t i = 0; i < count; i++)
+            cursor[i] = packets[i].firstInstance;
+        for (size_t i = 0; i < instances.size(); i++)
+            gathered[cursor[instanceOwners[i]]++] = instances[i];
+
+        order.resize(count);
+        scratch.resize(count);
+        for (size_t i = 0; i < count; i++)
+            order[i] = SortEntry{packets[i].key, (uint32_t) i};
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t histogram[256] = {};
+            for (const SortEntry &entry : order)
+                histogram[(entry.key >> shift) & 0xff]++;
+            if (count == 0 || histogram[(order[0].key >> shift) & 0xff] == count)
+                continue;
+            size_t start = 0;
+            for (size_t &bucket : histogram) {
+                size_t size = bucket;
+                bucket = start;
+                start += size;
+            }
+            for (const SortEntry &entry : order)
+                scratch[histogram[(entry.key >> shift) & 0xff]++] = entry;
+            order.swap(scratch);
+        }
+        sorted = true;
+    }
+
+    // uploads the instances and issues the sorted draws. Leaves back face culling on and depth writes enabled.
+    void execute() {
+        if (!sorted)
+            sort();
+        stats = RenderQueueStats();
+        stats.culled = culled;
+        if (packets.empty())
+            return;
+        uploadInstances();
+
+        GLuint program = 0;
+        const Mesh *material = nullptr;
+        unsigned int block = ~0u;
+        int culling = -1;
+        bool transparent = false;
+        for (const SortEntry &entry : order) {
+            const DrawPacket &packet = packets[entry.index];
+            const Mesh &mesh = *packet.mesh;
+            if (packet.shader->ID != program) {
+                packet.shader->use();
+                program = packet.shader->ID;
+                material = nullptr; // sampler bindings are per program
+                stats.programChanges++;
+            }
+            int cull = packet.flags & DRAW_DOUBLE_SIDED ? 0 : 1;
+            if (cull != culling) {
+                if (cull)
+                    glEnable(GL_CULL_FACE);
+                else
+                    glDisable(GL_CULL_FACE);
+                culling = cull;
+                stats.cullChanges++;
+            }
+            if (pass == RENDER_PASS_SCENE) {
+                if (isTransparent(mesh) && !transparent) {
+                    // blended surfaces are tested against the opaque depth but do not hide each other
+                    glDepthMask(GL_FALSE);
+                    transparent = true;
+                }
+                if (!material || !sameMaterial(*material, mesh)) {
+                    mesh.bindMaterial(*packet.shader);
+                    material = &mesh;
+                    stats.materialChanges++;
+                }
+            }
+            if (mesh.geometry.block != block) {
+                block = mesh.geometry.block;
+                stats.geometryChanges++;
+            }
+            mesh.drawInstances(*packet.shader, packet.lod, instanceBuffer.get(),
+                               (size_t) packet.firstInstance * sizeof(InstanceData), (GLsizei) packet.instanceCount);
+            stats.draws++;
+            stats.instances += packet.instanceCount;
+        }
+        if (transparent)
+            glDepthMask(GL_TRUE);
+        if (culling == 0)
+            glEnable(GL_CULL_FACE);
+        if (material)
+            glActiveTexture(GL_TEXTURE0);
+        sorted = false;
+    }
+
+    size_t size() const {
+        return packets.size();
+    }
+
+    const RenderQueueStats &lastStats() const {
+        return stats;
+    }
+
+private:
+    struct SortEntry {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    // what submissions must share to be drawn as instances of one packet
+    struct BatchKey {
+        const Shader *shader;
+        const Mesh *mesh;
+        unsigned int lod;
+        uint32_t flags;
+
+        bool operator==(const BatchKey &other) const {
+            return shader == other.shader && mesh == other.mesh && lod == other.lod && flags == other.flags;
+        }
+    };
+
+    struct BatchKeyHash {
+        size_t operator()(const BatchKey &key) const {
+            size_t hash = std::hash<const void *>()(key.mesh);
+            hash = hash * 31 + std::hash<const void *>()(key.shader);
+            return hash * 31 + (key.lod << 4 | key.flags);
+        }
+    };
+
+    RenderPass pass;
+    glm::vec3 viewer = glm::vec3(0.0f);
+    std::vector<DrawPacket> packets;
+    std::unordered_map<BatchKey, uint32_t, BatchKeyHash> batches; // packet of each batch this frame
+    std::vector<InstanceData> instances, gathered; // in submission order, then grouped by packet
+    std::vector<uint32_t> instanceOwners;         // packet of each submitted instance
+    std::vector<uint32_t> cursor;
+    std::vector<SortEntry> order, scratch;
+    size_t culled = 0;
+    bool sorted = false;
+    RenderQueueStats stats;
+
+    GLBuffer instanceBuffer;
+    size_t instanceCapacity = 0; // in bytes
+    TrackedMemory instanceMemory;
+
+    // orphans the buffer on every upload, so the driver never waits for last frame's draws to finish with it
+    void uploadInstances() {
+        size_t bytes = gathered.size() * sizeof(InstanceData);
+        if (!instanceBuffer)
+            instanceBuffer = GLBuffer::create();
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer.get());
+        if (bytes > instanceCapacity) {
+            instanceCapacity = std::max(bytes, instanceCapacity * 2);
+            instanceMemory = TrackedMemory(MEMORY_INSTANCES, "render queue",
+                                           pass == RENDER_PASS_SHADOW ? "shadow instances" : "scene instances", instanceCapacity);
+        }
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) instanceCapacity, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr) bytes, gathered.data());
+    }
+
+    static bool isTransparent(const Mesh &mesh) {
+        return mesh.opacity < 1.0f;
+    }
+
+    static bool sameMaterial(const Mesh &a, const Mesh &b) {
+        if (a.opacity != b.opacity || a.glslIdentifierPrefix != b.glslIdentifierPrefix || a.textures.size() != b.textures.size())
+            return false;
+        for (size_t i = 0; i < a.textures.size(); i++) {
+            if (a.textures[i].id != b.textures[i].id || a.textures[i].type != b.textures[i].type)
+                return false;
+        }
+        return true;
+    }
+
+    // the top 30 bits of a non-negative float, which order the same way as the float itself
+    static uint64_t depthBits(float depth) {
+        depth = depth > 0.0f ? depth : 0.0f;
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return bits >> 1;
+    }
+
+    uint64_t makeKey(const Shader &shader, const Mesh &mesh, uint32_t flags, float depth) const {
+        const uint64_t depthMask = (1ull << 30) - 1;
+        uint64_t program = shader.ID & 0xff;
+        uint64_t cull = flags & DRAW_DOUBLE_SIDED ? 0 : 1;
+        uint64_t material = mesh.textures.empty() ? 0 : mesh.textures[0].id & 0xffff;
+        uint64_t block = mesh.geometry.block & 0xff;
+        uint64_t near = depthBits(depth) & depthMask;
+        if (pass == RENDER_PASS_SHADOW)
+            return program << 39 | cull << 38 | block << 30 | near;
+        uint64_t state = program << 25 | cull << 24 | material << 8 | block;
+        if (isTransparent(mesh))
+            return 1ull << 63 | (depthMask - near) << 33 | state;
+        return state << 30 | near;
+    }
+};
+
+#endif //PROJECT_BASE_RENDER_QUEUE_H
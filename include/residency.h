@@ -0,0 +1,278 @@
+#ifndef PROJECT_BASE_RESIDENCY_H
+#define PROJECT_BASE_RESIDENCY_H
+
+#include <thread_pool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// GL-thread time update() may spend finishing reloads of evicted resources per frame, in milliseconds
+#define RESIDENCY_RELOAD_BUDGET_MS 4.0
+
+// a slot in the ResidencyManager; the generation tells a live entry apart from a released one that reused the slot
+struct ResidencyId {
+    uint32_t index = ~0u;
+    uint32_t generation = 0;
+
+    bool valid() const { return index != ~0u; }
+};
+
+// the GL-thread end of a reload: uploads what its load read and reports success
+typedef std::function<bool()> ResidencyUpload;
+// the worker end of a reload: reads and decodes from disk and returns the upload, or an empty upload on
+// failure. It must not touch OpenGL or the resource's owner, which may be released while it runs.
+typedef std::function<ResidencyUpload()> ResidencyLoad;
+
+// Keeps the GPU memory of model geometry and of whole (not streamed) textures within a budget. Owners
+// register each resource with its size and two callbacks: evict() frees the GPU copy, reload() returns the
+// ResidencyLoad that brings it back. Drawing code calls use() every frame a resource is needed; that marks
+// it as recently used and, when it had been evicted, schedules a reload. update() (once per frame, before
+// drawing) runs the uploads of loads that have finished, within RESIDENCY_RELOAD_BUDGET_MS, hands the loads
+// of what was asked for to the worker pool given to setWorkers(), and then evicts the least recently used
+// resources until the resident total fits the budget. A resource stays non-resident until its upload ran.
+// Without workers loads run in update() itself, within the same budget. Anything used in the current or the
+// previous frame is never evicted, so a visible set that exceeds the budget stays resident rather than
+// thrashing. Mip levels of streamed textures are budgeted by the TextureStreamer instead. GL thread only,
+// apart from the loads.
+class ResidencyManager {
+public:
+    static ResidencyManager &instance() {
+        static ResidencyManager manager;
+        return manager;
+    }
+
+    ResidencyId add(const std::string &label, size_t bytes, std::function<void()> evict, std::function<ResidencyLoad()> reload) {
+        uint32_t index;
+        if (!freeSlots.empty()) {
+            index = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            index = (uint32_t) entries.size();
+            entries.emplace_back();
+        }
+        Entry &entry = entries[index];
+        entry.live = true;
+        entry.resident = true;
+        entry.reloadRequested = false;
+        entry.reloadFailed = false;
+        entry.reloading = false;
+        entry.label = label;
+        entry.bytes = bytes;
+        entry.lastUsed = frame;
+        entry.evict = std::move(evict);
+        entry.reload = std::move(reload);
+        residentBytes += bytes;
+
+        ResidencyId id;
+        id.index = index;
+        id.generation = entry.generation;
+        return id;
+    }
+
+    // forgets the resource without evicting it; the id becomes invalid
+    void remove(ResidencyId &id) {
+        Entry *entry = find(id);
+        if (entry) {
+            if (entry->resident)
+                residentBytes -= entry->bytes;
+            uint32_t generation = entry->generation + 1;
+            *entry = Entry();
+            entry->generation = generation;
+            freeSlots.push_back(id.index);
+        }
+        id = ResidencyId();
+    }
+
+    // records a new size and state, e.g. after the owner replaced its contents
+    void update(ResidencyId id, size_t bytes, bool resident) {
+        Entry *entry = find(id);
+        if (!entry)
+            return;
+        if (entry->resident)
+            residentBytes -= entry->bytes;
+        entry->bytes = bytes;
+        entry->resident = resident;
+        if (resident) {
+            residentBytes += bytes;
+            entry->reloading = false; // a load still in flight is stale now and will be dropped
+        }
+    }
+
+    // marks the resource as needed this frame; false while it is evicted (its reload is then scheduled)
+    bool use(ResidencyId id) {
+        Entry *entry = find(id);
+        if (!entry)
+            return true;
+        entry->lastUsed = frame;
+        if (!entry->resident && !entry->reloadFailed && !entry->reloading)
+            entry->reloadRequested = true;
+        return entry->resident;
+    }
+
+    void update() {
+        auto start = std::chrono::steady_clock::now();
+        auto budgetLeft = [&start] {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() < RESIDENCY_RELOAD_BUDGET_MS;
+        };
+
+        // uploads of finished loads; what the budget leaves over waits for the next frame
+        std::deque<LoadedResource> done;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.swap(loaded);
+        }
+        while (!done.empty() && budgetLeft()) {
+            LoadedResource resource = std::move(done.front());
+            done.pop_front();
+            Entry *entry = find(resource.id);
+            // released, replaced by its owner, or evicted and asked for again since this load started
+            if (!entry || !entry->reloading || entry->reloadSerial != resource.serial)
+                continue;
+            finishReload(*entry, resource.upload);
+        }
+        if (!done.empty()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            loaded.insert(loaded.begin(), std::make_move_iterator(done.begin()), std::make_move_iterator(done.end()));
+        }
+
+        for (uint32_t index = 0; index < entries.size(); index++) {
+            Entry &entry = entries[index];
+            if (!entry.live || !entry.reloadRequested)
+                continue;
+            if (!workers && !budgetLeft())
+                break;
+            entry.reloadRequested = false;
+            entry.reloading = true;
+            ResidencyLoad load = entry.reload();
+            if (!workers) {
+                finishReload(entry, load ? load() : ResidencyUpload());
+                continue;
+            }
+            ResidencyId id;
+            id.index = index;
+            id.generation = entry.generation;
+            uint32_t serial = ++entry.reloadSerial;
+            workers->submit([this, id, serial, load] {
+                ResidencyUpload upload = load ? load() : ResidencyUpload();
+                std::lock_guard<std::mutex> lock(mutex);
+                loaded.push_back(LoadedResource{id, serial, std::move(upload)});
+            });
+        }
+
+        if (residentBytes > budgetBytes) {
+            std::vector<Entry *> candidates;
+            for (Entry &entry : entries)
+                if (entry.live && entry.resident && entry.bytes && entry.lastUsed + 1 < frame)
+                    candidates.push_back(&entry);
+            std::sort(candidates.begin(), candidates.end(), [](const Entry *a, const Entry *b) { return a->lastUsed < b->lastUsed; });
+            for (Entry *entry : candidates) {
+                if (residentBytes <= budgetBytes)
+                    break;
+                entry->evict();
+                entry->resident = false;
+                residentBytes -= entry->bytes;
+                evictions++;
+            }
+        }
+        frame++;
+    }
+
+    // loads run on these workers from now on; nullptr runs them in update(). The pool must outlive its use here.
+    void setWorkers(ThreadPool *pool) {
+        workers = pool;
+    }
+
+    ThreadPool *workerPool() const {
+        return workers;
+    }
+
+    void setBudget(size_t bytes) {
+        budgetBytes = bytes;
+    }
+
+    size_t budget() const {
+        return budgetBytes;
+    }
+
+    size_t resident() const {
+        return residentBytes;
+    }
+
+    void report(std::ostream &out) const {
+        size_t live = 0, evicted = 0, reloading = 0;
+        for (const Entry &entry : entries) {
+            live += entry.live;
+            evicted += entry.live && !entry.resident;
+            reloading += entry.live && entry.reloading;
+        }
+        out << "RESIDENCY:: " << live << " resources, " << evicted << " evicted (" << reloading << " reloading), "
+            << residentBytes / (1024.0 * 1024.0)
+            << " of " << budgetBytes / (1024.0 * 1024.0) << " MB resident, " << evictions << " evictions, " << reloads
+            << " reloads" << std::endl;
+    }
+
+private:
+    struct Entry {
+        uint32_t generation = 0;
+        bool live = false;
+        bool resident = false;
+        bool reloadRequested = false;
+        bool reloadFailed = false;
+        bool reloading = false;    // a load is running or its upload is waiting
+        uint32_t reloadSerial = 0; // tells the current load's result apart from stale ones
+        std::string label;
+        size_t bytes = 0;
+        uint64_t lastUsed = 0;
+        std::function<void()> evict;
+        std::function<ResidencyLoad()> reload;
+    };
+
+    // a load finished on a worker, waiting for update() to run its upload
+    struct LoadedResource {
+        ResidencyId id;
+        uint32_t serial;
+        ResidencyUpload upload;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<uint32_t> freeSlots;
+    size_t residentBytes = 0;
+    size_t budgetBytes = 512 * 1024 * 1024;
+    uint64_t frame = 1;
+    size_t evictions = 0, reloads = 0;
+    ThreadPool *workers = nullptr;
+    std::mutex mutex; // guards loaded, which the workers append to
+    std::deque<LoadedResource> loaded;
+
+    ResidencyManager() = default;
+
+    void finishReload(Entry &entry, const ResidencyUpload &upload) {
+        entry.reloading = false;
+        if (!upload || !upload()) {
+            // not retried: the source is gone or broken, and the owner draws without it
+            entry.reloadFailed = true;
+            std::cout << "ERROR::RESIDENCY:: could not reload " << entry.label << std::endl;
+            return;
+        }
+        entry.resident = true;
+        residentBytes += entry.bytes;
+        reloads++;
+    }
+
+    Entry *find(ResidencyId id) {
+        if (!id.valid() || id.index >= entries.size())
+            return nullptr;
+        Entry &entry = entries[id.index];
+        return entry.live && entry.generation == id.generation ? &entry : nullptr;
+    }
+};
+
+#endif //PROJECT_BASE_RESIDENCY_H
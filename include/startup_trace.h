@@ -0,0 +1,197 @@
+#ifndef PROJECT_BASE_STARTUP_TRACE_H
+#define PROJECT_BASE_STARTUP_TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// one finished scope; times are in microseconds since the trace started
+struct TraceEvent {
+    std::string name;
+    std::string category;
+    std::string detail; // e.g. the file a load scope worked on
+    uint64_t start;
+    uint64_t duration;
+    uint32_t thread;
+};
+
+// Timeline of the program's launch, from main() to the first presented frame. TraceScopes on any thread
+// record what they cover until stop() is called; the result can be saved in the Chrome trace event format
+// (open it in chrome://tracing or ui.perfetto.dev) and summarized as a table per scope name. Recording is
+// a clock read and a locked push_back per scope, and a single atomic load once stopped.
+class StartupTrace {
+public:
+    // never destroyed, like the memory tracker; the clock starts with the first call
+    static StartupTrace &instance() {
+        static StartupTrace *trace = new StartupTrace();
+        return *trace;
+    }
+
+    bool recording() const {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    // microseconds since the trace started
+    uint64_t now() const {
+        return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void record(const char *name, const char *category, const std::string &detail, uint64_t start, uint64_t end) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!recording())
+            return;
+        events.push_back(TraceEvent{name, category, detail, start, end - start, threadIndex()});
+    }
+
+    // ends the trace; scopes still open when this is called are dropped. Returns the trace length in microseconds.
+    uint64_t stop() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (recording()) {
+            active = false;
+            length = now();
+        }
+        return length;
+    }
+
+    // writes the events as a Chrome trace JSON file
+    bool writeChromeTrace(const std::string &path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ofstream out(path);
+        if (!out) {
+            std::cout << "ERROR::STARTUP_TRACE:: could not write " << path << std::endl;
+            return false;
+        }
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        for (size_t i = 0; i < threadNames.size(); i++) {
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":\""
+                << threadNames[i] << "\"}},\n";
+        }
+        for (size_t i = 0; i < events.size(); i++) {
+            const TraceEvent &event = events[i];
+            out << "{\"name\":\"" << escape(event.name) << "\",\"cat\":\"" << escape(event.category) << "\",\"ph\":\"X\",\"ts\":"
+                << event.start << ",\"dur\":" << event.duration << ",\"pid\":1,\"tid\":" << event.thread;
+            if (!event.detail.empty())
+                out << ",\"args\":{\"detail\":\"" << escape(event.detail) << "\"}";
+            out << (i + 1 < events.size() ? "},\n" : "}\n");
+        }
+        out << "]}\n";
+        return (bool) out;
+    }
+
+    // total, count and longest instance per scope name, most expensive first. Times are summed across
+    // threads, so parallel work can add up to more than the trace length.
+    void summary(std::ostream &out) {
+        struct Row {
+            std::string name;
+            size_t count = 0;
+            uint64_t total = 0, longest = 0;
+        };
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<std::string, Row> byName;
+        for (const TraceEvent &event : events) {
+            Row &row = byName[event.name];
+            row.name = event.name;
+            row.count++;
+            row.total += event.duration;
+            row.longest = std::max(row.longest, event.duration);
+        }
+        std::vector<Row> rows;
+        for (const auto &entry : byName)
+            rows.push_back(entry.second);
+        std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) { return a.total > b.total; });
+
+        out << std::fixed << std::setprecision(2);
+        out << "STARTUP:: " << events.size() << " scopes on " << threadNames.size() << " threads over "
+            << length / 1000.0 << " ms" << std::endl;
+        out << "  " << std::left << std::setw(28) << "scope" << std::right << std::setw(8) << "count" << std::setw(12)
+            << "total ms" << std::setw(12) << "max ms" << std::endl;
+        for (const Row &row : rows) {
+            out << "  " << std::left << std::setw(28) << row.name << std::right << std::setw(8) << row.count << std::setw(12)
+                << row.total / 1000.0 << std::setw(12) << row.longest / 1000.0 << std::endl;
+        }
+        out << std::defaultfloat;
+    }
+
+private:
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::atomic<bool> active{true};
+    uint64_t length = 0;
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    std::map<std::thread::id, uint32_t> threads;
+    std::vector<std::string> threadNames;
+
+    StartupTrace() {
+        threads[std::this_thread::get_id()] = 0;
+        threadNames.push_back("main");
+    }
+
+    // small stable index of the calling thread; the one that created the trace is 0. Called with the lock held.
+    uint32_t threadIndex() {
+        auto entry = threads.find(std::this_thread::get_id());
+        if (entry != threads.end())
+            return entry->second;
+        uint32_t index = (uint32_t) threadNames.size();
+        threads[std::this_thread::get_id()] = index;
+        threadNames.push_back("worker " + std::to_string(index));
+        return index;
+    }
+
+    static std::string escape(const std::string &text) {
+        std::string escaped;
+        escaped.reserve(text.size());
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            if ((unsigned char) c >= 0x20)
+                escaped += c;
+        }
+        return escaped;
+    }
+};
+
+// records the time between its construction and end() or destruction as one trace event
+class TraceScope {
+public:
+    explicit TraceScope(const char *name, const char *category = "startup", const std::string &detail = std::string())
+        : name(name), category(category) {
+        StartupTrace &trace = StartupTrace::instance();
+        if (!trace.recording())
+            return;
+        this->detail = detail;
+        start = trace.now();
+        open = true;
+    }
+
+    ~TraceScope() { end(); }
+
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    // closes the scope early, for phases that do not match a C++ block
+    void end() {
+        if (!open)
+            return;
+        open = false;
+        StartupTrace &trace = StartupTrace::instance();
+        trace.record(name, category, detail, start, trace.now());
+    }
+
+private:
+    const char *name;
+    const char *category;
+    std::string detail;
+    uint64_t start = 0;
+    bool open = false;
+};
+
+#endif //PROJECT_BASE_STARTUP_TRACE_H
@@ -0,0 +1,172 @@
+#ifndef PROJECT_BASE_TEXTURE_REGISTRY_H
+#define PROJECT_BASE_TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <gl_object.h>
+#include <memory_tracker.h>
+#include <residency.h>
+
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+
+struct RegisteredTexture {
+    unsigned int id = 0;
+    std::string canonicalPath;
+    uint64_t contentHash = 0;
+    size_t bytes = 0; // estimated GPU size including the mip chain
+    bool srgb = false; // color data, mipmapped in linear light
+    TrackedMemory memory;
+    std::function<void(unsigned int)> onRelease; // runs just before the GL texture is deleted
+    ResidencyId residency;                       // set when the ResidencyManager may evict the texture
+};
+
+// shared ownership of a registered texture; the GL texture is deleted when the last handle goes away
+typedef std::shared_ptr<RegisteredTexture> TextureHandle;
+
+// Process-wide texture registry. Every Model resolves its textures through here, so a file referenced by
+// several models, or byte-identical files under different names, is decoded and uploaded only once.
+// Entries are found by canonical absolute path or by a hash of the file contents, both O(1). Lookups may
+// happen from loader threads; textures are created and released on the GL thread only.
+class TextureRegistry {
+public:
+    static TextureRegistry &instance() {
+        static TextureRegistry registry;
+        return registry;
+    }
+
+    // absolute path with symlinks and "..", "." resolved; files that do not exist keep their lexical path
+    static std::string canonicalPath(const std::string &path) {
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(), resolved))
+            return resolved;
+        if (!path.empty() && path[0] == '/')
+            return path;
+        char cwd[PATH_MAX];
+        return getcwd(cwd, sizeof(cwd)) ? std::string(cwd) + '/' + path : path;
+    }
+
+    bool containsPath(const std::string &canonical) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = byPath.find(canonical);
+        return entry != byPath.end() && !entry->second.expired();
+    }
+
+    bool containsHash(uint64_t contentHash) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = byHash.find(contentHash);
+        return contentHash != 0 && entry != byHash.end() && !entry->second.expired();
+    }
+
+    // returns the texture registered under the path or content hash (0 = unknown), or creates it with
+    // create() and registers it under both keys. create() returns the GL texture id and its size in bytes.
+    // The memory is accounted to the owner that created it, even once other owners share it.
+    TextureHandle acquire(const std::string &canonical, uint64_t contentHash, const std::string &owner,
+                          const std::function<unsigned int(size_t &bytes)> &create, bool srgb = false) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto byPathEntry = byPath.find(canonical);
+            if (byPathEntry != byPath.end()) {
+                if (TextureHandle existing = byPathEntry->second.lock()) {
+                    pathHits++;
+                    bytesSaved += existing->bytes;
+                    return existing;
+                }
+            }
+            auto byHashEntry = contentHash ? byHash.find(contentHash) : byHash.end();
+            if (byHashEntry != byHash.end()) {
+                if (TextureHandle existing = byHashEntry->second.lock()) {
+                    hashHits++;
+                    bytesSaved += existing->bytes;
+                    byPath[canonical] = existing;
+                    return existing;
+                }
+            }
+        }
+
+        size_t bytes = 0;
+        unsigned int id = create(bytes);
+        TextureHandle handle(new RegisteredTexture(), [this](RegisteredTexture *texture) { release(texture); });
+        handle->id = id;
+        handle->canonicalPath = canonical;
+        handle->contentHash = contentHash;
+        handle->bytes = bytes;
+        handle->srgb = srgb;
+        handle->memory = TrackedMemory(MEMORY_TEXTURE, owner, canonical, bytes);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        byPath[canonical] = handle;
+        if (contentHash)
+            byHash[contentHash] = handle;
+        uniqueTextures++;
+        bytesUploaded += bytes;
+        return handle;
+    }
+
+    // the live texture registered under the canonical path, or null
+    TextureHandle find(const std::string &canonical) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = byPath.find(canonical);
+        return entry != byPath.end() ? entry->second.lock() : TextureHandle();
+    }
+
+    // records that the texture's pixels were replaced in place, e.g. by a hot reload
+    void updateContent(const TextureHandle &texture, uint64_t contentHash, size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto byHashEntry = byHash.find(texture->contentHash);
+        if (byHashEntry != byHash.end() && byHashEntry->second.lock() == texture)
+            byHash.erase(byHashEntry);
+        if (contentHash)
+            byHash[contentHash] = texture;
+        bytesUploaded += bytes;
+        texture->contentHash = contentHash;
+        texture->bytes = bytes;
+        texture->memory.resize(bytes);
+    }
+
+    void report(std::ostream &out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "TEXTURES:: " << uniqueTextures << " uploaded (" << bytesUploaded / (1024.0 * 1024.0) << " MB), "
+            << pathHits << " reused by path, " << hashHits << " reused by content, "
+            << bytesSaved / (1024.0 * 1024.0) << " MB saved" << std::endl;
+    }
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::weak_ptr<RegisteredTexture>> byPath;
+    std::unordered_map<uint64_t, std::weak_ptr<RegisteredTexture>> byHash;
+    size_t uniqueTextures = 0, pathHits = 0, hashHits = 0;
+    size_t bytesUploaded = 0, bytesSaved = 0;
+
+    TextureRegistry() = default;
+
+    void release(RegisteredTexture *texture) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto entry = byPath.begin(); entry != byPath.end();) {
+                if (entry->second.expired())
+                    entry = byPath.erase(entry);
+                else
+                    ++entry;
+            }
+            auto byHashEntry = byHash.find(texture->contentHash);
+            if (byHashEntry != byHash.end() && byHashEntry->second.expired())
+                byHash.erase(byHashEntry);
+        }
+        if (texture->onRelease)
+            texture->onRelease(texture->id);
+        ResidencyManager::instance().remove(texture->residency);
+        GLTexture(texture->id).reset();
+        delete texture;
+    }
+};
+
+#endif //PROJECT_BASE_TEXTURE_REGISTRY_H
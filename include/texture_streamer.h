@@ -0,0 +1,483 @@
+#ifndef PROJECT_BASE_TEXTURE_STREAMER_H
+#define PROJECT_BASE_TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+
+#include <decoded_image.h>
+#include <gl_object.h>
+#include <memory_tracker.h>
+#include <mip_cache.h>
+#include <startup_trace.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// complete mip chains are streamed: only levels up to this size are uploaded before anything asks for more
+#define STREAM_TAIL_SIZE 64
+
+// Streams decoded texture data to the GPU through a small ring of pixel unpack buffers.
+//
+// enqueue() hands back a texture id right away, backed by a 1x1 placeholder, so a mesh can be drawn
+// with it immediately. update() (once per frame on the GL thread) copies pending images into free ring
+// slots and issues glTexImage2D from the PBO, which lets the driver perform the transfer asynchronously
+// instead of stalling on the client pointer. Each slot is guarded by a fence; a slot is reused, and its
+// texture reported resident, only after the fence has signalled. The amount of pixel data copied per
+// frame is capped so a batch of large castle textures is spread over several frames.
+//
+// The context is GL 3.3 core, so the PBOs are mapped per upload with GL_MAP_UNSYNCHRONIZED_BIT (safe
+// because the slot's fence has already signalled) rather than persistently mapped.
+//
+// Textures enqueued with a complete mip chain are streamed by screen coverage. The streamer keeps the chain
+// (usually mapped from its .mipcache) and first uploads only the levels up to STREAM_TAIL_SIZE. Every frame
+// the renderer reports through request() how many UV units one pixel spans for each visible texture. update()
+// turns that into the finest level needed and uploads the missing levels one at a time, largest shortfall
+// first. GL_TEXTURE_BASE_LEVEL/MAX_LEVEL restrict sampling to the resident levels. Streamed levels stay
+// within the VRAM budget: levels finer than needed go first, least recently requested texture first, and
+// when that is not enough the largest resident levels are dropped and further loads wait.
+class TextureStreamer {
+public:
+    explicit TextureStreamer(size_t slotCount = 3, size_t bytesPerFrame = 16 * 1024 * 1024,
+                             size_t vramBudget = 256 * 1024 * 1024)
+        : slots(slotCount), frameBudget(bytesPerFrame), vramBudget(vramBudget) {}
+
+    TextureStreamer(const TextureStreamer &) = delete;
+    TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+    // creates a texture showing a 1x1 placeholder and queues the image for upload. Normal maps get a
+    // flat-normal placeholder so lighting stays plausible until the real data arrives.
+    unsigned int enqueue(DecodedImage &&image, bool normalMap = false) {
+        return enqueue(MipChain(std::move(image)), normalMap);
+    }
+
+    // as above for a prebuilt mip chain. A complete chain is streamed by coverage and its resident levels
+    // are accounted to owner; a lone level 0 is uploaded whole and mipmapped by glGenerateMipmap.
+    unsigned int enqueue(MipChain &&mips, bool normalMap = false, const std::string &owner = "TextureStreamer",
+                         const std::string &label = "texture") {
+        static const unsigned char neutral[4] = {128, 128, 128, 255};
+        static const unsigned char flatNormal[4] = {128, 128, 255, 255};
+
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, normalMap ? flatNormal : neutral);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        if (mips.valid() && mips.levels.size() > 1)
+            stream(textureID, std::move(mips), owner, label);
+        else if (mips.valid())
+            queue(textureID, std::move(mips));
+        return textureID;
+    }
+
+    // queues new pixels for an existing texture, which keeps showing its current contents, mip range and
+    // swizzle until the first transfer lands. With streamLevels a complete chain is streamed by coverage like
+    // enqueue() does, otherwise it is uploaded whole; isResident() turns true once level 0 is on the GPU.
+    void replace(unsigned int texture, MipChain &&mips, bool streamLevels, const std::string &owner = "TextureStreamer",
+                 const std::string &label = "texture") {
+        if (!mips.valid())
+            return;
+        forget(texture);
+        if (streamLevels && mips.levels.size() > 1)
+            stream(texture, std::move(mips), owner, label);
+        else
+            queue(texture, std::move(mips));
+        pending.back().replacing = true;
+    }
+
+    // stops streaming the texture and drops its queued uploads, e.g. because it is being deleted and the id
+    // may be reused; its GL contents are left as they are
+    void forget(unsigned int texture) {
+        // whole images; queued levels of a streamed texture are skipped through their serial once it is erased
+        pending.erase(std::remove_if(pending.begin(), pending.end(), [texture](const PendingUpload &upload) {
+            return upload.texture == texture && upload.serial == 0;
+        }), pending.end());
+        // a transfer already under way must not report a reused id resident when it lands
+        for (Slot &slot : slots)
+            if (slot.texture == texture)
+                slot.complete = false;
+        resident.erase(texture);
+        auto entry = streamed.find(texture);
+        if (entry == streamed.end())
+            return;
+        streamedBytes -= entry->second.residentBytes();
+        streamed.erase(entry);
+    }
+
+    // reports that the texture is visible with one screen pixel spanning uvPerPixel texture coordinate units
+    // (0 = the viewer is inside the object). The finest level asked for during a frame wins.
+    void request(unsigned int texture, float uvPerPixel) {
+        auto entry = streamed.find(texture);
+        if (entry == streamed.end())
+            return;
+        StreamedTexture &streaming = entry->second;
+        float texelsPerPixel = uvPerPixel * (float) std::max(streaming.mips.width, streaming.mips.height);
+        int level = texelsPerPixel > 1.0f ? (int) std::floor(std::log2(texelsPerPixel)) : 0;
+        level = std::min(level, streaming.tail);
+        if (streaming.requestFrame != frame) {
+            streaming.requestFrame = frame;
+            streaming.wanted = level;
+        } else {
+            streaming.wanted = std::min(streaming.wanted, level);
+        }
+    }
+
+    void setBudget(size_t bytes) {
+        vramBudget = bytes;
+    }
+
+    size_t budget() const {
+        return vramBudget;
+    }
+
+    // bytes of streamed levels currently on the GPU
+    size_t residentStreamedBytes() const {
+        return streamedBytes;
+    }
+
+    // retires finished transfers, applies this frame's requests to the streamed textures and starts new
+    // transfers within the per-frame budget. Never blocks.
+    void update() {
+        TraceScope trace("stream textures", "texture");
+        retire(0);
+        planStreaming();
+        frame++;
+
+        size_t copied = 0;
+        while (!pending.empty() && copied < frameBudget) {
+            Slot *slot = freeSlot();
+            if (!slot)
+                break;
+            copied += start(*slot, pending.front());
+            pending.pop_front();
+        }
+    }
+
+    // uploads everything still queued and waits for all transfers to finish
+    void flush() {
+        while (!idle()) {
+            update();
+            retire(FLUSH_WAIT_NS);
+        }
+    }
+
+    bool idle() const {
+        if (!pending.empty())
+            return false;
+        for (const Slot &slot : slots)
+            if (slot.fence)
+                return false;
+        return true;
+    }
+
+
+    // true once the texture's full-resolution data is on the GPU
+    bool isResident(unsigned int texture) const {
+        return resident.count(texture) != 0;
+    }
+
+    size_t pendingCount() const {
+        return pending.size();
+    }
+
+    // deletes the ring's buffers and fences; call while the GL context is still current
+    void release() {
+        for (Slot &slot : slots) {
+            if (slot.fence)
+                glDeleteSync(slot.fence);
+            slot = Slot();
+        }
+        pending.clear();
+        streamed.clear();
+        streamedBytes = queuedBytes = 0;
+    }
+
+private:
+    // how long flush() waits on a fence per round, in nanoseconds
+    static const GLuint64 FLUSH_WAIT_NS = 1000000000ull;
+
+    struct Slot {
+        GLBuffer buffer;
+        size_t capacity = 0;
+        GLsync fence = 0;
+        unsigned int texture = 0;
+        bool complete = false; // the transfer includes level 0
+        TrackedMemory memory;
+    };
+
+    // a texture whose levels are uploaded on demand; levels [resident, levels) are on the GPU and
+    // [queued, resident) are waiting for or in transfer
+    struct StreamedTexture {
+        MipChain mips;
+        uint64_t serial = 0;       // tells this texture apart from an earlier one under the same GL id
+        int tail = 0;              // coarsest level ever requested; everything from here down stays resident
+        int resident = 0;
+        int queued = 0;
+        int wanted = 0;            // finest level asked for in the requested frame
+        uint64_t requestFrame = 0; // last frame a request() came in
+        TrackedMemory memory;
+
+        int levelCount() const { return (int) mips.levels.size(); }
+        size_t residentBytes() const { return bytes(resident, levelCount()); }
+        size_t bytes(int first, int end) const {
+            size_t total = 0;
+            for (int level = first; level < end; level++)
+                total += mips.levelSizes[level];
+            return total;
+        }
+    };
+
+    struct PendingUpload {
+        unsigned int texture = 0;
+        MipChain mips;            // empty for streamed levels, which are read from the StreamedTexture
+        uint64_t serial = 0;      // non-zero for streamed levels
+        int firstLevel = 0, endLevel = 0;
+        size_t bytes = 0;
+        TrackedMemory memory;     // the decoded pixels held until the upload starts
+        bool replacing = false;   // first transfer of replace(): the previous contents may have been swizzled
+    };
+
+    std::vector<Slot> slots;
+    std::deque<PendingUpload> pending;
+    std::set<unsigned int> resident;
+    std::map<unsigned int, StreamedTexture> streamed;
+    size_t frameBudget;
+    size_t vramBudget;
+    size_t streamedBytes = 0; // streamed levels on the GPU
+    size_t queuedBytes = 0;   // streamed levels queued but not started
+    uint64_t frame = 1;
+    uint64_t nextSerial = 1;
+
+    void queue(unsigned int texture, MipChain &&mips) {
+        PendingUpload upload;
+        upload.texture = texture;
+        upload.memory = TrackedMemory(MEMORY_CPU_TEXTURE, "TextureStreamer", "texture " + std::to_string(texture), mips.totalSize());
+        upload.endLevel = (int) mips.levels.size();
+        upload.bytes = mips.totalSize();
+        upload.mips = std::move(mips);
+        pending.push_back(std::move(upload));
+    }
+
+    void stream(unsigned int texture, MipChain &&mips, const std::string &owner, const std::string &label) {
+        StreamedTexture streaming;
+        streaming.mips = std::move(mips);
+        streaming.serial = nextSerial++;
+        int levels = streaming.levelCount();
+        int tail = 0;
+        while (tail + 1 < levels && std::max(streaming.mips.width >> tail, streaming.mips.height >> tail) > STREAM_TAIL_SIZE)
+            tail++;
+        streaming.tail = streaming.wanted = tail;
+        streaming.resident = streaming.queued = levels;
+        streaming.memory = TrackedMemory(MEMORY_TEXTURE, owner, label, 0);
+        forget(texture);
+        StreamedTexture &entry = streamed[texture] = std::move(streaming);
+        queueLevels(texture, entry, tail);
+    }
+
+    // queues levels [first, entry.queued) of a streamed texture as one transfer
+    void queueLevels(unsigned int texture, StreamedTexture &entry, int first) {
+        PendingUpload upload;
+        upload.texture = texture;
+        upload.serial = entry.serial;
+        upload.firstLevel = first;
+        upload.endLevel = entry.queued;
+        upload.bytes = entry.bytes(upload.firstLevel, upload.endLevel);
+        entry.queued = first;
+        queuedBytes += upload.bytes;
+        pending.push_back(std::move(upload));
+    }
+
+    // the finest level a streamed texture should have: what was asked for in this or the previous frame,
+    // only the tail once it went unseen
+    int target(const StreamedTexture &streaming) const {
+        return streaming.requestFrame + 1 >= frame ? streaming.wanted : streaming.tail;
+    }
+
+    // moves every streamed texture towards its target level: drops levels over the budget, then queues the
+    // next finer level of the textures furthest from their target while the budget allows
+    void planStreaming() {
+        std::vector<std::pair<unsigned int, StreamedTexture *>> surplus, shortfall;
+        for (auto &entry : streamed) {
+            StreamedTexture &streaming = entry.second;
+            if (streaming.queued != streaming.resident)
+                continue; // a transfer is outstanding, leave it alone until it lands
+            if (streaming.resident < target(streaming))
+                surplus.emplace_back(entry.first, &streaming);
+            else if (streaming.resident > target(streaming))
+                shortfall.emplace_back(entry.first, &streaming);
+        }
+
+        // levels nobody needs any more: least recently requested first
+        std::sort(surplus.begin(), surplus.end(), [](const std::pair<unsigned int, StreamedTexture *> &a,
+                                                     const std::pair<unsigned int, StreamedTexture *> &b) {
+            return a.second->requestFrame < b.second->requestFrame;
+        });
+        for (auto &entry : surplus) {
+            while (streamedBytes + queuedBytes > vramBudget && entry.second->resident < target(*entry.second))
+                evictLevel(entry.first, *entry.second);
+        }
+        // still over budget (it was lowered, or the visible set alone exceeds it): drop the largest levels
+        while (streamedBytes + queuedBytes > vramBudget) {
+            unsigned int largest = 0;
+            StreamedTexture *victim = nullptr;
+            for (auto &entry : streamed) {
+                StreamedTexture &streaming = entry.second;
+                if (streaming.queued == streaming.resident && streaming.resident < streaming.tail &&
+                    (!victim || streaming.mips.levelSizes[streaming.resident] > victim->mips.levelSizes[victim->resident])) {
+                    largest = entry.first;
+                    victim = &streaming;
+                }
+            }
+            if (!victim)
+                break;
+            evictLevel(largest, *victim);
+        }
+
+        std::sort(shortfall.begin(), shortfall.end(), [this](const std::pair<unsigned int, StreamedTexture *> &a,
+                                                             const std::pair<unsigned int, StreamedTexture *> &b) {
+            return a.second->resident - target(*a.second) > b.second->resident - target(*b.second);
+        });
+        for (auto &entry : shortfall) {
+            StreamedTexture &streaming = *entry.second;
+            int level = streaming.resident - 1;
+            if (streamedBytes + queuedBytes + streaming.mips.levelSizes[level] > vramBudget)
+                continue;
+            queueLevels(entry.first, streaming, level);
+        }
+    }
+
+    // releases the finest resident level of a streamed texture and clamps sampling to the rest
+    void evictLevel(unsigned int texture, StreamedTexture &streaming) {
+        int level = streaming.resident;
+        streaming.resident = streaming.queued = level + 1;
+        streamedBytes -= streaming.mips.levelSizes[level];
+        streaming.memory.resize(streaming.residentBytes());
+        if (level == 0)
+            resident.erase(texture);
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, streaming.resident);
+        // a zero-sized image lets the driver free the level; it lies below the base level, so the texture stays complete
+        glTexImage2D(GL_TEXTURE_2D, level, uploadFormat(streaming.mips.components), 0, 0, 0,
+                     uploadFormat(streaming.mips.components), GL_UNSIGNED_BYTE, nullptr);
+    }
+
+    static GLenum uploadFormat(int components) {
+        if (components == 1)
+            return GL_RED;
+        if (components == 2)
+            return GL_RG;
+        if (components == 3)
+            return GL_RGB;
+        return GL_RGBA;
+    }
+
+    Slot *freeSlot() {
+        for (Slot &slot : slots)
+            if (!slot.fence)
+                return &slot;
+        return nullptr;
+    }
+
+    void retire(GLuint64 timeout) {
+        for (Slot &slot : slots) {
+            if (!slot.fence)
+                continue;
+            GLenum status = glClientWaitSync(slot.fence, timeout ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, timeout);
+            if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+                glDeleteSync(slot.fence);
+                slot.fence = 0;
+                if (slot.complete)
+                    resident.insert(slot.texture);
+            }
+        }
+    }
+
+    // copies the upload's levels into the slot's PBO and issues the texture uploads from it; returns bytes copied
+    size_t start(Slot &slot, PendingUpload &upload) {
+        const MipChain *source = &upload.mips;
+        StreamedTexture *streaming = nullptr;
+        if (upload.serial) {
+            queuedBytes -= upload.bytes;
+            auto entry = streamed.find(upload.texture);
+            if (entry == streamed.end() || entry->second.serial != upload.serial)
+                return 0; // forgotten since it was queued
+            streaming = &entry->second;
+            source = &streaming->mips;
+        }
+        const MipChain &mips = *source;
+        size_t size = upload.bytes;
+        GLenum format = uploadFormat(mips.components);
+
+        if (!slot.buffer)
+            slot.buffer = GLBuffer::create();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer.get());
+        if (slot.capacity < size) {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            slot.capacity = size;
+            slot.memory = TrackedMemory(MEMORY_STAGING, "TextureStreamer", "pixel unpack buffer", size);
+        }
+        unsigned char *mapped = (unsigned char *) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (mapped) {
+            size_t offset = 0;
+            for (int level = upload.firstLevel; level < upload.endLevel; level++) {
+                memcpy(mapped + offset, mips.levels[level], mips.levelSizes[level]);
+                offset += mips.levelSizes[level];
+            }
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, upload.texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        size_t offset = 0;
+        for (int level = upload.firstLevel; level < upload.endLevel; level++) {
+            // from the PBO, or straight from the client pointer if the PBO could not be mapped
+            const void *pixels = mapped ? (const void *) offset : (const void *) mips.levels[level];
+            if (!mapped && level == upload.firstLevel)
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glTexImage2D(GL_TEXTURE_2D, level, format, std::max(1, mips.width >> level), std::max(1, mips.height >> level), 0,
+                         format, GL_UNSIGNED_BYTE, pixels);
+            offset += mips.levelSizes[level];
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        if (upload.replacing) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_GREEN);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_BLUE);
+        }
+        if (streaming) {
+            // commands execute in order, so the new levels can be sampled right away
+            if (streaming->resident == streaming->levelCount())
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, streaming->levelCount() - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, upload.firstLevel);
+            streaming->resident = upload.firstLevel;
+            streamedBytes += size;
+            streaming->memory.resize(streaming->residentBytes());
+        } else {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+            if (mips.complete()) {
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint) mips.levels.size() - 1);
+            } else {
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+                glGenerateMipmap(GL_TEXTURE_2D);
+            }
+        }
+
+        slot.texture = upload.texture;
+        slot.complete = upload.firstLevel == 0;
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        return size;
+    }
+};
+
+#endif //PROJECT_BASE_TEXTURE_STREAMER_H
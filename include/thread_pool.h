@@ -0,0 +1,98 @@
+#ifndef PROJECT_BASE_THREAD_POOL_H
+#define PROJECT_BASE_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads consuming a FIFO of jobs. Jobs must not touch OpenGL.
+class ThreadPool {
+public:
+    // threadCount == 0 uses one worker per hardware thread
+    explicit ThreadPool(unsigned int threadCount = 0) {
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 1;
+        for (unsigned int i = 0; i < threadCount; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobAvailable.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        jobAvailable.notify_one();
+    }
+
+    // blocks until every submitted job has finished
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return jobs.empty() && running == 0; });
+    }
+
+    unsigned int size() const {
+        return (unsigned int) workers.size();
+    }
+
+    // true on a worker of any pool, where the cores are already spoken for
+    static bool onWorkerThread() {
+        return workerFlag();
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable idle;
+    unsigned int running = 0;
+    bool stopping = false;
+
+    static bool &workerFlag() {
+        thread_local bool worker = false;
+        return worker;
+    }
+
+    void workerLoop() {
+        workerFlag() = true;
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                running++;
+            }
+            job();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running--;
+                if (jobs.empty() && running == 0)
+                    idle.notify_all();
+            }
+        }
+    }
+};
+
+#endif //PROJECT_BASE_THREAD_POOL_H
@@ -0,0 +1,172 @@
+#ifndef PROJECT_BASE_UNIFORM_BLOCKS_H
+#define PROJECT_BASE_UNIFORM_BLOCKS_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <gl_object.h>
+#include <memory_tracker.h>
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+// Uniform blocks shared by every program: their std140 layout as C++ structs, the matching GLSL declarations
+// (UNIFORM_BLOCKS_GLSL, spliced into a shader in place of the line #include "uniform_blocks.glsl") and the
+// fixed binding point of each. Shader binds the blocks a program uses right after linking; main uploads
+// each one through a UniformBlockBuffer. A change to a struct here has to be made to the GLSL below too,
+// which the static_asserts on the std140 offsets help keep honest.
+#define UNIFORM_BLOCK_SPOT_LIGHTS 2
+
+enum UniformBlockBinding {
+    UNIFORM_BINDING_FRAME,  // FrameData
+    UNIFORM_BINDING_LIGHTS, // Lights
+    UNIFORM_BINDING_SHADOW, // ShadowData
+    UNIFORM_BINDING_COUNT
+};
+
+// std140 puts a vec3 on a 16 byte boundary and lets a following float fill its fourth component, so every
+// vec3 here is paired with a float; explicit padding keeps the structs free of indeterminate bytes.
+struct PointLight {
+    glm::vec3 position;
+    float constant = 1.0f;
+    glm::vec3 ambient;
+    float linear = 0.0f;
+    glm::vec3 diffuse;
+    float quadratic = 0.0f;
+    glm::vec3 specular;
+    float padding = 0.0f;
+};
+
+struct SpotLight {
+    glm::vec3 position;
+    float constant = 1.0f;
+    glm::vec3 direction;
+    float linear = 0.0f;
+    glm::vec3 ambient;
+    float quadratic = 0.0f;
+    glm::vec3 diffuse;
+    float cutOff = 0.0f;      // cosine of the inner cone angle
+    glm::vec3 specular;
+    float outerCutOff = 0.0f; // cosine of the outer cone angle
+};
+
+// camera, once per frame
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPosition;
+    float padding = 0.0f;
+};
+
+struct Lights {
+    PointLight pointLight;
+    SpotLight spotLights[UNIFORM_BLOCK_SPOT_LIGHTS];
+};
+
+// the point light's shadow cube map: one view projection per face, and the range depths are divided by
+struct ShadowData {
+    glm::mat4 shadowMatrices[6];
+    glm::vec3 lightPosition;
+    float farPlane = 1.0f;
+};
+
+static_assert(sizeof(PointLight) == 64 && offsetof(PointLight, specular) == 48, "PointLight must match std140");
+static_assert(sizeof(SpotLight) == 80 && offsetof(SpotLight, outerCutOff) == 76, "SpotLight must match std140");
+static_assert(sizeof(FrameData) == 144 && offsetof(FrameData, viewPosition) == 128, "FrameData must match std140");
+static_assert(sizeof(Lights) == 64 + 80 * UNIFORM_BLOCK_SPOT_LIGHTS && offsetof(Lights, spotLights) == 64, "Lights must match std140");
+static_assert(sizeof(ShadowData) == 400 && offsetof(ShadowData, farPlane) == 396, "ShadowData must match std140");
+
+#define UNIFORM_BLOCKS_STRINGIFY(x) #x
+#define UNIFORM_BLOCKS_NUMBER(x) UNIFORM_BLOCKS_STRINGIFY(x)
+
+static const char *const UNIFORM_BLOCKS_GLSL =
+        "#define N_SPOTLIGHTS " UNIFORM_BLOCKS_NUMBER(UNIFORM_BLOCK_SPOT_LIGHTS) "\n"
+        R"(
+struct PointLight {
+    vec3 position;
+    float constant;
+    vec3 ambient;
+    float linear;
+    vec3 diffuse;
+    float quadratic;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    float constant;
+    vec3 direction;
+    float linear;
+    vec3 ambient;
+    float quadratic;
+    vec3 diffuse;
+    float cutOff;
+    vec3 specular;
+    float outerCutOff;
+};
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+layout (std140) uniform Lights {
+    PointLight pointLight;
+    SpotLight spotLights[N_SPOTLIGHTS];
+};
+
+layout (std140) uniform ShadowData {
+    mat4 shadowMatrices[6];
+    vec3 lightPosition;
+    float farPlane;
+};
+)";
+
+// block names by binding point, for glUniformBlockBinding
+static const char *const UNIFORM_BLOCK_NAMES[UNIFORM_BINDING_COUNT] = {"FrameData", "Lights", "ShadowData"};
+
+// GL buffer behind one block, bound to the block's binding point for as long as it lives. update() uploads
+// only when the contents differ from the last upload, so blocks that rarely change (the lights, the shadow
+// matrices of a light that stays put) cost a memcmp per frame. GL thread only.
+template <typename Block>
+class UniformBlockBuffer {
+public:
+    explicit UniformBlockBuffer(UniformBlockBinding binding)
+        : buffer(GLBuffer::create()),
+          memory(MEMORY_UNIFORMS, "uniform blocks", UNIFORM_BLOCK_NAMES[binding], sizeof(Block)) {
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer.get());
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer.get());
+    }
+
+    UniformBlockBuffer(const UniformBlockBuffer &) = delete;
+    UniformBlockBuffer &operator=(const UniformBlockBuffer &) = delete;
+
+    // returns whether anything was uploaded
+    bool update(const Block &data) {
+        if (uploaded && memcmp(&data, &last, sizeof(Block)) == 0)
+            return false;
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer.get());
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &data);
+        last = data;
+        uploaded = true;
+        uploads++;
+        return true;
+    }
+
+    size_t uploadCount() const {
+        return uploads;
+    }
+
+private:
+    GLBuffer buffer;
+    TrackedMemory memory;
+    Block last;
+    bool uploaded = false;
+    size_t uploads = 0;
+};
+
+#endif //PROJECT_BASE_UNIFORM_BLOCKS_H
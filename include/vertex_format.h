@@ -0,0 +1,137 @@
+#ifndef PROJECT_BASE_VERTEX_FORMAT_H
+#define PROJECT_BASE_VERTEX_FORMAT_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// positions are stored as 16-bit unorm relative to the mesh bounds; set to 0 to keep full float positions
+#ifndef MESH_QUANTIZE_POSITIONS
+#define MESH_QUANTIZE_POSITIONS 1
+#endif
+
+// GPU vertex layout used by Mesh (20 bytes, 24 without position quantization, instead of the 56 byte Vertex):
+//   location 0  position   4 x uint16 unorm, dequantized as aPos * positionScale + positionOffset
+//                          (or 3 x float with scale 1 and offset 0)
+//   location 1  normal     int 2_10_10_10_rev snorm
+//   location 2  texCoords  2 x half float
+//   location 3  tangent    int 2_10_10_10_rev snorm, w holds the bitangent sign: B = cross(N, T) * w
+struct PackedVertex {
+#if MESH_QUANTIZE_POSITIONS
+    uint16_t Position[4]; // the fourth component only pads to 8 bytes
+#else
+    float    Position[3];
+#endif
+    uint32_t Normal;
+    uint16_t TexCoords[2];
+    uint32_t Tangent;
+};
+
+// per instance attributes of the shaders' INSTANCED variants, read from the render queue's instance buffer:
+//   locations 4-7   model matrix, one column each
+//   locations 8-10  normal matrix (inverse transpose of the model matrix's upper 3x3), one column each
+#define INSTANCE_ATTRIBUTE_MODEL 4
+#define INSTANCE_ATTRIBUTE_NORMAL 8
+struct InstanceData {
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+};
+
+// maps packed positions back to model space; also what the shaders receive as uniforms
+struct PositionDequantization {
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::vec3 offset = glm::vec3(0.0f);
+};
+
+class VertexPacker {
+public:
+    // vertex is the importer's full-float Vertex (anything with Position, Normal, TexCoords, Tangent and Bitangent)
+    template<typename VertexT>
+    static std::vector<PackedVertex> pack(const VertexT *vertices, size_t count, PositionDequantization &dequantization) {
+        dequantization = PositionDequantization();
+#if MESH_QUANTIZE_POSITIONS
+        glm::vec3 lo(0.0f), hi(0.0f);
+        if (count) {
+            lo = hi = vertices[0].Position;
+            for (size_t i = 1; i < count; i++) {
+                lo = glm::min(lo, vertices[i].Position);
+                hi = glm::max(hi, vertices[i].Position);
+            }
+        }
+        glm::vec3 extent = hi - lo;
+        for (int c = 0; c < 3; c++)
+            dequantization.scale[c] = extent[c] > 0.0f ? extent[c] : 1.0f;
+        dequantization.offset = lo;
+#endif
+
+        std::vector<PackedVertex> packed(count);
+        for (size_t i = 0; i < count; i++) {
+            const VertexT &v = vertices[i];
+            PackedVertex &p = packed[i];
+#if MESH_QUANTIZE_POSITIONS
+            for (int c = 0; c < 3; c++)
+                p.Position[c] = (uint16_t) std::lround(glm::clamp((v.Position[c] - lo[c]) / dequantization.scale[c], 0.0f, 1.0f) * 65535.0f);
+            p.Position[3] = 0;
+#else
+            for (int c = 0; c < 3; c++)
+                p.Position[c] = v.Position[c];
+#endif
+            p.Normal = packSnorm1010102(v.Normal, 0.0f);
+            p.TexCoords[0] = toHalf(v.TexCoords.x);
+            p.TexCoords[1] = toHalf(v.TexCoords.y);
+            // the shader rebuilds the bitangent from N and T, only its handedness has to be stored
+            float handedness = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) < 0.0f ? -1.0f : 1.0f;
+            p.Tangent = packSnorm1010102(v.Tangent, handedness);
+        }
+        return packed;
+    }
+
+    // signed normalized 10/10/10/2 with x in the low bits, matching GL_INT_2_10_10_10_REV
+    static uint32_t packSnorm1010102(const glm::vec3 &v, float w) {
+        glm::vec3 n = v;
+        float length = glm::length(n);
+        if (length > 0.0f)
+            n /= length;
+        uint32_t x = (uint32_t) std::lround(glm::clamp(n.x, -1.0f, 1.0f) * 511.0f) & 0x3ff;
+        uint32_t y = (uint32_t) std::lround(glm::clamp(n.y, -1.0f, 1.0f) * 511.0f) & 0x3ff;
+        uint32_t z = (uint32_t) std::lround(glm::clamp(n.z, -1.0f, 1.0f) * 511.0f) & 0x3ff;
+        uint32_t a = (uint32_t) std::lround(glm::clamp(w, -1.0f, 1.0f)) & 0x3;
+        return x | (y << 10) | (z << 20) | (a << 30);
+    }
+
+    // IEEE 754 binary16, round to nearest even; overflow saturates to infinity
+    static uint16_t toHalf(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000;
+        int32_t exponent = (int32_t) ((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffff;
+
+        if (((bits >> 23) & 0xff) == 0xff) // inf or NaN
+            return (uint16_t) (sign | 0x7c00 | (mantissa ? 0x200 : 0));
+        if (exponent >= 31)
+            return (uint16_t) (sign | 0x7c00);
+        if (exponent <= 0) {
+            if (exponent < -10)
+                return (uint16_t) sign;
+            mantissa |= 0x800000;
+            uint32_t shift = (uint32_t) (14 - exponent);
+            uint32_t half = mantissa >> shift;
+            uint32_t rest = mantissa & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1)))
+                half++;
+            return (uint16_t) (sign | half);
+        }
+        uint32_t half = ((uint32_t) exponent << 10) | (mantissa >> 13);
+        uint32_t rest = mantissa & 0x1fff;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+            half++; // may carry into the exponent, which is still the correctly rounded result
+        return (uint16_t) (sign | half);
+    }
+};
+
+#endif //PROJECT_BASE_VERTEX_FORMAT_H
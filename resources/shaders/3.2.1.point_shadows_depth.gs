@@ -2,7 +2,8 @@
 layout (triangles) in;
 layout (triangle_strip, max_vertices=18) out;
 
-uniform mat4 shadowMatrices[6];
+// shadowMatrices come from ShadowData
+#include "uniform_blocks.glsl"
 
 out vec4 FragPos; // FragPos from GS (output per emitvertex)
 
@@ -1,9 +1,19 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
+#ifdef INSTANCED
+// per instance, see InstanceData in vertex_format.h; the normal matrix is not needed for depth
+layout (location = 4) in mat4 aModel;
+#else
 uniform mat4 model;
+#endif
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
 
 void main()
 {
-    gl_Position = model * vec4(aPos, 1.0);
+#ifdef INSTANCED
+    mat4 model = aModel;
+#endif
+    gl_Position = model * vec4(aPos * positionScale + positionOffset, 1.0);
 }
\ No newline at end of file
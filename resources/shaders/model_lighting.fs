@@ -1,52 +1,23 @@
 #version 330 core
 out vec4 FragColor;
 
-struct PointLight {
-    vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-#define N_SPOTLIGHTS 2
+// PointLight, SpotLight, N_SPOTLIGHTS and the FrameData, Lights and ShadowData blocks, see uniform_blocks.h
+#include "uniform_blocks.glsl"
 
 struct Material {
     sampler2D texture_diffuse1;
     sampler2D texture_specular1;
 
     float shininess;
+    float opacity;
 };
 in vec2 TexCoords;
 in vec3 Normal;
 in vec3 FragPos;
 
-uniform PointLight pointLight;
-uniform SpotLight spotLights[N_SPOTLIGHTS];
 uniform Material material;
-uniform vec3 viewPosition;
 
 uniform samplerCube depthMap;
-uniform float far_plane;
 
 float ShadowCalculation(vec3 fragPos)
 {
@@ -64,7 +35,7 @@ float ShadowCalculation(vec3 fragPos)
             for(float z = -offset; z < offset; z += offset / (samples * 0.5))
             {
                 float closestDepth = texture(depthMap, fragToLight + vec3(x, y, z)).r;
-                closestDepth *= far_plane;   // undo mapping [0;1]
+                closestDepth *= farPlane;   // undo mapping [0;1]
                 if(currentDepth - bias > closestDepth)
                     shadow += 1.0;
             }
@@ -140,5 +111,5 @@ void main()
     float distance = length(FragPos - viewPosition) / 1.5;
     distance = distance > 1.0 ? 1.0 : distance;
 
-    FragColor = vec4(globalAmbient + (1.0 - shadow) * result, distance);
+    FragColor = vec4(globalAmbient + (1.0 - shadow) * result, distance * material.opacity);
 }
\ No newline at end of file
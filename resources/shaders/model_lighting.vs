@@ -7,14 +7,29 @@ out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
 
+#ifdef INSTANCED
+// per instance, see InstanceData in vertex_format.h
+layout (location = 4) in mat4 aModel;
+layout (location = 8) in mat3 aNormalMatrix;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+// projection and view come from FrameData
+#include "uniform_blocks.glsl"
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = aNormal;
+#ifdef INSTANCED
+    mat4 model = aModel;
+    mat3 normalMatrix = aNormalMatrix;
+#else
+    mat3 normalMatrix = transpose(inverse(mat3(model)));
+#endif
+    FragPos = vec3(model * vec4(aPos * positionScale + positionOffset, 1.0));
+    Normal = normalMatrix * aNormal;
     TexCoords = aTexCoords;    
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
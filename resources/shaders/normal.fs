@@ -1,34 +1,8 @@
 #version 330 core
 out vec4 FragColor;
 
-struct PointLight {
-    vec3 position;
-
-    vec3 specular;
-    vec3 diffuse;
-    vec3 ambient;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-#define N_SPOTLIGHTS 2
+// PointLight, SpotLight, N_SPOTLIGHTS and the FrameData, Lights and ShadowData blocks, see uniform_blocks.h
+#include "uniform_blocks.glsl"
 
 struct Material {
     sampler2D texture_diffuse1;
@@ -36,6 +10,7 @@ struct Material {
     sampler2D texture_normal1;
 
     float shininess;
+    float opacity;
 };
 in vec2 TexCoords;
 in vec3 Normal;
@@ -46,10 +21,7 @@ in vec3 TangentSpotLightPos[N_SPOTLIGHTS];
 in vec3 TangentFragPos;
 in vec3 TangentViewPos;
 
-uniform PointLight pointLight;
-uniform SpotLight spotLights[N_SPOTLIGHTS];
 uniform Material material;
-uniform vec3 viewPosition;
 
 
 vec3 globalAmbient = vec3(0.0f);
@@ -107,7 +79,11 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec
 void main()
 {
     vec3 normal = texture(material.texture_normal1, TexCoords).rgb;
-    normal = normalize(normal * 2.0 - 1.0);
+    normal = normal * 2.0 - 1.0;
+    // cooked BC5 normal maps only store x and y (blue reads as 0), so rebuild z from the unit length
+    if (normal.z == -1.0)
+        normal.z = sqrt(max(1.0 - dot(normal.xy, normal.xy), 0.0));
+    normal = normalize(normal);
     vec3 viewDir = normalize(TangentViewPos - TangentFragPos);
 
     vec3 result = CalcPointLight(pointLight, normal, TangentFragPos, viewDir, TangentLightPos);
@@ -117,5 +93,5 @@ void main()
     float distance = length(FragPos - viewPosition) / 1.5;
     distance = distance > 1.0 ? 1.0 : distance;
 
-    FragColor = vec4(globalAmbient + result, distance);
+    FragColor = vec4(globalAmbient + result, distance * material.opacity);
 }
\ No newline at end of file
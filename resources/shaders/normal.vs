@@ -2,10 +2,10 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
-layout (location = 3) in vec3 aTangent;
-layout (location = 4) in vec3 aBitangent;
+layout (location = 3) in vec4 aTangent; // w: bitangent sign
 
-#define N_SPOTLIGHTS 2
+// the camera and the light positions come from FrameData and Lights
+#include "uniform_blocks.glsl"
 
 out vec2 TexCoords;
 out vec3 Normal;
@@ -16,30 +16,38 @@ out vec3 TangentSpotLightPos[N_SPOTLIGHTS];
 out vec3 TangentFragPos;
 out vec3 TangentViewPos;
 
+#ifdef INSTANCED
+// per instance, see InstanceData in vertex_format.h
+layout (location = 4) in mat4 aModel;
+layout (location = 8) in mat3 aNormalMatrix;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-uniform vec3 lightPos;
-uniform vec3 SpotLightPos[N_SPOTLIGHTS];
-uniform vec3 viewPos;
+#endif
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
+#ifdef INSTANCED
+    mat4 model = aModel;
+    mat3 normalMatrix = aNormalMatrix;
+#else
+    mat3 normalMatrix = transpose(inverse(mat3(model)));
+#endif
+    FragPos = vec3(model * vec4(aPos * positionScale + positionOffset, 1.0));
     TexCoords = aTexCoords;
 
-    mat3 normalMatrix = transpose(inverse(mat3(model)));
-    vec3 T = normalize(normalMatrix * aTangent);
+    vec3 T = normalize(normalMatrix * aTangent.xyz);
     vec3 N = normalize(normalMatrix * aNormal);
     T = normalize(T - dot(T, N) * N);
-    vec3 B = cross(N, T);
+    // GL 3.3 maps the 2-bit snorm -1 to -1/3, so only the sign of w is meaningful
+    vec3 B = cross(N, T) * (aTangent.w < 0.0 ? -1.0 : 1.0);
 
     mat3 TBN = transpose(mat3(T, B, N));
-    TangentLightPos = TBN * lightPos;
+    TangentLightPos = TBN * pointLight.position;
     for (int i = 0; i < N_SPOTLIGHTS; i++)
-        TangentSpotLightPos[i] = TBN * SpotLightPos[i];
-    TangentViewPos  = TBN * viewPos;
+        TangentSpotLightPos[i] = TBN * spotLights[i].position;
+    TangentViewPos  = TBN * viewPosition;
     TangentFragPos  = TBN * FragPos;
 
     gl_Position = projection * view * vec4(FragPos, 1.0);
@@ -14,9 +14,29 @@
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
 
+#include "asset_hot_reload.h"
+#include "async_io.h"
+#include "compressed_texture.h"
+#include "dds.h"
+#include "frustum.h"
+#include "geometry_arena.h"
+#include "gl_object.h"
+#include "memory_tracker.h"
+#include "model_cache.h"
+#include "model_loader.h"
 #include "object.h"
-
+#include "render_queue.h"
+#include "residency.h"
+#include "startup_trace.h"
+#include "texture_streamer.h"
+#include "uniform_blocks.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <random>
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 
@@ -30,8 +50,10 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 bool normal = false;
 int speed = 1;
 
-void renderScene(Shader *shader);
+void renderScene(RenderQueue &queue, Shader *shader, const LodView &lod, const CullView &cull);
 vector<Object *> objects;
+Object castle;
+RenderQueue shadowQueue(RENDER_PASS_SHADOW), sceneQueue(RENDER_PASS_SCENE);
 
 unsigned int loadCubemap(vector<std::string> faces);
 
@@ -39,6 +61,11 @@ unsigned int loadCubemap(vector<std::string> faces);
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
 
+// level of detail: largest acceptable geometric error in pixels, and how much coarser the shadow
+// pass may be since shadow maps are low resolution and filtered anyway
+const float LOD_PIXEL_ERROR = 1.0f;
+const float SHADOW_LOD_BIAS = 4.0f;
+
 // camera
 
 float lastX = SCR_WIDTH / 2.0f;
@@ -49,32 +76,8 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-struct PointLight {
-    glm::vec3 position;
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-
-struct SpotLight {
-    glm::vec3 position;
-    glm::vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    glm::vec3 ambient;
-    glm::vec3 diffuse;
-    glm::vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
-vector<SpotLight> spotLights(2);
+// PointLight and SpotLight are laid out as the Lights uniform block, see uniform_blocks.h
+SpotLight spotLights[UNIFORM_BLOCK_SPOT_LIGHTS];
 
 struct ProgramState {
     glm::vec3 clearColor = glm::vec3(0);
@@ -84,14 +87,45 @@ struct ProgramState {
     glm::vec3 backpackPosition = glm::vec3(0.0f);
     float backpackScale = 1.0f;
     PointLight pointLight;
+    int textureBudgetMB = 256; // VRAM for streamed texture levels
+    int residencyBudgetMB = 512; // VRAM for model geometry and whole textures
     ProgramState() : camera(glm::vec3(0.0f, 10.0f, -8.0f)) {}
 };
 
 ProgramState *programState;
 
 void DrawImGui(ProgramState *programState);
+void DrawMemoryPanel();
+
+int main(int argc, char **argv) {
+    // launch phases are traced until the first frame is presented, see startup_trace.h
+    StartupTrace &startupTrace = StartupTrace::instance();
+    TraceScope startupPhase("glfw init");
+
+    // --memory-report prints every tracked allocation with current and peak totals at exit
+    // --startup-trace writes the launch timeline to startup_trace.json and prints a summary of it
+    // --forest <count> scatters count more trees, rocks and logs around the scene, drawn instanced
+    bool memoryReport = false, writeStartupTrace = false;
+    int forestSize = 0;
+    for (int i = 1; i < argc; i++) {
+        memoryReport = memoryReport || strcmp(argv[i], "--memory-report") == 0;
+        writeStartupTrace = writeStartupTrace || strcmp(argv[i], "--startup-trace") == 0;
+        if (strcmp(argv[i], "--forest") == 0 && i + 1 < argc)
+            forestSize = std::max(0, atoi(argv[++i]));
+    }
+    // resources.pak, built by the pack_resources target, stands in for the loose files when it exists
+    FileSystem::mountArchive("resources.pak");
+    // the shaders and the skybox are read while the window and the context are being created
+    for (const char *path : {"resources/shaders/model_lighting.vs", "resources/shaders/model_lighting.fs",
+                             "resources/shaders/3.2.1.point_shadows_depth.vs", "resources/shaders/3.2.1.point_shadows_depth.fs",
+                             "resources/shaders/3.2.1.point_shadows_depth.gs", "resources/shaders/6.1.skybox.vs",
+                             "resources/shaders/6.1.skybox.fs", "resources/shaders/normal.vs", "resources/shaders/normal.fs"})
+        AsyncIO::instance().prefetch(path);
+    for (const char *face : {"right", "left", "top", "bottom", "front", "back"}) {
+        std::string path = FileSystem::getPath(std::string("resources/textures/skybox/") + face + ".jpg");
+        AsyncIO::instance().prefetch(DDS::isFresh(DDS::cookedPath(path), path) ? DDS::cookedPath(path) : path);
+    }
 
-int main() {
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -120,6 +154,8 @@ int main() {
     // tell GLFW to capture our mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
+    startupPhase.end();
+    TraceScope gladPhase("glad load");
     // glad: load all OpenGL function pointers
     // ---------------------------------------
     if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
@@ -130,6 +166,9 @@ int main() {
     // tell stb_image.h to flip loaded texture's on the y-axis (before loading model).
     //stbi_set_flip_vertically_on_load(true);
 
+    gladPhase.end();
+
+    TraceScope imguiPhase("imgui init");
     programState = new ProgramState;
     if (programState->ImGuiEnabled) {
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
@@ -144,6 +183,7 @@ int main() {
 
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 330 core");
+    imguiPhase.end();
 
     // configure global opengl state
     // -----------------------------
@@ -156,11 +196,17 @@ int main() {
 
     // build and compile shaders
     // -------------------------
-    Shader simpleShader("resources/shaders/model_lighting.vs", "resources/shaders/model_lighting.fs");
-    Shader simpleDepthShader("resources/shaders/3.2.1.point_shadows_depth.vs", "resources/shaders/3.2.1.point_shadows_depth.fs", "resources/shaders/3.2.1.point_shadows_depth.gs");
+    // the variants drawn through the render queues read their transforms per instance
+    Shader simpleShader("resources/shaders/model_lighting.vs", "resources/shaders/model_lighting.fs", nullptr, "INSTANCED");
+    Shader simpleDepthShader("resources/shaders/3.2.1.point_shadows_depth.vs", "resources/shaders/3.2.1.point_shadows_depth.fs", "resources/shaders/3.2.1.point_shadows_depth.gs", "INSTANCED");
     Shader skyboxShader("resources/shaders/6.1.skybox.vs", "resources/shaders/6.1.skybox.fs");
-    Shader normalShader("resources/shaders/normal.vs", "resources/shaders/normal.fs");
+    Shader normalShader("resources/shaders/normal.vs", "resources/shaders/normal.fs", nullptr, "INSTANCED");
+    // camera, lights and shadow matrices are shared by all programs through uniform blocks
+    UniformBlockBuffer<FrameData> frameBlock(UNIFORM_BINDING_FRAME);
+    UniformBlockBuffer<Lights> lightsBlock(UNIFORM_BINDING_LIGHTS);
+    UniformBlockBuffer<ShadowData> shadowBlock(UNIFORM_BINDING_SHADOW);
 
+    TraceScope shadowPhase("shadow map setup");
     const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
     unsigned int depthMapFBO;
     glGenFramebuffers(1, &depthMapFBO);
@@ -170,6 +216,7 @@ int main() {
     for (unsigned int i = 0; i < 6; ++i)
         glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT,
                      SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    MemoryTracker::instance().track(MEMORY_RENDER_TARGET, "scene", "point shadow cubemap", 6 * SHADOW_WIDTH * SHADOW_HEIGHT * sizeof(float));
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -180,17 +227,30 @@ int main() {
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    shadowPhase.end();
     
     
     // load models
     // -----------
-    Object castle;
-    castle.setModel(new Model("resources/objects/castle/Castle OBJ.obj"));
+    // imports run on a worker pool while this thread creates the GPU resources as each one finishes.
+    // models are served from their .meshcache files after the first run; delete those to measure a cold load
+    // texture pixels are streamed in through PBOs, coarse levels first and finer ones as the camera gets close
+    // enough to need them; placeholders are drawn until the first levels arrive
+    double sceneLoadStart = glfwGetTime();
+    TraceScope scenePhase("load scene");
+    TextureStreamer textureStreamer;
+    ModelLoader loader(&textureStreamer);
+    // edits to the model and texture files are picked up while running, see asset_hot_reload.h
+    AssetHotReload hotReload(textureStreamer);
+    hotReload.watch("resources/objects");
+    hotReload.watch("resources/textures");
+    loader.load("resources/objects/castle/Castle OBJ.obj", [&hotReload](ModelHandle m) { castle.setModel(m); hotReload.track(m); });
     castle.setScale(glm::vec3(0.25));
+    castle.setDoubleSided(true);
 //    objects.push_back(&castle);
 
     Object henri;
-    henri.setModel(new Model("resources/objects/henri/stegosaurus.obj"));
+    loader.load("resources/objects/henri/stegosaurus.obj", [&henri, &hotReload](ModelHandle m) { henri.setModel(m); hotReload.track(m); });
     henri.setScale(glm::vec3(0.007));
     henri.translate(glm::vec3(-14.0, 17, 400.0));
     objects.push_back(&henri);
@@ -204,37 +264,58 @@ int main() {
     float curr3 = 0.0f, total3 = 100.0f;
 
     Object tank;
-    tank.setModel(new Model("resources/objects/tank/T34.vox.obj"));
+    loader.load("resources/objects/tank/T34.vox.obj", [&tank, &hotReload](ModelHandle m) { tank.setModel(m); hotReload.track(m); });
     tank.setScale(glm::vec3(0.4));
     tank.rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-135.0f), glm::vec3(0.0, 1.0, 0.0)));
     tank.translate(glm::vec3(2, 0.1, 5));
     objects.push_back(&tank);
 
     Object tree_bare;
-    tree_bare.setModel(new Model("resources/objects/trees/Trunk_3.obj"));
+    loader.load("resources/objects/trees/Trunk_3.obj", [&tree_bare, &hotReload](ModelHandle m) { tree_bare.setModel(m); hotReload.track(m); });
     tree_bare.setScale(glm::vec3(0.6));
     tree_bare.translate(glm::vec3(5, 0, 0));
     objects.push_back(&tree_bare);
 
     Object tree;
-    tree.setModel(new Model("resources/objects/trees/Tree_3.obj"));
+    loader.load("resources/objects/trees/Tree_3.obj", [&tree, &hotReload](ModelHandle m) { tree.setModel(m); hotReload.track(m); });
     tree.setScale(glm::vec3(0.6));
     tree.translate(glm::vec3(-7, 0, 13));
     objects.push_back(&tree);
 
     Object trunk;
-    trunk.setModel(new Model("resources/objects/trees/Log_5.obj"));
+    loader.load("resources/objects/trees/Log_5.obj", [&trunk, &hotReload](ModelHandle m) { trunk.setModel(m); hotReload.track(m); });
     trunk.setScale(glm::vec3(0.6));
     trunk.rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-135.0f), glm::vec3(0.0, 1.0, 0.0)));
     trunk.translate(glm::vec3(12, 0, -7));
     objects.push_back(&trunk);
 
     Object rock;
-    rock.setModel(new Model("resources/objects/rock/Rock1.obj"));
+    loader.load("resources/objects/rock/Rock1.obj", [&rock, &hotReload](ModelHandle m) { rock.setModel(m); hotReload.track(m); });
     rock.setScale(glm::vec3(0.6));
     rock.translate(glm::vec3(9, 0, 13));
     objects.push_back(&rock);
 
+    // every placement shares its model with the others, so the render queue draws each mesh once per pass
+    const char *forestModels[] = {"resources/objects/trees/Tree_3.obj", "resources/objects/rock/Rock1.obj", "resources/objects/trees/Log_5.obj"};
+    vector<std::unique_ptr<Object>> forest;
+    std::mt19937 forestRandom(7);
+    std::uniform_real_distribution<float> forestPosition(-60.0f, 60.0f), forestAngle(0.0f, 360.0f);
+    for (int i = 0; i < forestSize; i++) {
+        forest.emplace_back(new Object());
+        Object *placement = forest.back().get();
+        loader.load(forestModels[i % 3], [placement](ModelHandle m) { placement->setModel(m); });
+        placement->setScale(glm::vec3(0.6));
+        placement->rotate(glm::rotate(glm::mat4(1.0f), glm::radians(forestAngle(forestRandom)), glm::vec3(0.0, 1.0, 0.0)));
+        placement->translate(glm::vec3(forestPosition(forestRandom), 0, forestPosition(forestRandom)));
+        objects.push_back(placement);
+    }
+    loader.finish();
+    scenePhase.end();
+    std::cout << "SCENE::LOADED in " << (glfwGetTime() - sceneLoadStart) * 1000.0 << " ms on " << loader.threadCount() << " threads" << std::endl;
+    ModelCache::instance().report(std::cout);
+    TextureRegistry::instance().report(std::cout);
+    GeometryArena::instance().report(std::cout);
+
 
     PointLight& pointLight = programState->pointLight;
     pointLight.position = glm::vec3( 0.0f, 5.0, 5.0);
@@ -277,6 +358,7 @@ int main() {
 
 
     // load skybox
+    TraceScope skyboxPhase("skybox setup");
     vector<std::string> faces
     {
             FileSystem::getPath("resources/textures/skybox/right.jpg"),
@@ -287,6 +369,9 @@ int main() {
             FileSystem::getPath("resources/textures/skybox/back.jpg")
     };
     unsigned int cubemapTexture = loadCubemap(faces);
+    // everything loaded at startup has been opened by now; what was not is a stale cache or a skipped texture
+    AsyncIO::instance().dropUnclaimed();
+    AsyncIO::instance().report(std::cout);
 
     float skyboxVertices[] = {
             // positions
@@ -340,11 +425,13 @@ int main() {
     glBindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
+    MemoryTracker::instance().track(MEMORY_ENVIRONMENT, "scene", "skybox vertices", sizeof(skyboxVertices));
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
     skyboxShader.use();
     skyboxShader.setInt("skybox", 0);
+    skyboxPhase.end();
 
 
 
@@ -353,6 +440,7 @@ int main() {
 
     // render loop
     // -----------
+    TraceScope firstFramePhase("first frame");
     while (!glfwWindowShouldClose(window)) {
         // per-frame time logic
         // --------------------
@@ -363,23 +451,49 @@ int main() {
         glm::mat4 projection = glm::perspective(glm::radians(programState->camera.Zoom),
                                                 (float) SCR_WIDTH / (float) SCR_HEIGHT, 0.1f, 100.0f);
         glm::mat4 view = programState->camera.GetViewMatrix();
+        LodView cameraLod = {programState->camera.Position,
+                             SCR_HEIGHT / (2.0f * tanf(glm::radians(programState->camera.Zoom) / 2.0f)), LOD_PIXEL_ERROR};
+        CullView cameraCull;
+        cameraCull.add(projection * view);
 
         // input
         // -----
         processInput(window);
 
+        hotReload.update();
+        textureStreamer.setBudget((size_t) programState->textureBudgetMB * 1024 * 1024);
+        castle.requestTextures(cameraLod, programState->camera.Front);
+        for (auto &object : objects)
+            object->requestTextures(cameraLod, programState->camera.Front);
+        textureStreamer.update();
+        ResidencyManager::instance().setBudget((size_t) programState->residencyBudgetMB * 1024 * 1024);
+        ResidencyManager::instance().update();
+
 
         // render
         // ------
         glClearColor(programState->clearColor.r, programState->clearColor.g, programState->clearColor.b, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        // each block is uploaded only when its contents changed since the last frame
+        FrameData frame;
+        frame.projection = projection;
+        frame.view = view;
+        frame.viewPosition = programState->camera.Position;
+        frameBlock.update(frame);
+        Lights lights;
+        lights.pointLight = pointLight;
+        std::copy(spotLights, spotLights + UNIFORM_BLOCK_SPOT_LIGHTS, lights.spotLights);
+        lightsBlock.update(lights);
+
         if (!normal) {
             // 0. create depth cubemap transformation matrices
             // -----------------------------------------------
             float near_plane = 1.0f;
             float far_plane = 25.0f;
             glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), (float)SHADOW_WIDTH / (float)SHADOW_HEIGHT, near_plane, far_plane);
+            LodView shadowLod = {pointLight.position, SHADOW_HEIGHT / (2.0f * tanf(glm::radians(45.0f))),
+                                 LOD_PIXEL_ERROR * SHADOW_LOD_BIAS};
             std::vector<glm::mat4> shadowTransforms;
             shadowTransforms.push_back(shadowProj * glm::lookAt(pointLight.position, pointLight.position + glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
             shadowTransforms.push_back(shadowProj * glm::lookAt(pointLight.position, pointLight.position + glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
@@ -387,21 +501,21 @@ int main() {
             shadowTransforms.push_back(shadowProj * glm::lookAt(pointLight.position, pointLight.position + glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f)));
             shadowTransforms.push_back(shadowProj * glm::lookAt(pointLight.position, pointLight.position + glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
             shadowTransforms.push_back(shadowProj * glm::lookAt(pointLight.position, pointLight.position + glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f)));
+            CullView shadowCull;
+            for (const glm::mat4 &face : shadowTransforms)
+                shadowCull.add(face);
+            ShadowData shadow;
+            std::copy(shadowTransforms.begin(), shadowTransforms.end(), shadow.shadowMatrices);
+            shadow.lightPosition = pointLight.position;
+            shadow.farPlane = far_plane;
+            shadowBlock.update(shadow);
 
             // 1. render scene to depth cubemap
             // --------------------------------
             glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
             glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
             glClear(GL_DEPTH_BUFFER_BIT);
-            simpleDepthShader.use();
-            for (unsigned int i = 0; i < 6; ++i)
-                simpleDepthShader.setMat4("shadowMatrices[" + std::to_string(i) + "]", shadowTransforms[i]);
-            simpleDepthShader.setFloat("far_plane", far_plane);
-            simpleDepthShader.setVec3("lightPos", pointLight.position);
-            simpleDepthShader.setMat4("projection", projection);
-            simpleDepthShader.setMat4("view", view);
-            castle.render(&simpleDepthShader);
-            renderScene(&simpleDepthShader);
+            renderScene(shadowQueue, &simpleDepthShader, shadowLod, shadowCull);
             glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
             // 2. render scene as normal
@@ -410,77 +524,19 @@ int main() {
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             simpleShader.use();
             simpleShader.setInt("depthMap", 1);
-            simpleShader.setFloat("far_plane", far_plane);
             glActiveTexture(GL_TEXTURE1);
             glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-
-
-            simpleShader.setVec3("pointLight.position", pointLight.position);
-            simpleShader.setVec3("pointLight.ambient", pointLight.ambient);
-            simpleShader.setVec3("pointLight.diffuse", pointLight.diffuse);
-            simpleShader.setVec3("pointLight.specular", pointLight.specular);
-            simpleShader.setFloat("pointLight.constant", pointLight.constant);
-            simpleShader.setFloat("pointLight.linear", pointLight.linear);
-            simpleShader.setFloat("pointLight.quadratic", pointLight.quadratic);
-            simpleShader.setVec3("viewPosition", programState->camera.Position);
             simpleShader.setFloat("material.shininess", 32.0f);
-            simpleShader.setMat4("projection", projection);
-            simpleShader.setMat4("view", view);
-
-            for (int i = 0; i < 2; i++) {
-                string sl = "spotLights[" + to_string(i) + "].";
-                simpleShader.setVec3 (sl + "position", spotLights[i].position);
-                simpleShader.setVec3 (sl + "direction", spotLights[i].direction);
-                simpleShader.setVec3 (sl + "ambient", spotLights[i].ambient);
-                simpleShader.setVec3 (sl + "diffuse", spotLights[i].diffuse);
-                simpleShader.setVec3 (sl + "specular", spotLights[i].specular);
-                simpleShader.setFloat(sl + "constant", spotLights[i].constant);
-                simpleShader.setFloat(sl + "linear", spotLights[i].linear);
-                simpleShader.setFloat(sl + "quadratic", spotLights[i].quadratic);
-                simpleShader.setFloat(sl + "cutOff", spotLights[i].cutOff);
-                simpleShader.setFloat(sl + "outerCutOff", spotLights[i].outerCutOff);
-            }
 
 
-            glDisable(GL_CULL_FACE);
-            castle.render(&simpleShader);
-            glEnable(GL_CULL_FACE);
-            renderScene(&simpleShader);
+            renderScene(sceneQueue, &simpleShader, cameraLod, cameraCull);
         }
         else {
             normalShader.use();
-            normalShader.setVec3("pointLight.position", pointLight.position);
-            normalShader.setVec3("pointLight.ambient", pointLight.ambient);
-            normalShader.setVec3("pointLight.diffuse", pointLight.diffuse);
-            normalShader.setVec3("pointLight.specular", pointLight.specular);
-            normalShader.setFloat("pointLight.constant", pointLight.constant);
-            normalShader.setFloat("pointLight.linear", pointLight.linear);
-            normalShader.setFloat("pointLight.quadratic", pointLight.quadratic);
-            normalShader.setVec3("viewPosition", programState->camera.Position);
             normalShader.setFloat("material.shininess", 32.0f);
-            normalShader.setMat4("projection", projection);
-            normalShader.setMat4("view", view);
-            normalShader.setVec3("lightPos", pointLight.position);
-            for (int i = 0; i < 2; i++) {
-                string sl = "spotLights[" + to_string(i) + "].";
-                normalShader.setVec3 (sl + "position", spotLights[i].position);
-                normalShader.setVec3 (sl + "direction", spotLights[i].direction);
-                normalShader.setVec3 (sl + "ambient", spotLights[i].ambient);
-                normalShader.setVec3 (sl + "diffuse", spotLights[i].diffuse);
-                normalShader.setVec3 (sl + "specular", spotLights[i].specular);
-                normalShader.setFloat(sl + "constant", spotLights[i].constant);
-                normalShader.setFloat(sl + "linear", spotLights[i].linear);
-                normalShader.setFloat(sl + "quadratic", spotLights[i].quadratic);
-                normalShader.setFloat(sl + "cutOff", spotLights[i].cutOff);
-                normalShader.setFloat(sl + "outerCutOff", spotLights[i].outerCutOff);
-                normalShader.setVec3("SpotLightPos[" + to_string(i) + "]", spotLights[i].position);
-            }
 
 
-            glDisable(GL_CULL_FACE);
-            castle.render(&simpleShader);
-            glEnable(GL_CULL_FACE);
-            renderScene(&simpleShader);
+            renderScene(sceneQueue, &normalShader, cameraLod, cameraCull);
         }
         
 
@@ -638,6 +694,7 @@ int main() {
         glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
         glDrawArrays(GL_TRIANGLES, 0, 36);
         glBindVertexArray(0);
+        GeometryArena::instance().resetBinding();
         glDepthFunc(GL_LESS); // set depth function back to default
 
 
@@ -650,8 +707,28 @@ int main() {
         // -------------------------------------------------------------------------------
         glfwSwapBuffers(window);
         glfwPollEvents();
+        GLDeleteQueue::instance().endFrame();
+
+        if (startupTrace.recording()) {
+            firstFramePhase.end();
+            std::cout << "STARTUP:: first frame after " << startupTrace.stop() / 1000.0 << " ms" << std::endl;
+            if (writeStartupTrace && startupTrace.writeChromeTrace("startup_trace.json")) {
+                startupTrace.summary(std::cout);
+                std::cout << "STARTUP:: timeline written to startup_trace.json" << std::endl;
+            }
+        }
     }
 
+    if (memoryReport) {
+        MemoryTracker::instance().report(std::cout);
+        ResidencyManager::instance().report(std::cout);
+    }
+    // the objects hold the last references to the models, which must go while the context is current
+    castle.setModel(nullptr);
+    for (auto &object : objects)
+        object->setModel(nullptr);
+    textureStreamer.release();
+    GLDeleteQueue::instance().flush();
     delete programState;
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
@@ -742,10 +819,92 @@ void DrawImGui(ProgramState *programState) {
         ImGui::End();
     }
 
+    {
+        ImGui::Begin("Render queue");
+        const char *names[] = {"Shadow", "Scene"};
+        const RenderQueue *queues[] = {&shadowQueue, &sceneQueue};
+        for (int i = 0; i < 2; i++) {
+            const RenderQueueStats &stats = queues[i]->lastStats();
+            ImGui::Text("%-6s %4zu draws of %5zu instances, %5zu culled, %3zu programs, %3zu materials, %3zu VAOs, %3zu cull changes",
+                        names[i], stats.draws, stats.instances, stats.culled, stats.programChanges, stats.materialChanges,
+                        stats.geometryChanges, stats.cullChanges);
+        }
+        ImGui::End();
+    }
+
+    DrawMemoryPanel();
+
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
+void DrawMemoryPanel() {
+    MemoryTracker &tracker = MemoryTracker::instance();
+    ImGui::Begin("Memory");
+    ImGui::SliderInt("Texture streaming budget (MB)", &programState->textureBudgetMB, 16, 2048);
+    ImGui::SliderInt("Residency budget (MB)", &programState->residencyBudgetMB, 16, 4096);
+    MemoryUsage vram = tracker.domainUsage(MEMORY_VRAM), ram = tracker.domainUsage(MEMORY_RAM);
+    ImGui::Text("VRAM %.2f MB (peak %.2f MB)", MemoryTracker::megabytes(vram.current), MemoryTracker::megabytes(vram.peak));
+    ImGui::Text("Tracked RAM %.2f MB (peak %.2f MB), process resident %.2f MB", MemoryTracker::megabytes(ram.current),
+                MemoryTracker::megabytes(ram.peak), MemoryTracker::megabytes(MemoryTracker::residentBytes()));
+
+    if (ImGui::CollapsingHeader("By category", ImGuiTreeNodeFlags_DefaultOpen)) {
+        for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++) {
+            MemoryUsage usage = tracker.categoryUsage((MemoryCategory) c);
+            ImGui::Text("%-16s %9.2f MB  peak %9.2f MB", memoryCategoryName((MemoryCategory) c),
+                        MemoryTracker::megabytes(usage.current), MemoryTracker::megabytes(usage.peak));
+        }
+    }
+    if (ImGui::CollapsingHeader("By owner", ImGuiTreeNodeFlags_DefaultOpen)) {
+        for (const auto &owner : tracker.ownerUsage()) {
+            const MemoryUsage *usage = owner.second.domains;
+            ImGui::Text("%9.2f / %.2f MB  peak %.2f / %.2f MB  %s", MemoryTracker::megabytes(usage[MEMORY_VRAM].current),
+                        MemoryTracker::megabytes(usage[MEMORY_RAM].current), MemoryTracker::megabytes(usage[MEMORY_VRAM].peak),
+                        MemoryTracker::megabytes(usage[MEMORY_RAM].peak), owner.first.c_str());
+        }
+    }
+
+    // every live allocation; click a header to sort by that column
+    std::vector<MemoryRecord> records = tracker.snapshot();
+    ImGuiTableFlags flags = ImGuiTableFlags_Sortable | ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg |
+                            ImGuiTableFlags_ScrollY | ImGuiTableFlags_BordersOuter;
+    if (ImGui::BeginTable("allocations", 4, flags, ImVec2(0.0f, 300.0f))) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("MB", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending);
+        ImGui::TableSetupColumn("Category");
+        ImGui::TableSetupColumn("Owner");
+        ImGui::TableSetupColumn("Allocation");
+        ImGui::TableHeadersRow();
+
+        const ImGuiTableSortSpecs *sort = ImGui::TableGetSortSpecs();
+        int column = sort && sort->SpecsCount > 0 ? sort->Specs[0].ColumnIndex : 0;
+        bool descending = sort && sort->SpecsCount > 0 && sort->Specs[0].SortDirection == ImGuiSortDirection_Descending;
+        std::sort(records.begin(), records.end(), [column, descending](const MemoryRecord &a, const MemoryRecord &b) {
+            const MemoryRecord &x = descending ? b : a, &y = descending ? a : b;
+            switch (column) {
+                case 1: return x.category < y.category;
+                case 2: return x.owner < y.owner;
+                case 3: return x.label < y.label;
+                default: return x.bytes < y.bytes;
+            }
+        });
+
+        for (const MemoryRecord &record : records) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", MemoryTracker::megabytes(record.bytes));
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(memoryCategoryName(record.category));
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(record.owner.c_str());
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(record.label.c_str());
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
+
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
     if (key == GLFW_KEY_F1 && action == GLFW_PRESS) {
         programState->ImGuiEnabled = !programState->ImGuiEnabled;
@@ -764,9 +923,15 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         speed -= 1;
 }
 
-void renderScene(Shader *shader) {
+// draws the castle and the objects through the queue, sorted for its pass; lod.eye is the viewer and
+// whatever cull cannot see is left out
+void renderScene(RenderQueue &queue, Shader *shader, const LodView &lod, const CullView &cull) {
+    queue.clear(lod.eye);
+    castle.submit(queue, shader, &lod, &cull);
     for (auto& object : objects)
-        object->render(shader);
+        object->submit(queue, shader, &lod, &cull);
+    queue.sort();
+    queue.execute();
 }
 
 unsigned int loadCubemap(vector<std::string> faces)
@@ -775,15 +940,36 @@ unsigned int loadCubemap(vector<std::string> faces)
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
+    // use the texture_cook output when all six faces have a fresh one in the same supported format
+    vector<CompressedImage> cooked(faces.size());
+    bool useCooked = true;
+    for (unsigned int i = 0; i < faces.size() && useCooked; i++)
+    {
+        string cookedPath = DDS::cookedPath(faces[i]);
+        useCooked = DDS::isFresh(cookedPath, faces[i]) && DDS::read(cookedPath, cooked[i]) &&
+                    cooked[i].format == cooked[0].format && CompressedTexture::supported(cooked[i].format);
+    }
+
     int width, height, nrChannels;
+    size_t bytes = 0;
     for (unsigned int i = 0; i < faces.size(); i++)
     {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
+        if (useCooked)
+        {
+            bytes += cooked[i].levelSizes[0];
+            // the cubemap samples without mipmaps, so only the base level is needed
+            glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, CompressedTexture::glFormat(cooked[i].format),
+                                   cooked[i].width, cooked[i].height, 0, (GLsizei) cooked[i].levelSizes[0], cooked[i].levels[0]);
+            continue;
+        }
+        MappedFile file(faces[i]);
+        unsigned char *data = file.isOpen() ? stbi_load_from_memory(file.data(), (int) file.size(), &width, &height, &nrChannels, 0) : nullptr;
         if (data)
         {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
                          0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
             );
+            bytes += (size_t) width * height * 3;
             stbi_image_free(data);
         }
         else
@@ -797,6 +983,7 @@ unsigned int loadCubemap(vector<std::string> faces)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    MemoryTracker::instance().track(MEMORY_ENVIRONMENT, "scene", "skybox cubemap", bytes);
 
     return textureID;
 }
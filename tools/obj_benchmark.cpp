@@ -0,0 +1,103 @@
+// obj_benchmark: parse throughput of ObjLoader against Assimp on Wavefront OBJ files.
+// For every file it reports MB/s for ObjLoader's parallel parse alone, for the complete ObjLoader import
+// (parse, MTL, triangulation, normals and tangents), and for Assimp's ReadFile with MODEL_IMPORT_FLAGS.
+//
+//   obj_benchmark [--repeat N] [file.obj...]      (defaults to every .obj under resources/objects)
+
+#include <learnopengl/model.h>
+
+#include <mapped_file.h>
+#include <obj_loader.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+static void collect(const std::string &path, std::vector<std::string> &files) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return;
+    if (S_ISREG(st.st_mode)) {
+        if (path.size() > 4 && path.compare(path.size() - 4, 4, ".obj") == 0)
+            files.push_back(path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode))
+        return;
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return;
+    while (dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] != '.')
+            collect(path + '/' + entry->d_name, files);
+    }
+    closedir(dir);
+}
+
+// best of `repeat` runs, in seconds
+static double bestTime(int repeat, const std::function<void()> &run) {
+    double best = 1e30;
+    for (int i = 0; i < repeat; i++) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    int repeat = 5;
+    std::vector<std::string> roots, files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+            repeat = std::max(1, atoi(argv[++i]));
+        else
+            roots.push_back(argv[i]);
+    }
+    if (roots.empty())
+        roots.push_back("resources/objects");
+    for (const std::string &root : roots)
+        collect(root, files);
+    std::sort(files.begin(), files.end());
+
+    printf("%-48s %9s %12s %12s %12s %8s\n", "file", "KB", "parse MB/s", "obj MB/s", "assimp MB/s", "speedup");
+    double totalBytes = 0, totalParse = 0, totalObj = 0, totalAssimp = 0;
+    for (const std::string &file : files) {
+        MappedFile mapped(file);
+        if (!mapped.isOpen())
+            continue;
+        double megabytes = mapped.size() / (1024.0 * 1024.0);
+
+        double parse = bestTime(repeat, [&] {
+            std::vector<ObjChunk> chunks = ObjLoader::parse(reinterpret_cast<const char *>(mapped.data()), mapped.size());
+        });
+        double obj = bestTime(repeat, [&] {
+            std::vector<MeshData> meshes;
+            ObjLoader::load(file, meshes);
+        });
+        bool assimpOk = true;
+        double assimp = bestTime(repeat, [&] {
+            Assimp::Importer importer;
+            assimpOk = importer.ReadFile(file, MODEL_IMPORT_FLAGS) != nullptr && assimpOk;
+        });
+
+        printf("%-48s %9.1f %12.1f %12.1f %12.1f %7.1fx%s\n", file.c_str(), mapped.size() / 1024.0, megabytes / parse,
+               megabytes / obj, megabytes / assimp, assimp / obj, assimpOk ? "" : "  (assimp failed)");
+        totalBytes += megabytes;
+        totalParse += parse;
+        totalObj += obj;
+        totalAssimp += assimp;
+    }
+    if (totalBytes > 0)
+        printf("%-48s %9.1f %12.1f %12.1f %12.1f %7.1fx\n", "total", totalBytes * 1024.0, totalBytes / totalParse,
+               totalBytes / totalObj, totalBytes / totalAssimp, totalAssimp / totalObj);
+    return 0;
+}
@@ -0,0 +1,186 @@
+// pak_build: packs every file under the given directories into one resource archive (see pak_archive.h).
+// Entries are named relative to the root and LZ4 compressed whenever that saves at least an eighth of
+// their size; the rest are stored as is so the renderer can read them straight from the mapping.
+// Cooked caches (.dds, .mipcache, .meshcache) next to the sources are packed along with them.
+//
+//   pak_build [--store] <output.pak> <root> [directory...]      (directories default to <root>/resources)
+
+#include <lz4_block.h>
+#include <mapped_file.h>
+#include <pak_archive.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct SourceFile {
+    std::string path; // as found
+    std::string name; // relative to the root
+    int64_t modified;
+};
+
+static bool endsWith(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static void collect(const std::string &path, std::vector<std::string> &files) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return;
+    if (S_ISREG(st.st_mode)) {
+        // skips archives and the leftovers of interrupted cache writes ("x.mipcache.tmp1234")
+        std::string name = path.substr(path.find_last_of('/') + 1);
+        if (!endsWith(name, ".pak") && name.find(".tmp") == std::string::npos)
+            files.push_back(path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode))
+        return;
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return;
+    while (dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] != '.')
+            collect(path + '/' + entry->d_name, files);
+    }
+    closedir(dir);
+}
+
+static void pad(std::ofstream &out, uint64_t &offset, uint64_t alignment) {
+    static const char zeros[PAK_MIN_ALIGNMENT] = {};
+    while (offset % alignment) {
+        uint64_t step = std::min<uint64_t>(alignment - offset % alignment, sizeof(zeros));
+        out.write(zeros, (std::streamsize) step);
+        offset += step;
+    }
+}
+
+int main(int argc, char **argv) {
+    bool store = false;
+    std::vector<std::string> arguments;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--store") == 0)
+            store = true;
+        else
+            arguments.push_back(argv[i]);
+    }
+    if (arguments.size() < 2) {
+        std::cout << "usage: pak_build [--store] <output.pak> <root> [directory...]" << std::endl;
+        return 1;
+    }
+    std::string output = arguments[0], root = arguments[1];
+    std::vector<std::string> directories(arguments.begin() + 2, arguments.end());
+    if (directories.empty())
+        directories.push_back(root + "/resources");
+
+    std::string cwd = PakArchive::currentDirectory();
+    std::string rootPrefix = PakArchive::normalize(root, cwd);
+    if (rootPrefix.back() != '/')
+        rootPrefix += '/';
+    std::vector<std::string> paths;
+    for (const std::string &directory : directories)
+        collect(directory, paths);
+
+    std::vector<SourceFile> files;
+    for (const std::string &path : paths) {
+        std::string normalized = PakArchive::normalize(path, cwd);
+        if (normalized.compare(0, rootPrefix.size(), rootPrefix) != 0) {
+            std::cout << "skipped " << path << ": not below " << root << std::endl;
+            continue;
+        }
+        struct stat st;
+        stat(path.c_str(), &st);
+        files.push_back(SourceFile{path, normalized.substr(rootPrefix.size()), (int64_t) st.st_mtime});
+    }
+    // neighbouring files of one model end up next to each other in the archive
+    std::sort(files.begin(), files.end(), [](const SourceFile &a, const SourceFile &b) { return a.name < b.name; });
+    files.erase(std::unique(files.begin(), files.end(), [](const SourceFile &a, const SourceFile &b) { return a.name == b.name; }), files.end());
+
+    std::ofstream out(output, std::ios::binary);
+    if (!out) {
+        std::cout << "could not write " << output << std::endl;
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    PakHeader header = {};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    uint64_t offset = sizeof(header);
+
+    std::vector<PakEntry> entries;
+    std::string names;
+    uint64_t sourceBytes = 0, compressedCount = 0;
+    std::vector<unsigned char> compressed;
+    for (const SourceFile &source : files) {
+        MappedFile file(source.path);
+        PakEntry entry = {};
+        entry.nameHash = PakArchive::hashName(source.name.data(), source.name.size());
+        entry.nameOffset = (uint32_t) names.size();
+        entry.nameLength = (uint32_t) source.name.size();
+        entry.modified = source.modified;
+        entry.size = file.size();
+        names += source.name;
+
+        const unsigned char *bytes = file.data();
+        size_t storedSize = file.size();
+        entry.compression = PAK_STORED;
+        if (!store && file.size() > 0 && file.size() < ((uint64_t) 1 << 32)) {
+            compressed.resize(LZ4Block::bound(file.size()));
+            size_t compressedSize = LZ4Block::compress(file.data(), file.size(), compressed.data());
+            if (compressedSize <= file.size() - file.size() / 8) {
+                entry.compression = PAK_LZ4;
+                bytes = compressed.data();
+                storedSize = compressedSize;
+                compressedCount++;
+            }
+        }
+        pad(out, offset, entry.compression == PAK_STORED && storedSize >= PAK_ALIGNMENT ? PAK_ALIGNMENT : PAK_MIN_ALIGNMENT);
+        entry.offset = offset;
+        entry.storedSize = storedSize;
+        out.write(reinterpret_cast<const char *>(bytes), (std::streamsize) storedSize);
+        offset += storedSize;
+        sourceBytes += file.size();
+        entries.push_back(entry);
+    }
+
+    // the index: slots for linear probing at most half full, then the entries and their names
+    uint32_t slotCount = 2;
+    while (slotCount < entries.size() * 2)
+        slotCount *= 2;
+    std::vector<uint32_t> slots(slotCount, 0);
+    for (size_t i = 0; i < entries.size(); i++) {
+        uint32_t slot = (uint32_t) entries[i].nameHash & (slotCount - 1);
+        while (slots[slot] != 0)
+            slot = (slot + 1) & (slotCount - 1);
+        slots[slot] = (uint32_t) i + 1;
+    }
+    pad(out, offset, 8);
+    header.magic = PAK_MAGIC;
+    header.version = PAK_VERSION;
+    header.entryCount = (uint32_t) entries.size();
+    header.slotCount = slotCount;
+    header.indexOffset = offset;
+    header.indexSize = slots.size() * sizeof(uint32_t) + entries.size() * sizeof(PakEntry) + names.size();
+    out.write(reinterpret_cast<const char *>(slots.data()), (std::streamsize) (slots.size() * sizeof(uint32_t)));
+    out.write(reinterpret_cast<const char *>(entries.data()), (std::streamsize) (entries.size() * sizeof(PakEntry)));
+    out.write(names.data(), (std::streamsize) names.size());
+    offset += header.indexSize;
+    out.seekp(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.close();
+    if (!out) {
+        std::cout << "failed to write " << output << std::endl;
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "packed " << entries.size() << " files (" << compressedCount << " compressed) in " << seconds << " s, "
+              << sourceBytes / (1024.0 * 1024.0) << " MB -> " << offset / (1024.0 * 1024.0) << " MB  " << output << std::endl;
+    return 0;
+}
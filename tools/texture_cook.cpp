@@ -0,0 +1,187 @@
+// texture_cook: converts the JPG/PNG textures under the given files or directories into block compressed
+// DDS files with full mip chains, written next to each source ("name.jpg" -> "name.dds").
+// The renderer picks the cooked file up automatically whenever it is at least as new as its source.
+//
+//   texture_cook [--force] [path...]      (defaults to resources/objects and resources/textures)
+
+#include <block_compression.h>
+#include <dds.h>
+#include <stb_image.h>
+#include <thread_pool.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static bool endsWith(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size() && std::equal(suffix.rbegin(), suffix.rend(), s.rbegin(),
+                                                   [](char a, char b) { return tolower(a) == tolower(b); });
+}
+
+static bool contains(const std::string &s, const char *needle) {
+    return s.find(needle) != std::string::npos;
+}
+
+static void collect(const std::string &path, std::vector<std::string> &files) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return;
+    if (S_ISREG(st.st_mode)) {
+        if (endsWith(path, ".jpg") || endsWith(path, ".jpeg") || endsWith(path, ".png"))
+            files.push_back(path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode))
+        return;
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return;
+    while (dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] != '.')
+            collect(path + '/' + entry->d_name, files);
+    }
+    closedir(dir);
+}
+
+// picks the block format from the file name and contents:
+// tangent-space normal maps -> BC5, grayscale bump/height maps -> BC4, alpha -> BC3, anything else -> BC1
+static BlockFormat chooseFormat(const std::string &path, const unsigned char *rgba, int width, int height) {
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    bool gray = true, alpha = false;
+    for (size_t i = 0; i < (size_t) width * height; i++) {
+        const unsigned char *p = rgba + i * 4;
+        gray = gray && p[0] == p[1] && p[1] == p[2];
+        alpha = alpha || p[3] != 255;
+    }
+    if (gray && !alpha)
+        return BLOCK_BC4;
+    if (contains(name, "NORMAL") || contains(name, "Normal") || contains(name, "normal") || contains(name, "_Bump"))
+        return BLOCK_BC5;
+    return alpha ? BLOCK_BC3 : BLOCK_BC1;
+}
+
+// 2x2 box filter; normal maps are renormalised so the mips stay unit length
+static std::vector<unsigned char> downsample(const std::vector<unsigned char> &src, int width, int height, bool normalMap) {
+    int w = std::max(1, width / 2), h = std::max(1, height / 2);
+    std::vector<unsigned char> dst((size_t) w * h * 4);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            float sum[4] = {0, 0, 0, 0};
+            for (int dy = 0; dy < 2; dy++) {
+                for (int dx = 0; dx < 2; dx++) {
+                    int sx = std::min(x * 2 + dx, width - 1), sy = std::min(y * 2 + dy, height - 1);
+                    const unsigned char *p = &src[((size_t) sy * width + sx) * 4];
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += p[c];
+                }
+            }
+            unsigned char *out = &dst[((size_t) y * w + x) * 4];
+            if (normalMap) {
+                float n[3], length = 0.0f;
+                for (int c = 0; c < 3; c++) {
+                    n[c] = sum[c] / (4.0f * 127.5f) - 1.0f;
+                    length += n[c] * n[c];
+                }
+                length = length > 0.0f ? std::sqrt(length) : 1.0f;
+                for (int c = 0; c < 3; c++)
+                    out[c] = (unsigned char) std::lround((n[c] / length + 1.0f) * 127.5f);
+                out[3] = (unsigned char) std::lround(sum[3] / 4.0f);
+            } else {
+                for (int c = 0; c < 4; c++)
+                    out[c] = (unsigned char) std::lround(sum[c] / 4.0f);
+            }
+        }
+    }
+    return dst;
+}
+
+static const char *formatName(BlockFormat format) {
+    switch (format) {
+        case BLOCK_BC1: return "BC1";
+        case BLOCK_BC3: return "BC3";
+        case BLOCK_BC4: return "BC4";
+        case BLOCK_BC5: return "BC5";
+    }
+    return "?";
+}
+
+int main(int argc, char **argv) {
+    bool force = false;
+    std::vector<std::string> roots;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--force") == 0)
+            force = true;
+        else
+            roots.push_back(argv[i]);
+    }
+    if (roots.empty()) {
+        roots.push_back("resources/objects");
+        roots.push_back("resources/textures");
+    }
+
+    std::vector<std::string> files;
+    for (const std::string &root : roots)
+        collect(root, files);
+
+    ThreadPool pool;
+    auto start = std::chrono::steady_clock::now();
+    size_t cooked = 0, sourceBytes = 0, cookedBytes = 0;
+    for (const std::string &file : files) {
+        std::string target = DDS::cookedPath(file);
+        if (!force && DDS::isFresh(target, file))
+            continue;
+
+        int width, height, components;
+        unsigned char *pixels = stbi_load(file.c_str(), &width, &height, &components, 4);
+        if (!pixels) {
+            std::cout << "skipped " << file << ": " << stbi_failure_reason() << std::endl;
+            continue;
+        }
+        // palettes such as T34.vox.png (256x1) need exact texel values and are tiny anyway
+        if (width < 4 || height < 4) {
+            std::cout << "skipped " << file << ": smaller than a block" << std::endl;
+            stbi_image_free(pixels);
+            continue;
+        }
+
+        BlockFormat format = chooseFormat(file, pixels, width, height);
+        std::vector<unsigned char> level(pixels, pixels + (size_t) width * height * 4);
+        stbi_image_free(pixels);
+
+        std::vector<std::vector<unsigned char>> levels;
+        int w = width, h = height;
+        for (;;) {
+            levels.push_back(BlockCompressor::compress(level.data(), w, h, format, pool));
+            if (w == 1 && h == 1)
+                break;
+            level = downsample(level, w, h, format == BLOCK_BC5);
+            w = std::max(1, w / 2);
+            h = std::max(1, h / 2);
+        }
+
+        if (!DDS::write(target, format, width, height, levels)) {
+            std::cout << "failed to write " << target << std::endl;
+            continue;
+        }
+        size_t size = 0;
+        for (const std::vector<unsigned char> &l : levels)
+            size += l.size();
+        std::cout << formatName(format) << " " << width << "x" << height << " " << levels.size() << " mips  " << target << std::endl;
+        cooked++;
+        sourceBytes += (size_t) width * height * components * 4 / 3;
+        cookedBytes += size;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "cooked " << cooked << " of " << files.size() << " textures in " << seconds << " s on " << pool.size()
+              << " threads, " << sourceBytes / (1024.0 * 1024.0) << " MB -> " << cookedBytes / (1024.0 * 1024.0)
+              << " MB of texture memory" << std::endl;
+    return 0;
+}